@@ -3,3 +3,5 @@ CONFIG += ordered
 include(common.pri)
 qttelnet-uselib:SUBDIRS=buildlib
 SUBDIRS+=examples
+SUBDIRS+=tools
+SUBDIRS+=tests
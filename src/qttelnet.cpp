@@ -65,10 +65,27 @@
     You can use your own socket if you call setSocket() before
     connecting. The socket used by QtTelnet is available from
     socket().
+
+    An idle session is budgeted at 2 KB of memory for QtTelnet's own
+    state on 64-bit platforms, both before connecting and once
+    connected and negotiated. The socket is not counted; it is only
+    created by connectToHost() or socket(). State for optional
+    features, such as LINEMODE or changed prompt patterns, is only
+    allocated when the feature is used. The footprint tool in the tools
+    directory measures the resident memory of many idle sessions, less
+    that of as many plain sockets when they are connected, and fails
+    if the budget is exceeded.
 */
 
 #include "qttelnet.h"
+#include "qttelnettranscript.h"
+#include "qttelnetcore.h"
+#include "qttelnettrace.h"
 #include <QtNetwork/QTcpSocket>
+#include <QtNetwork/QHostInfo>
+#ifndef QTTELNET_NO_SSL
+#  include <QtNetwork/QSslSocket>
+#endif
 #include <QtCore/QList>
 #include <QtCore/QMap>
 #include <QtCore/QPair>
@@ -76,7 +93,26 @@
 #include <QtCore/QSocketNotifier>
 #include <QtCore/QBuffer>
 #include <QtCore/QVarLengthArray>
+#include <QtCore/QTextCodec>
+#include <QtCore/QTimer>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QCoreApplication>
+#if QT_VERSION >= 0x050a00
+#  include <QtCore/QRandomGenerator>
+#endif
+#include <string.h>
+#include <stdlib.h>
 
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define QTTELNET_HAVE_SSE2
+#  include <emmintrin.h>
+#endif
 
 #ifdef Q_OS_WIN
 #  include <winsock2.h>
@@ -84,8 +120,13 @@
 #if defined (Q_OS_UNIX)
 #  include <sys/types.h>
 #  include <sys/socket.h>
+#  include <sys/select.h>
+#  include <sys/time.h>
 #  include <netinet/in.h>
 #endif
+#ifndef MSG_OOB
+#  define MSG_OOB 1
+#endif
 
 // #define QTTELNET_DEBUG
 
@@ -93,184 +134,236 @@
 #include <QtCore/QDebug>
 #endif
 
-class QtTelnetAuth
+/*
+  Returns true if none of the \a length bytes at \a data have the high
+  bit set, i.e. the data can be widened to UTF-16 without decoding.
+*/
+static bool isAscii(const char *data, int length)
 {
-public:
-    enum State { AuthIntermediate, AuthSuccess, AuthFailure };
+    const char *end = data + length;
+#ifdef QTTELNET_HAVE_SSE2
+    for (; end - data >= 16; data += 16) {
+        const __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        if (_mm_movemask_epi8(v))
+            return false;
+    }
+#endif
+    for (; end - data >= 8; data += 8) {
+        quint64 v;
+        memcpy(&v, data, sizeof(v));
+        if (v & Q_UINT64_C(0x8080808080808080))
+            return false;
+    }
+    for (; data < end; ++data) {
+        if (uchar(*data) & 0x80)
+            return false;
+    }
+    return true;
+}
 
-    QtTelnetAuth(char code) : st(AuthIntermediate), cd(code) {};
-    virtual ~QtTelnetAuth() {}
+static int utf8SequenceLength(uchar lead)
+{
+    if (lead >= 0xf0)
+        return 4;
+    if (lead >= 0xe0)
+        return 3;
+    if (lead >= 0xc0)
+        return 2;
+    return 1;
+}
 
-    int code() const { return cd; }
-    State state() const { return st; }
-    void setState(State state) { st = state; };
+/*
+  Returns the number of bytes at the end of \a data that form the
+  start of a UTF-8 sequence which continues in the next read.
+*/
+static int utf8IncompleteTail(const char *data, int length)
+{
+    for (int i = 1; i <= 3 && i <= length; ++i) {
+        const uchar c = uchar(data[length - i]);
+        if ((c & 0xc0) == 0x80) // continuation byte
+            continue;
+        return (utf8SequenceLength(c) > i ? i : 0);
+    }
+    return 0;
+}
 
-    virtual QByteArray authStep(const QByteArray &data) = 0;
+/*
+  Reconnect delays shared by all sessions in the process, so that a
+  flapping server is backed off from by every session connected to it,
+  and a global rate limit caps the number of reconnects per second.
+*/
+class QtTelnetReconnectPolicy
+{
+public:
+    QtTelnetReconnectPolicy() : rate(0), nextslot(0) { clock.start(); }
 
-private:
-    State st;
-    int   cd;
+    int delay(const QString &host, int initial, int maximum);
+    void succeeded(const QString &host);
+
+    QMutex mutex;
+    QHash<QString, int> failures;
+    QElapsedTimer clock;
+    int rate;
+    qint64 nextslot;
 };
 
-class QtTelnetReceiveBuffer
+Q_GLOBAL_STATIC(QtTelnetReconnectPolicy, reconnectPolicy)
+
+/*
+  Returns the delay in milliseconds before the next reconnect to \a host:
+  an exponential backoff with full jitter, pushed back further if needed
+  to stay within the global rate limit.
+*/
+int QtTelnetReconnectPolicy::delay(const QString &host, int initial,
+                                   int maximum)
+{
+    QMutexLocker locker(&mutex);
+    const int n = failures.value(host);
+    failures.insert(host, n + 1);
+
+    qint64 backoff = qint64(qMax(1, initial)) << qMin(n, 20);
+    backoff = qMin(backoff, qint64(qMax(initial, maximum)));
+#if QT_VERSION >= 0x050a00
+    qint64 msecs = backoff / 2
+        + QRandomGenerator::global()->bounded(quint32(backoff / 2 + 1));
+#else
+    qint64 msecs = backoff / 2 + (qrand() % (backoff / 2 + 1));
+#endif
+    if (rate > 0) {
+        const qint64 now = clock.elapsed();
+        const qint64 slot = qMax(now + msecs, nextslot);
+        nextslot = slot + qMax(1, 1000 / rate);
+        msecs = slot - now;
+    }
+    return int(msecs);
+}
+
+void QtTelnetReconnectPolicy::succeeded(const QString &host)
+{
+    QMutexLocker locker(&mutex);
+    failures.remove(host);
+}
+
+#ifndef QTTELNET_NO_SSL
+/*
+  TLS sessions from earlier connections, by host and port, so that new
+  connections to the same server can resume them instead of going
+  through a full handshake.
+*/
+class QtTelnetTlsSessionCache
 {
 public:
-    QtTelnetReceiveBuffer() : bytesAvailable(0) {}
-    void append(const QByteArray &data) { buffers.append(data); }
-    void push_back(const QByteArray &data) { buffers.prepend(data); }
-    long size() const { return bytesAvailable; }
-    QByteArray readAll()
+    QByteArray session(const QString &key)
     {
-        QByteArray a;
-        while (!buffers.isEmpty()) {
-            a.append(buffers.takeFirst());
-        }
-        return a;
+        QMutexLocker locker(&mutex);
+        return sessions.value(key);
+    }
+    void setSession(const QString &key, const QByteArray &session)
+    {
+        QMutexLocker locker(&mutex);
+        sessions.insert(key, session);
     }
 
 private:
-    QList<QByteArray> buffers;
-    long bytesAvailable;
+    QMutex mutex;
+    QHash<QString, QByteArray> sessions;
+};
+
+Q_GLOBAL_STATIC(QtTelnetTlsSessionCache, tlsSessionCache)
+#endif
+
+class QtTelnetAuthenticatorPrivate
+{
+public:
+    QtTelnetAuthenticatorPrivate(int type, int modifiers)
+        : type(type), modifiers(modifiers),
+          state(QtTelnetAuthenticator::Idle), telnet(0)
+    {}
+
+    int type, modifiers;
+    QtTelnetAuthenticator::State state;
+    QtTelnet *telnet; // 0 until added to a session
 };
 
-namespace Common // RFC854
-{
-    // Commands
-    const uchar CEOF  = 236;
-    const uchar SUSP  = 237;
-    const uchar ABORT = 238;
-    const uchar SE    = 240;
-    const uchar NOP   = 241;
-    const uchar DM    = 242;
-    const uchar BRK   = 243;
-    const uchar IP    = 244;
-    const uchar AO    = 245;
-    const uchar AYT   = 246;
-    const uchar EC    = 247;
-    const uchar EL    = 248;
-    const uchar GA    = 249;
-    const uchar SB    = 250;
-    const uchar WILL  = 251;
-    const uchar WONT  = 252;
-    const uchar DO    = 253;
-    const uchar DONT  = 254;
-    const uchar IAC   = 255;
-
-    // Types
-    const char IS    = 0;
-    const char SEND  = 1;
-
-    const char Authentication = 37; // RFC1416,
-                                    // implemented to always return NULL
-    const char SuppressGoAhead = 3; // RFC858
-    const char Echo = 1; // RFC857, not implemented (returns WONT/DONT)
-    const char LineMode = 34; // RFC1184, implemented
-    const uchar LineModeEOF = 236, // RFC1184, not implemented
-                LineModeSUSP = 237,
-                LineModeABORT = 238;
-    const char Status = 5; // RFC859, should be implemented!
-    const char Logout = 18; // RFC727, implemented
-    const char TerminalType = 24; // RFC1091,
-                                  // implemented to always return UNKNOWN
-    const char NAWS = 31; // RFC1073, implemented
-    const char TerminalSpeed = 32; // RFC1079, not implemented
-    const char FlowControl = 33; // RFC1372, should be implemented?
-    const char XDisplayLocation = 35; // RFC1096, not implemented
-    const char EnvironmentOld = 36; // RFC1408, should not be implemented!
-    const char Environment = 39; // RFC1572, should be implemented
-    const char Encrypt = 38; // RFC2946, not implemented
+char *QtTelnetArena::allocate(int size)
+{
+    if (used + size <= capacity) {
+        char *p = block + used;
+        used += size;
+        return p;
+    }
+    // Keep earlier allocations valid; the block is resized on reset()
+    Overflow *o = static_cast<Overflow *>(::malloc(sizeof(Overflow) + size));
+    Q_CHECK_PTR(o);
+    o->next = overflow;
+    overflow = o;
+    overflowsize += size;
+    return reinterpret_cast<char *>(o + 1);
+}
+
+void QtTelnetArena::reset()
+{
+    if (overflow) {
+        releaseOverflow();
+        ::free(block);
+        capacity = qMax(4096, used + overflowsize);
+        block = static_cast<char *>(::malloc(capacity));
+        Q_CHECK_PTR(block);
+        overflowsize = 0;
+    }
+    used = 0;
+}
+
+void QtTelnetArena::releaseOverflow()
+{
+    while (overflow) {
+        Overflow *next = overflow->next;
+        ::free(overflow);
+        overflow = next;
+    }
+}
+
+static QThreadStorage<QtTelnetArena *> readArenas;
+
+QtTelnetArena *qtTelnetReadArena()
+{
+    if (!readArenas.hasLocalData())
+        readArenas.setLocalData(new QtTelnetArena);
+    return readArenas.localData();
+}
+
+#ifdef QTTELNET_DEBUG
+/*
+  Returns the name of \a value from \a names, which lists the names
+  of the values from \a first on, or \a unknown and the number if it
+  has none.
+*/
+template <int N>
+static QString nameStr(const char *const (&names)[N], int first, int value,
+                       const char *unknown)
+{
+    const int i = value - first;
+    if (i >= 0 && i < N && names[i])
+        return QLatin1String(names[i]);
+    return QString("%1 (%2)").arg(QLatin1String(unknown)).arg(value);
+}
+#endif
 
+namespace Common
+{
 #ifdef QTTELNET_DEBUG
     QString typeStr(char op)
     {
-        QString str;
-        switch (op) {
-        case IS:
-            str = "IS";
-            break;
-        case SEND:
-            str = "SEND";
-            break;
-        default:
-            str = QString("Unknown common type (%1)").arg(op);
-        }
-        return str;
+        static const char *const names[] = { "IS", "SEND", "INFO" };
+        return nameStr(names, IS, op, "Unknown common type");
     }
     QString operationStr(char op)
     {
-        QString str;
-        switch (quint8(op)) {
-        case quint8(WILL):
-            str = "WILL";
-            break;
-        case quint8(WONT):
-            str = "WONT";
-            break;
-        case quint8(DO):
-            str = "DO";
-            break;
-        case quint8(DONT):
-            str = "DONT";
-            break;
-        case quint8(SB):
-            str = "SB";
-            break;
-        default:
-            str = QString("Unknown operation (%1)").arg(quint8(op));
-        }
-        return str;
-    }
-
-    QString optionStr(char op)
-    {
-        QString str;
-        switch (op) {
-        case Authentication:
-            str = "AUTHENTICATION";
-            break;
-        case SuppressGoAhead:
-            str = "SUPPRESS GO AHEAD";
-            break;
-        case Echo:
-            str = "ECHO";
-            break;
-        case LineMode:
-            str = "LINEMODE";
-            break;
-        case Status:
-            str = "STATUS";
-            break;
-        case Logout:
-            str = "LOGOUT";
-            break;
-        case TerminalType:
-            str = "TERMINAL-TYPE";
-            break;
-        case TerminalSpeed:
-            str = "TERMINAL-SPEED";
-            break;
-        case NAWS:
-            str = "NAWS";
-            break;
-        case FlowControl:
-            str = "TOGGLE-FLOW-CONTROL";
-            break;
-        case XDisplayLocation:
-            str = "X-DISPLAY-LOCATION";
-            break;
-        case EnvironmentOld:
-            str = "ENVIRON";
-            break;
-        case Environment:
-            str = "NEW-ENVIRON";
-            break;
-        case Encrypt:
-            str = "ENCRYPT";
-            break;
-        default:
-            str = QString("Unknown option (%1)").arg(op);
-        }
-        return str;
+        static const char *const names[] = {
+            "SB", "WILL", "WONT", "DO", "DONT"
+        };
+        return nameStr(names, SB, quint8(op), "Unknown operation");
     }
 #endif
 };
@@ -313,108 +406,76 @@ namespace Auth // RFC1416
 #ifdef QTTELNET_DEBUG
     QString authStr(int op)
     {
-        QString str;
-        switch (op) {
-        case REPLY:
-            str = "REPLY";
-            break;
-        case NAME:
-            str = "NAME";
-            break;
-        default:
-            str = QString("Unknown auth (%1)").arg(op);
-        }
-        return str;
+        static const char *const names[] = { "REPLY", "NAME" };
+        return nameStr(names, REPLY, op, "Unknown auth");
     }
     QString typeStr(int op)
     {
-        QString str;
-        switch (op) {
-        case AUTHNULL:
-            str = "NULL";
-            break;
-        case KERBEROS_V4:
-            str = "KERBEROS_V4";
-            break;
-        case KERBEROS_V5:
-            str = "KERBEROS_V5";
-            break;
-        case SPX:
-            str = "SPX";
-            break;
-        case SRA:
-            str = "SRA";
-            break;
-        case LOKI:
-            str = "LOKI";
-            break;
-        default:
-            str = QString("Unknown auth type (%1)").arg(op);
-        }
-        return str;
+        static const char *const names[] = {
+            "NULL", "KERBEROS_V4", "KERBEROS_V5", "SPX", 0, 0, "SRA",
+            0, 0, 0, "LOKI"
+        };
+        return nameStr(names, AUTHNULL, op, "Unknown auth type");
     }
     QString whoStr(int op)
     {
-        QString str;
-        op = op & AUTH_WHO_MASK;
-        switch (op) {
-        case AUTH_CLIENT_TO_SERVER:
-            str = "CLIENT";
-            break;
-        case AUTH_SERVER_TO_CLIENT:
-            str = "SERVER";
-            break;
-        default:
-            str = QString("Unknown who type (%1)").arg(op);
-        }
-        return str;
+        static const char *const names[] = { "CLIENT", "SERVER" };
+        return nameStr(names, 0, op & AUTH_WHO_MASK, "Unknown who type");
     }
     QString howStr(int op)
     {
-        QString str;
-        op = op & AUTH_HOW_MASK;
-        switch (op) {
-        case AUTH_HOW_ONE_WAY:
-            str = "ONE-WAY";
-            break;
-        case AUTH_HOW_MUTUAL:
-            str = "MUTUAL";
-            break;
-        default:
-            str = QString("Unknown how type (%1)").arg(op);
-        }
-        return str;
+        static const char *const names[] = { "ONE-WAY", 0, "MUTUAL" };
+        return nameStr(names, 0, op & AUTH_HOW_MASK, "Unknown how type");
     }
     QString sraStr(int op)
     {
-        QString str;
-        switch (op) {
-        case SRA_KEY:
-            str = "KEY";
-            break;
-        case SRA_REJECT:
-            str = "REJECT";
-            break;
-        case SRA_ACCEPT:
-            str = "ACCEPT";
-            break;
-        case SRA_USER:
-            str = "USER";
-            break;
-        case SRA_CONTINUE:
-            str = "CONTINUE";
-            break;
-        case SRA_PASSWORD:
-            str = "PASSWORD";
-            break;
-        default:
-            str = QString("Unknown SRA option (%1)").arg(op);
-        }
-        return str;
+        static const char *const names[] = {
+            "KEY", "USER", "CONTINUE", "PASSWORD", "ACCEPT", "REJECT"
+        };
+        return nameStr(names, SRA_KEY, op, "Unknown SRA option");
     }
 #endif
 };
 
+namespace Environ // RFC1572
+{
+    const char VAR = 0;
+    const char VALUE = 1;
+    const char ESC = 2;
+    const char USERVAR = 3;
+
+    bool isWellKnown(const QString &name)
+    {
+        return (name == QLatin1String("USER")
+                || name == QLatin1String("JOB")
+                || name == QLatin1String("ACCT")
+                || name == QLatin1String("PRINTER")
+                || name == QLatin1String("SYSTEMTYPE")
+                || name == QLatin1String("DISPLAY"));
+    }
+
+    void appendEscaped(QByteArray &a, const QByteArray &data)
+    {
+        for (int i = 0; i < data.size(); ++i) {
+            const char c = data.at(i);
+            if (c == VAR || c == VALUE || c == ESC || c == USERVAR)
+                a.append(ESC);
+            a.append(c);
+        }
+    }
+
+    void appendVariable(QByteArray &a, const QString &name,
+                        const QString &value, bool defined)
+    {
+        a.append(isWellKnown(name) ? VAR : USERVAR);
+        appendEscaped(a, name.toUtf8());
+        if (!defined)
+            return;
+        a.append(VALUE);
+        appendEscaped(a, value.toUtf8());
+    }
+};
+
 namespace LineMode // RFC1184
 {
     const char Mode = 1;
@@ -471,28 +532,258 @@ namespace LineMode // RFC1184
     };
 };
 
-class QtTelnetAuthNull : public QtTelnetAuth
+/*
+  Answers SEND with IS NULL when the server offers no mechanism we
+  have, leaving the login to the login and password prompts.
+*/
+class QtTelnetAuthNull : public QtTelnetAuthenticator
 {
 public:
-    QtTelnetAuthNull() : QtTelnetAuth(0) {}
+    QtTelnetAuthNull(QObject *parent)
+        : QtTelnetAuthenticator(Auth::AUTHNULL, 0, parent)
+    {}
 
-    QByteArray authStep(const QByteArray &data);
+protected:
+    void start()
+    {
+        send(QByteArray());
+        setSucceeded();
+    }
+    void receive(const QByteArray &) {}
 };
 
-QByteArray QtTelnetAuthNull::authStep(const QByteArray &data)
+/*
+  Writes output batches to a device on a thread of its own, so that a
+  slow device does not hold up reading from the socket.
+*/
+class QtTelnetOutputWriter : public QThread
 {
-    Q_ASSERT(data[0] == Common::Authentication);
+public:
+    QtTelnetOutputWriter(QIODevice *device)
+        : device(device), queued(0), stopping(false)
+    {}
+    ~QtTelnetOutputWriter();
 
-    if (data.size() < 2 || data[1] != Common::SEND)
-        return QByteArray();
+    void enqueue(QByteArray &batch);
+
+protected:
+    void run();
+
+private:
+    QIODevice *device;
+    QMutex mutex;
+    QWaitCondition wakeup, drained;
+    QList<QByteArray> queue;
+    qint64 queued;
+    bool stopping;
+};
+
+/*
+  Writes all the queued batches before returning.
+*/
+QtTelnetOutputWriter::~QtTelnetOutputWriter()
+{
+    mutex.lock();
+    stopping = true;
+    wakeup.wakeOne();
+    mutex.unlock();
+    wait();
+}
+
+/*
+  Queues \a batch for writing and clears it. Blocks while more than
+  32 MB are waiting to be written, rather than buffering without
+  bounds.
+*/
+void QtTelnetOutputWriter::enqueue(QByteArray &batch)
+{
+    QMutexLocker locker(&mutex);
+    while (queued > 32 * 1024 * 1024)
+        drained.wait(&mutex);
+    queued += batch.size();
+    queue.append(batch);
+    batch = QByteArray();
+    wakeup.wakeOne();
+}
+
+void QtTelnetOutputWriter::run()
+{
+    QMutexLocker locker(&mutex);
+    forever {
+        while (queue.isEmpty() && !stopping)
+            wakeup.wait(&mutex);
+        if (queue.isEmpty())
+            return;
+        const QByteArray batch = queue.takeFirst();
+        locker.unlock();
+        if (device->write(batch) != batch.size())
+            qWarning("QtTelnet: could not write output: %s",
+                     qPrintable(device->errorString()));
+        locker.relock();
+        queued -= batch.size();
+        drained.wakeAll();
+    }
+}
+
+/*
+  LINEMODE (RFC1184) state. It is only allocated once the server
+  starts to negotiate LINEMODE, as most sessions never use it.
+*/
+struct QtTelnetLineMode
+{
+    QtTelnetLineMode() : mode(0), hasforwardmask(false), literalnext(false)
+    { resetSLC(); }
+
+    void resetSLC();
+    bool isForwardChar(uchar c) const;
+    // True if the function \a func is supported and bound to \a c
+    bool isSLC(int func, uchar c) const
+    {
+        return (slc[func][0] & LineMode::SLC_LEVELBITS)
+            != LineMode::SLC_NOSUPPORT && slc[func][1] == c;
+    }
+
+    uchar mode;
+    uchar slc[LineMode::SLC_EEOL + 1][2]; // level/flags, value
+    uchar forwardmask[32];
+    bool hasforwardmask, literalnext;
+    QByteArray editbuffer;
+};
+
+/*
+  A login, password or prompt pattern. Literal strings are found with
+  a plain substring search, which can also run on the raw bytes
+  received; only real patterns go through a regular expression engine.
+*/
+class QtTelnetPattern
+{
+public:
+    enum Kind { Empty, Literal, RegExp, RegularExpression };
+
+    QtTelnetPattern() : kind(Empty), ascii(false) {}
+
+    bool isEmpty() const { return kind == Empty; }
+    void setLiteral(const QString &str);
+    void setRegExp(const QRegExp &pattern);
+#if QT_VERSION >= 0x050000
+    void setRegularExpression(const QRegularExpression &pattern);
+#endif
+
+    bool matches(const QString &text);
+    bool matches(const QByteArray &data, bool utf8, QTextCodec *codec);
+
+private:
+    Kind kind;
+    bool ascii;
+    QString literal;
+    QByteArray utf8literal;
+    QRegExp rx;
+#if QT_VERSION >= 0x050000
+    QRegularExpression re;
+#endif
+};
+
+void QtTelnetPattern::setLiteral(const QString &str)
+{
+    *this = QtTelnetPattern();
+    if (str.isEmpty())
+        return;
+    kind = Literal;
+    literal = str;
+    utf8literal = str.toUtf8();
+    ascii = (utf8literal.size() == str.size());
+}
+
+void QtTelnetPattern::setRegExp(const QRegExp &pattern)
+{
+    *this = QtTelnetPattern();
+    if (pattern.isEmpty())
+        return;
+    kind = RegExp;
+    rx = pattern;
+}
+
+#if QT_VERSION >= 0x050000
+void QtTelnetPattern::setRegularExpression(const QRegularExpression &pattern)
+{
+    *this = QtTelnetPattern();
+    if (pattern.pattern().isEmpty())
+        return;
+    kind = RegularExpression;
+    re = pattern;
+#if QT_VERSION >= 0x050400
+    re.optimize(); // Compiled (and JIT compiled) once, shared by all copies
+#endif
+}
+#endif
+
+bool QtTelnetPattern::matches(const QString &text)
+{
+    switch (kind) {
+    case Literal:
+        return text.contains(literal);
+    case RegExp:
+        return rx.indexIn(text) != -1;
+#if QT_VERSION >= 0x050000
+    case RegularExpression:
+        return re.match(text).hasMatch();
+#endif
+    default:
+        break;
+    }
+    return false;
+}
 
-    char buf[8] = {Common::IAC, Common::SB, Common::Authentication,
-                   Common::IS, Auth::AUTHNULL, 0, // CLIENT|ONE-WAY
-                   Common::IAC, Common::SE};
-    setState(AuthSuccess);
-    return QByteArray(buf, sizeof(buf));
+/*
+  Matches the received bytes in \a data. Literals are searched for in
+  \a data directly if it is UTF-8 (\a utf8 is true) or the literal is
+  ASCII and \a codec is ASCII compatible; otherwise \a data is decoded
+  first.
+*/
+bool QtTelnetPattern::matches(const QByteArray &data, bool utf8,
+                              QTextCodec *codec)
+{
+    if (kind == Empty)
+        return false;
+    if (kind == Literal && (utf8 || (ascii && codec->mibEnum() == 4)))
+        return data.contains(utf8literal);
+    return matches(codec->toUnicode(data));
 }
 
+/*
+  The login, password and prompt patterns. Sessions that use the
+  defaults share one set per thread (QRegExp keeps match state, so
+  sets cannot be shared between threads); a session gets its own copy
+  when one of the patterns is changed.
+*/
+struct QtTelnetPatterns
+{
+    QtTelnetPatterns()
+    {
+#if QT_VERSION >= 0x050000
+        login.setRegularExpression(
+            QRegularExpression(QLatin1String("ogin:\\s*$")));
+        pass.setRegularExpression(
+            QRegularExpression(QLatin1String("assword:\\s*$")));
+#else
+        login.setRegExp(QRegExp(QLatin1String("ogin:\\s*$")));
+        pass.setRegExp(QRegExp(QLatin1String("assword:\\s*$")));
+#endif
+    }
+
+    QtTelnetPattern login, pass, prompt;
+};
+
+static QThreadStorage<QtTelnetPatterns *> defaultPatterns;
+
+Q_GLOBAL_STATIC_WITH_ARGS(QStringList, defaultTerminalTypes,
+                          (QStringList() << QLatin1String("UNKNOWN")))
+
+/*
+  Keep the members of an idle session within the budget documented
+  for QtTelnet: fixed size tables instead of containers, pointers for
+  state that is allocated on first use, and implicitly shared defaults.
+*/
 class QtTelnetPrivate : public QObject
 {
     Q_OBJECT
@@ -500,830 +791,4016 @@ public:
     QtTelnetPrivate(QtTelnet *parent);
     ~QtTelnetPrivate();
 
-    QMap<char, bool> modes;
-    QList< QPair<uchar, uchar> > osent;
+    QtTelnetCore<QtTelnetPrivate, QtTelnetPrivate> core;
+    QtTelnetOptionSet peerlocal, peerremote; // As reported by STATUS IS
+    bool haspeerstatus;
 
     QtTelnet *q;
     QTcpSocket *socket;
-    QtTelnetReceiveBuffer buffer;
+    QByteArray pending; // Incomplete command left over from the last read
+    bool textwanted; // Whether anything is connected to message()
+    bool promptwanted; // Or to promptReceived()
+    bool linewanted; // Or to lineReceived()
+    bool textwantedstale;
+    // State of the blocking functions
+    bool waitingprompt, promptseen, collecting;
+    QString collected;
+    bool waitFor(const bool &flag, int msecs);
+    void deliverAuthCalls();
+
+    QtTelnet::EventHook eventhook;
+    void *eventhookcontext;
+    bool eventhooktext;
+    void callHook(QtTelnet::HookEvent event, const QString &text = QString())
+    {
+        if (eventhook)
+            eventhook(eventhookcontext, event, text);
+    }
     QSocketNotifier *notifier;
 
     QSize windowSize;
 
+    int connecttimeout;
+    bool parallelconnect;
+    QTimer *connecttimer, *staggertimer;
+    int lookupid;
+    quint16 connectport;
+    QList<QHostAddress> candidates;
+    QList<QTcpSocket *> attempts;
+    QAbstractSocket::SocketError attempterror;
+
+    bool autoreconnect, reconnectpending, userclosed, loggedin;
+    int reconnectinitial, reconnectmaximum, reconnectattempt;
+    QString lasthost;
+    quint16 lastport;
+    QString savedlogin, savedpass;
+    QStringList pendingcommands;
+    QTimer *reconnecttimer;
+
+    void connectFailed(QAbstractSocket::SocketError error);
+    void scheduleReconnect();
+    void resetSession();
+    void setLoggedIn();
+    void endLoginSpan();
+    void writeData(const QString &data);
+
+    QtTelnet::TlsMode tlsmode;
+    bool starttlsrefused;
+#ifndef QTTELNET_NO_SSL
+    QSslConfiguration sslconfig;
+#endif
+
+    QTcpSocket *createSocket();
+    void configureTls(QTcpSocket *s);
+    void cacheTlsSession();
+    bool isEncrypted() const;
+    bool isStartTls() const
+    {
+#ifdef QTTELNET_NO_SSL
+        return false;
+#else
+        return tlsmode == QtTelnet::StartTls
+            || tlsmode == QtTelnet::StartTlsRequired;
+#endif
+    }
+    bool credentialsHeld() const
+    { return isStartTls() && !starttlsrefused && !isEncrypted(); }
+    void startTlsRefused();
+    void parseSubStartTLS(const QByteArray &data);
+    void startSession();
+
+    void startConnectTimer();
+    void startParallelConnect(const QString &host, quint16 port);
+    void cancelConnect();
+
     bool connected, nocheckp;
+    bool loginspan; // The "login" trace span is open
     bool triedlogin, triedpass, firsttry;
 
-    QMap<int, QtTelnetAuth*> auths;
-    QtTelnetAuth *curauth;
+    QList<QtTelnetAuthenticator *> auths;
+    QtTelnetAuthenticator *curauth; // Not owned
+    QtTelnetAuthNull *authnull;     // 0 until first used
     bool nullauth;
 
-    QRegExp loginp, passp, promptp;
+    void authFinished(QtTelnetAuthenticator *auth);
+
+    QtTelnetPatterns *ownpatterns; // 0 while the defaults are used
+
+    QtTelnetPatterns *patterns();
+    QtTelnetPatterns *writablePatterns();
+    bool hasLoginPatterns();
     QString login, pass;
 
+    enum FastLoginState { FastLoginIdle, FastLoginSent };
+    enum PromptKind { NoPrompt, LoginPrompt, PasswordPrompt };
+    bool fastlogin;
+    int fastlogintimeout;
+    FastLoginState fastloginstate;
+    int fastloginprompts[3];
+    PromptKind lastprompt;
+    PromptKind heldprompt; // Answered once START_TLS has been settled
+    QTimer *fastlogintimer;
+
+    void sendCredential(const QString &str, bool typeahead = false);
+    void answerHeldPrompt();
+    void startFastLogin();
+    void stopFastLogin();
+    void verifyFastLogin(const QString &text);
+
+    QStringList termtypes;
+    int termtypeindex;
+    QMap<QString, QString> environment;
+    bool environsent;
+
+    bool lineframing, skiplf;
+    int maxlinelength;
+    QByteArray partialline;
+
+    enum DecoderKind { Latin1Decoder, Utf8Decoder, GenericDecoder };
+    QTextCodec *codec;
+    QTextDecoder *decoder;
+    DecoderKind decoderkind;
+    char utf8pending[4];
+    int utf8pendinglen;
+
+    void setCodec(QTextCodec *c);
+    QString decode(const char *data, int length);
+    QString decodeUtf8(const char *data, int length);
+    QByteArray encode(const QString &str) const;
+
+    QtTelnetLineMode *lm; // 0 until LINEMODE is negotiated
+
+    QtTelnetLineMode *lineModeState();
+    bool isLineEditing() const;
+    void sendLineModeInput(const QByteArray &input);
+    void flushEditBuffer();
+
+    QtTelnetOptionHandler **handlers; // 256 entries, 0 until one is set
+
     bool allowOption(int oper, int opt);
     void sendOptions();
     void sendCommand(const QByteArray &command);
     void sendCommand(const char *command, int length);
     void sendCommand(const char operation, const char option);
     void sendString(const QString &str);
-    bool replyNeeded(uchar operation, uchar option);
-    void setMode(uchar operation, uchar option);
-    bool alreadySent(uchar operation, uchar option);
-    void addSent(uchar operation, uchar option);
     void sendWindowSize();
 
-    int  parsePlaintext(const QByteArray &data);
-    int parseIAC(const QByteArray &data);
+    bool binary;
+    QIODevice *binarysink, *binarysource;
+    bool binarysourcedone;
+    qint64 binarysent;
+    QByteArray binarychunk, binaryout;
+
+    bool isBinaryReceive() const;
+    void writeBinary(const char *data, int length);
+    void stopBinarySource();
+
+    QIODevice *outputdevice;
+    QtTelnet::OutputFlags outputflags;
+    QByteArray outputbatch;
+    QTimer *outputtimer;
+    QtTelnetOutputWriter *outputwriter;
+
+    void writeOutput(const char *data, int length);
+
+    QtTelnetTranscript *transcript;
+
+    qint64 writeSocket(const char *data, qint64 length);
+    qint64 writeSocket(const QByteArray &data)
+    { return writeSocket(data.constData(), data.size()); }
+    void writeOutputBatch();
+
+    bool syncpending, flushoutput;
+    int datamarks; // Data Marks read while no SYNC was pending
+
+    bool isDiscarding() const { return syncpending || flushoutput; }
+    void endSync();
+    void requestOutputFlush();
+
+    int  parsePlaintext(const char *data, int size);
+    void processText(const char *data, int length, bool nul);
+    void frameLines(const char *data, int length);
+    void emitLine(const char *data, int length);
     bool isOperation(const uchar c);
-    bool isCommand(const uchar c);
-    QByteArray getSubOption(const QByteArray &data);
     void parseSubAuth(const QByteArray &data);
     void parseSubTT(const QByteArray &data);
+    void parseSubEnviron(const QByteArray &data);
+    void sendEnviron(char type, const QByteArray &variables);
     void parseSubNAWS(const QByteArray &data);
-    uchar opposite(uchar operation, bool positive);
-
-    void consume();
+    void parseSubLineMode(const QByteArray &data);
+    void parseLineModeSLC(const QByteArray &data);
+    void parseSubStatus(const QByteArray &data);
+    void sendStatus();
+
+    int consume(const char *data, int length);
+
+    // The policies of QtTelnetCore
+    void telnetData(const char *data, int length);
+    void telnetCommand(uchar command);
+    void telnetSubOption(const char *data, int length);
+    bool telnetOptionReceived(uchar operation, uchar option);
+    bool telnetAllowOption(uchar operation, uchar option)
+    { return allowOption(operation, option); }
+    void telnetOptionChanged(uchar option, bool local, bool enabled);
+    void telnetWrite(const char *data, int length)
+    { writeSocket(data, length); }
 
     void setSocket(QTcpSocket *socket);
 
 public slots:
     void socketConnected();
+    void socketHostFound();
     void socketConnectionClosed();
     void socketReadyRead();
     void socketError(QAbstractSocket::SocketError error);
     void socketException(int);
+    void fastLoginTimeout();
+    void hostLookedUp(const QHostInfo &info);
+    void startNextAttempt();
+    void attemptConnected();
+    void attemptError(QAbstractSocket::SocketError error);
+    void connectTimedOut();
+    void reconnect();
+    void socketEncrypted();
+    void socketSessionTicket();
+    void sendBinaryChunks();
+    void binarySourceFinished();
+    void binarySourceDestroyed();
+    void outputTimeout();
 };
 
-QtTelnetPrivate::QtTelnetPrivate(QtTelnet *parent)
-    : q(parent), socket(0), notifier(0),
-      connected(false), nocheckp(false),
-      triedlogin(false), triedpass(false), firsttry(true),
-      curauth(0), nullauth(false),
-      loginp("ogin:\\s*$"), passp("assword:\\s*$")
+/*
+  What the client does with each option, indexed by the option code:
+  its name, whether we agree when the server asks for it, and the
+  parser for its suboptions. Negotiating an option or dispatching a
+  suboption is a single lookup in this table. The entries past the
+  last one listed are unnamed, refused and have no parser.
+*/
+struct QtTelnetOptionEntry
 {
-    setSocket(new QTcpSocket(this));
+    enum Policy { Refuse, Agree, Depends }; // Depends: see allowOption()
+
+    const char *name;
+    uchar policy;
+    void (QtTelnetPrivate::*parse)(const QByteArray &data);
+};
+
+#define QTTELNET_OPTION(name, policy, parse) \
+    { name, QtTelnetOptionEntry::policy, parse }
+
+static const QtTelnetOptionEntry optionTable[256] = {
+    QTTELNET_OPTION("TRANSMIT-BINARY", Depends, 0),                  // 0
+    QTTELNET_OPTION("ECHO", Refuse, 0),
+    QTTELNET_OPTION("RCP", Refuse, 0),
+    QTTELNET_OPTION("SUPPRESS GO AHEAD", Agree, 0),
+    QTTELNET_OPTION("NAMS", Refuse, 0),
+    QTTELNET_OPTION("STATUS", Agree, &QtTelnetPrivate::parseSubStatus),
+    QTTELNET_OPTION("TIMING-MARK", Refuse, 0),
+    QTTELNET_OPTION("RCTE", Refuse, 0),
+    QTTELNET_OPTION("NAOL", Refuse, 0),
+    QTTELNET_OPTION("NAOP", Refuse, 0),
+    QTTELNET_OPTION("NAOCRD", Refuse, 0),                            // 10
+    QTTELNET_OPTION("NAOHTS", Refuse, 0),
+    QTTELNET_OPTION("NAOHTD", Refuse, 0),
+    QTTELNET_OPTION("NAOFFD", Refuse, 0),
+    QTTELNET_OPTION("NAOVTS", Refuse, 0),
+    QTTELNET_OPTION("NAOVTD", Refuse, 0),
+    QTTELNET_OPTION("NAOLFD", Refuse, 0),
+    QTTELNET_OPTION("EXTEND-ASCII", Refuse, 0),
+    QTTELNET_OPTION("LOGOUT", Agree, 0),
+    QTTELNET_OPTION("BM", Refuse, 0),
+    QTTELNET_OPTION("DET", Refuse, 0),                               // 20
+    QTTELNET_OPTION("SUPDUP", Refuse, 0),
+    QTTELNET_OPTION("SUPDUP-OUTPUT", Refuse, 0),
+    QTTELNET_OPTION("SEND-LOCATION", Refuse, 0),
+    QTTELNET_OPTION("TERMINAL-TYPE", Agree, &QtTelnetPrivate::parseSubTT),
+    QTTELNET_OPTION("END-OF-RECORD", Refuse, 0),
+    QTTELNET_OPTION("TUID", Refuse, 0),
+    QTTELNET_OPTION("OUTMRK", Refuse, 0),
+    QTTELNET_OPTION("TTYLOC", Refuse, 0),
+    QTTELNET_OPTION("3270-REGIME", Refuse, 0),
+    QTTELNET_OPTION("X.3-PAD", Refuse, 0),                           // 30
+    QTTELNET_OPTION("NAWS", Depends, &QtTelnetPrivate::parseSubNAWS),
+    QTTELNET_OPTION("TERMINAL-SPEED", Refuse, 0),
+    QTTELNET_OPTION("TOGGLE-FLOW-CONTROL", Refuse, 0),
+    QTTELNET_OPTION("LINEMODE", Agree, &QtTelnetPrivate::parseSubLineMode),
+    QTTELNET_OPTION("X-DISPLAY-LOCATION", Refuse, 0),
+    QTTELNET_OPTION("ENVIRON", Refuse, 0),
+    QTTELNET_OPTION("AUTHENTICATION", Agree, &QtTelnetPrivate::parseSubAuth),
+    QTTELNET_OPTION("ENCRYPT", Refuse, 0),
+    QTTELNET_OPTION("NEW-ENVIRON", Depends,
+                    &QtTelnetPrivate::parseSubEnviron),
+    QTTELNET_OPTION("TN3270E", Refuse, 0),                           // 40
+    QTTELNET_OPTION("XAUTH", Refuse, 0),
+    QTTELNET_OPTION("CHARSET", Refuse, 0),
+    QTTELNET_OPTION("RSP", Refuse, 0),
+    QTTELNET_OPTION("COM-PORT-OPTION", Refuse, 0),
+    QTTELNET_OPTION("SUPPRESS-LOCAL-ECHO", Refuse, 0),
+    QTTELNET_OPTION("START-TLS", Depends,
+                    &QtTelnetPrivate::parseSubStartTLS),
+    QTTELNET_OPTION("KERMIT", Refuse, 0),
+    QTTELNET_OPTION("SEND-URL", Refuse, 0),
+    QTTELNET_OPTION("FORWARD-X", Refuse, 0)
+};
+
+#undef QTTELNET_OPTION
+
+#ifdef QTTELNET_DEBUG
+static QString optionStr(uchar option)
+{
+    if (optionTable[option].name)
+        return QLatin1String(optionTable[option].name);
+    return QString("Unknown option (%1)").arg(option);
+}
+#endif
+
+QtTelnetPrivate::QtTelnetPrivate(QtTelnet *parent)
+    : core(this, this), haspeerstatus(false), q(parent), socket(0),
+      textwanted(false), promptwanted(false), linewanted(false),
+      textwantedstale(true),
+      waitingprompt(false), promptseen(false), collecting(false),
+      eventhook(0), eventhookcontext(0), eventhooktext(false), notifier(0),
+      connecttimeout(0), parallelconnect(false),
+      connecttimer(0), staggertimer(0), lookupid(-1), connectport(0),
+      attempterror(QAbstractSocket::UnknownSocketError),
+      autoreconnect(false), reconnectpending(false), userclosed(false),
+      loggedin(false), reconnectinitial(1000), reconnectmaximum(60000),
+      reconnectattempt(0), lastport(0), reconnecttimer(0),
+      tlsmode(QtTelnet::NoTls), starttlsrefused(false),
+      connected(false), nocheckp(false), loginspan(false),
+      triedlogin(false), triedpass(false), firsttry(true),
+      curauth(0), authnull(0), nullauth(false),
+      ownpatterns(0),
+      fastlogin(false), fastlogintimeout(10000),
+      fastloginstate(FastLoginIdle), lastprompt(NoPrompt), heldprompt(NoPrompt),
+      fastlogintimer(0),
+      termtypes(*defaultTerminalTypes()), termtypeindex(0),
+      environsent(false),
+      lineframing(false), skiplf(false), maxlinelength(8192),
+      codec(0), decoder(0), decoderkind(Latin1Decoder), utf8pendinglen(0),
+      lm(0), handlers(0),
+      binary(false), binarysink(0), binarysource(0), binarysourcedone(false),
+      binarysent(0), outputdevice(0), outputtimer(0), outputwriter(0),
+      transcript(0), syncpending(false), flushoutput(false), datamarks(0)
+{
+#ifndef QTTELNET_NO_SSL
+    sslconfig = QSslConfiguration::defaultConfiguration();
+#endif
+    setCodec(0);
 }
 
 QtTelnetPrivate::~QtTelnetPrivate()
 {
     delete socket;
     delete notifier;
-    delete curauth;
+    delete decoder;
+    delete lm;
+    delete [] handlers;
+    delete ownpatterns;
+    writeOutputBatch();
+    delete outputwriter;
+    pass.fill(QLatin1Char(' '));
+    savedpass.fill(QLatin1Char(' '));
 }
 
-void QtTelnetPrivate::setSocket(QTcpSocket *s)
+QtTelnetPatterns *QtTelnetPrivate::patterns()
 {
-    if (socket) {
-        q->logout();
-        socket->flush();
-    }
-    delete socket;
-    socket = s;
-    connected = false;
-    if (socket) {
-        connect(socket, SIGNAL(connected()), this, SLOT(socketConnected()));
-        connect(socket, SIGNAL(disconnected()),
-                this, SLOT(socketConnectionClosed()));
-        connect(socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()));
-        connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
-                this, SLOT(socketError(QAbstractSocket::SocketError)));
-    }
+    if (ownpatterns)
+        return ownpatterns;
+    if (!defaultPatterns.hasLocalData())
+        defaultPatterns.setLocalData(new QtTelnetPatterns);
+    return defaultPatterns.localData();
 }
 
 /*
-   Returns the opposite value of the one we pass in.
+  Returns the patterns of this session, detaching them from the shared
+  defaults first.
 */
-uchar QtTelnetPrivate::opposite(uchar operation, bool positive)
+QtTelnetPatterns *QtTelnetPrivate::writablePatterns()
 {
-    if (operation == Common::DO)
-        return (positive ? Common::WILL : Common::WONT);
-    else if (operation == Common::DONT) // Not allowed to say WILL
-        return Common::WONT;
-    else if (operation == Common::WILL)
-        return (positive ? Common::DO : Common::DONT);
-    else if (operation == Common::WONT) // Not allowed to say DO
-        return Common::DONT;
-    return 0;
+    if (!ownpatterns)
+        ownpatterns = new QtTelnetPatterns(*patterns());
+    return ownpatterns;
 }
 
-void QtTelnetPrivate::consume()
+bool QtTelnetPrivate::hasLoginPatterns()
 {
-    const QByteArray data = buffer.readAll();
-    int currpos = 0;
-    int prevpos = -1;;
-    while (prevpos < currpos && currpos < data.size()) {
-        prevpos = currpos;
-        const uchar c = uchar(data[currpos]);
-        if (c == Common::DM)
-            ++currpos;
-        else if (c == Common::IAC)
-            currpos += parseIAC(data.mid(currpos));
-        else // Assume plain text
-            currpos += parsePlaintext(data.mid(currpos));
-    }
-    if (currpos < data.size())
-        buffer.push_back(data.mid(currpos));
+    const QtTelnetPatterns *p = patterns();
+    return !p->login.isEmpty() || !p->pass.isEmpty();
 }
 
-bool QtTelnetPrivate::isCommand(const uchar c)
+QtTelnetLineMode *QtTelnetPrivate::lineModeState()
 {
-    return (c == Common::DM);
+    if (!lm)
+        lm = new QtTelnetLineMode;
+    return lm;
 }
 
-bool QtTelnetPrivate::isOperation(const uchar c)
+/*
+  Sets the codec used for the text sent and received. Passing 0 selects
+  the codec for the current locale. Any partially decoded character is
+  discarded.
+*/
+void QtTelnetPrivate::setCodec(QTextCodec *c)
 {
-    return (c == Common::WILL || c == Common::WONT
-            || c == Common::DO ||c == Common::DONT);
+    codec = (c ? c : QTextCodec::codecForLocale());
+    delete decoder;
+    decoder = 0;
+    utf8pendinglen = 0;
+
+    switch (codec->mibEnum()) {
+    case 106: // UTF-8
+        decoderkind = Utf8Decoder;
+        break;
+    case 4: // ISO-8859-1
+        decoderkind = Latin1Decoder;
+        break;
+    default:
+        decoderkind = GenericDecoder;
+        decoder = codec->makeDecoder();
+        break;
+    }
 }
 
-QByteArray QtTelnetPrivate::getSubOption(const QByteArray &data)
+/*
+  Decodes \a length bytes of \a data. The decoder keeps its state
+  between calls, so a character may be split across two reads.
+*/
+QString QtTelnetPrivate::decode(const char *data, int length)
 {
-    Q_ASSERT(!data.isEmpty() && uchar(data[0]) == Common::IAC);
-
-    if (data.size() < 4 || uchar(data[1]) != Common::SB)
-        return QByteArray();
+    switch (decoderkind) {
+    case Utf8Decoder:
+        return decodeUtf8(data, length);
+    case Latin1Decoder:
+        return QString::fromLatin1(data, length);
+    default:
+        break;
+    }
+    return decoder->toUnicode(data, length);
+}
 
-    for (int i = 2; i < data.size() - 1; ++i) {
-        if (uchar(data[i]) == Common::IAC && uchar(data[i+1]) == Common::SE) {
-            return data.mid(2, i-2);
-        }
+QString QtTelnetPrivate::decodeUtf8(const char *data, int length)
+{
+    QString text;
+    if (utf8pendinglen) {
+        // Complete the sequence left over from the previous read
+        const int need = utf8SequenceLength(uchar(utf8pending[0]));
+        int i = 0;
+        while (utf8pendinglen < need && i < length
+               && (uchar(data[i]) & 0xc0) == 0x80)
+            utf8pending[utf8pendinglen++] = data[i++];
+        if (utf8pendinglen < need && i == length)
+            return text;
+        text = QString::fromUtf8(utf8pending, utf8pendinglen);
+        utf8pendinglen = 0;
+        data += i;
+        length -= i;
     }
-    return QByteArray();
+
+    if (isAscii(data, length))
+        return text + QString::fromLatin1(data, length);
+
+    const int tail = utf8IncompleteTail(data, length);
+    length -= tail;
+    memcpy(utf8pending, data + length, tail);
+    utf8pendinglen = tail;
+    return text + QString::fromUtf8(data, length);
 }
 
-void QtTelnetPrivate::parseSubNAWS(const QByteArray &data)
+QByteArray QtTelnetPrivate::encode(const QString &str) const
 {
-    Q_UNUSED(data);
+    switch (decoderkind) {
+    case Utf8Decoder:
+        return str.toUtf8();
+    case Latin1Decoder:
+        return str.toLatin1();
+    default:
+        break;
+    }
+    return codec->fromUnicode(str);
 }
 
-void QtTelnetPrivate::parseSubTT(const QByteArray &data)
+/*
+  Returns a socket of the type needed for the current TLS mode.
+*/
+QTcpSocket *QtTelnetPrivate::createSocket()
 {
-    Q_ASSERT(!data.isEmpty() && data[0] == Common::TerminalType);
+#ifndef QTTELNET_NO_SSL
+    if (tlsmode != QtTelnet::NoTls)
+        return new QSslSocket(this);
+#endif
+    return new QTcpSocket(this);
+}
 
-    if (data.size() < 2 || data[1] != Common::SEND)
+/*
+  Applies the TLS configuration to \a s before it connects to the last
+  host passed to connectToHost(), offering to resume the TLS session
+  of an earlier connection to the same server.
+*/
+void QtTelnetPrivate::configureTls(QTcpSocket *s)
+{
+#ifndef QTTELNET_NO_SSL
+    QSslSocket *ssl = qobject_cast<QSslSocket *>(s);
+    if (!ssl || tlsmode == QtTelnet::NoTls)
         return;
-
-    const char c1[4] = { Common::IAC, Common::SB,
-                         Common::TerminalType, Common::IS};
-    sendCommand(c1, sizeof(c1));
-    sendString("UNKNOWN");
-    const char c2[2] = { Common::IAC, Common::SE };
-    sendCommand(c2, sizeof(c2));
+    QSslConfiguration config = sslconfig;
+#if QT_VERSION >= 0x050400
+    config.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    const QByteArray session = tlsSessionCache()->session(
+        lasthost + QLatin1Char(':') + QString::number(lastport));
+    if (!session.isEmpty())
+        config.setSessionTicket(session);
+#endif
+    ssl->setSslConfiguration(config);
+#if QT_VERSION >= 0x040800
+    ssl->setPeerVerifyName(lasthost);
+#endif
+#else
+    Q_UNUSED(s);
+#endif
 }
 
-void QtTelnetPrivate::parseSubAuth(const QByteArray &data)
+/*
+  Remembers the TLS session of the current connection, so that the next
+  connection to the same server can resume it.
+*/
+void QtTelnetPrivate::cacheTlsSession()
 {
-    Q_ASSERT(data[0] == Common::Authentication);
+#if !defined(QTTELNET_NO_SSL) && QT_VERSION >= 0x050400
+    QSslSocket *ssl = qobject_cast<QSslSocket *>(socket);
+    if (!ssl)
+        return;
+    const QByteArray session = ssl->sslConfiguration().sessionTicket();
+    if (!session.isEmpty())
+        tlsSessionCache()->setSession(lasthost + QLatin1Char(':')
+                                      + QString::number(lastport), session);
+#endif
+}
 
-    if (!curauth && data[1] == Common::SEND) {
-        int pos = 2;
-        while (pos < data.size() && !curauth) {
-            curauth = auths[data[pos]];
-            pos += 2;
+bool QtTelnetPrivate::isEncrypted() const
+{
+#ifndef QTTELNET_NO_SSL
+    QSslSocket *ssl = qobject_cast<QSslSocket *>(socket);
+    return ssl && ssl->isEncrypted();
+#else
+    return false;
+#endif
+}
 
-            if (curauth) {
-                emit q->loginRequired();
-                break;
-            }
-        }
-        if (!curauth) {
-            curauth = new QtTelnetAuthNull;
-            nullauth = true;
-            if (loginp.isEmpty() && passp.isEmpty()) {
-                // emit q->loginRequired();
-                nocheckp = true;
-            }
-        }
+void QtTelnetPrivate::setSocket(QTcpSocket *s)
+{
+    if (socket) {
+        q->logout();
+        socket->flush();
     }
-    if (curauth) {
-        const QByteArray a = curauth->authStep(data);
-        if (!a.isEmpty())
-            sendCommand(a);
-
-        if (curauth->state() == QtTelnetAuth::AuthFailure)
-            emit q->loginFailed();
-        else if (curauth->state() == QtTelnetAuth::AuthSuccess) {
-            if (loginp.isEmpty() && passp.isEmpty())
-                emit q->loggedIn();
-            if (!nullauth)
-                nocheckp = true;
+    delete socket;
+    socket = s;
+    connected = false;
+    if (socket) {
+        connect(socket, SIGNAL(connected()), this, SLOT(socketConnected()));
+        connect(socket, SIGNAL(hostFound()), this, SLOT(socketHostFound()));
+        connect(socket, SIGNAL(disconnected()),
+                this, SLOT(socketConnectionClosed()));
+        connect(socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()));
+        connect(socket, SIGNAL(bytesWritten(qint64)),
+                this, SLOT(sendBinaryChunks()));
+        connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
+                this, SLOT(socketError(QAbstractSocket::SocketError)));
+#ifndef QTTELNET_NO_SSL
+        if (qobject_cast<QSslSocket *>(socket)) {
+            connect(socket, SIGNAL(encrypted()),
+                    this, SLOT(socketEncrypted()));
+#if QT_VERSION >= 0x050f00
+            // TLS 1.3 tickets arrive after the handshake
+            connect(socket, SIGNAL(newSessionTicketReceived()),
+                    this, SLOT(socketSessionTicket()));
+#endif
         }
+#endif
+    }
+}
+
+void QtTelnetPrivate::startConnectTimer()
+{
+    if (connecttimeout <= 0)
+        return;
+    if (!connecttimer) {
+        connecttimer = new QTimer(this);
+        connecttimer->setSingleShot(true);
+        connect(connecttimer, SIGNAL(timeout()),
+                this, SLOT(connectTimedOut()));
     }
+    connecttimer->start(connecttimeout);
 }
 
 /*
-  returns number of bytes consumed
+  Resolves \a host asynchronously and then races connections to the
+  addresses found, in the manner of RFC8305 ("Happy Eyeballs"). A new
+  attempt is started every 250 ms, or as soon as the previous one
+  fails. The first connection to succeed replaces the socket, and the
+  others are abandoned.
 */
-int QtTelnetPrivate::parseIAC(const QByteArray &data)
+void QtTelnetPrivate::startParallelConnect(const QString &host, quint16 port)
 {
-    if (data.isEmpty())
-        return 0;
-
-    Q_ASSERT(uchar(data.at(0)) == Common::IAC);
+    connectport = port;
+    candidates.clear();
+    attempterror = QAbstractSocket::HostNotFoundError;
+    startConnectTimer();
+
+    QTTELNET_TRACE_BEGIN("session", "lookup", this);
+    QHostAddress address;
+    if (address.setAddress(host)) {
+        QHostInfo info;
+        info.setAddresses(QList<QHostAddress>() << address);
+        hostLookedUp(info);
+        return;
+    }
+    lookupid = QHostInfo::lookupHost(host, this, SLOT(hostLookedUp(QHostInfo)));
+}
 
-    if (data.size() >= 3 && isOperation(data[1])) { // IAC, Operation, Option
-        const uchar operation = data[1];
-        const uchar option = data[2];
-        if (operation == Common::WONT && option == Common::Logout) {
-            q->close();
-            return 3;
-        }
-        if (operation == Common::DONT && option == Common::Authentication) {
-            if (loginp.isEmpty() && passp.isEmpty())
-                emit q->loggedIn();
-            nullauth = true;
-        }
-        if (replyNeeded(operation, option)) {
-            bool allowed = allowOption(operation, option);
-            sendCommand(opposite(operation, allowed), option);
-            setMode(operation, option);
-        }
-        return 3;
+void QtTelnetPrivate::hostLookedUp(const QHostInfo &info)
+{
+    lookupid = -1;
+    QTTELNET_TRACE_END("session", "lookup", this);
+
+    // Interleave the address families, starting with the family of the
+    // first address returned by the resolver.
+    QList<QHostAddress> preferred, other;
+    const QList<QHostAddress> addresses = info.addresses();
+    for (int i = 0; i < addresses.size(); ++i) {
+        if (addresses.at(i).protocol() == addresses.first().protocol())
+            preferred.append(addresses.at(i));
+        else
+            other.append(addresses.at(i));
     }
-    if (data.size() >= 2 && isCommand(data[1])) { // IAC Command
-        return 2;
+    while (!preferred.isEmpty() || !other.isEmpty()) {
+        if (!preferred.isEmpty())
+            candidates.append(preferred.takeFirst());
+        if (!other.isEmpty())
+            candidates.append(other.takeFirst());
     }
 
-    QByteArray suboption = getSubOption(data);
-    if (suboption.isEmpty())
-        return 0;
-
-    // IAC SB Operation SubOption [...] IAC SE
-    switch (suboption[0]) {
-    case Common::Authentication:
-        parseSubAuth(suboption);
-        break;
-    case Common::TerminalType:
-        parseSubTT(suboption);
-        break;
-    case Common::NAWS:
-        parseSubNAWS(data);
-        break;
-    default:
-        qWarning("QtTelnetPrivate::parseIAC: unknown suboption %d",
-                 quint8(suboption.at(0)));
-        break;
+    if (candidates.isEmpty()) {
+        cancelConnect();
+        connectFailed(QAbstractSocket::HostNotFoundError);
+        return;
     }
-    return suboption.size() + 4;
+    if (!staggertimer) {
+        staggertimer = new QTimer(this);
+        staggertimer->setSingleShot(true);
+        connect(staggertimer, SIGNAL(timeout()),
+                this, SLOT(startNextAttempt()));
+    }
+    startNextAttempt();
 }
 
-int QtTelnetPrivate::parsePlaintext(const QByteArray &data)
+void QtTelnetPrivate::startNextAttempt()
 {
-    int consumed = 0;
-    int length = data.indexOf('\0');
-    if (length == -1) {
-        length = data.size();
-        consumed = length;
-    } else {
-        consumed = length + 1; // + 1 for removing '\0'
-    }
+    if (candidates.isEmpty())
+        return;
 
-    QString text = QString::fromLocal8Bit(data.constData(), length);
+    QTcpSocket *s = createSocket();
+    configureTls(s);
+    attempts.append(s);
+    connect(s, SIGNAL(connected()), this, SLOT(attemptConnected()));
+    connect(s, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(attemptError(QAbstractSocket::SocketError)));
+    s->connectToHost(candidates.takeFirst(), connectport);
+    if (!candidates.isEmpty())
+        staggertimer->start(250);
+}
 
-    if (!nocheckp && nullauth) {
-        if (!promptp.isEmpty() && promptp.indexIn(text) != -1) {
-            emit q->loggedIn();
-            nocheckp = true;
-        }
+/*
+  Aborts the host lookup and all connection attempts in progress.
+*/
+void QtTelnetPrivate::cancelConnect()
+{
+    if (lookupid != -1) {
+        QHostInfo::abortHostLookup(lookupid);
+        lookupid = -1;
     }
-    if (!nocheckp && nullauth) {
-        if (!loginp.isEmpty() && loginp.indexIn(text) != -1) {
-            if (triedlogin || firsttry) {
-                emit q->message(text);    // Display the login prompt
-                text.clear();
-                emit q->loginRequired();  // Get a (new) login
-                firsttry = false;
-            }
-            if (!triedlogin) {
-                q->sendData(login);
-                triedlogin = true;
-            }
-        }
-        if (!passp.isEmpty() && passp.indexIn(text) != -1) {
-            if (triedpass || firsttry) {
-                emit q->message(text);    // Display the password prompt
-                text.clear();
-                emit q->loginRequired();  // Get a (new) pass
-                firsttry = false;
-            }
-            if (!triedpass) {
-                q->sendData(pass);
-                triedpass = true;
-                // We don't have to store the password anymore
-                pass.fill(' ');
-                pass.resize(0);
-            }
-        }
+    candidates.clear();
+    while (!attempts.isEmpty()) {
+        QTcpSocket *s = attempts.takeFirst();
+        s->disconnect(this);
+        s->abort();
+        s->deleteLater();
     }
+    if (staggertimer)
+        staggertimer->stop();
+    if (connecttimer)
+        connecttimer->stop();
+}
 
-    if (!text.isEmpty())
-        emit q->message(text);
-    return consumed;
+void QtTelnetPrivate::attemptConnected()
+{
+    QTcpSocket *s = qobject_cast<QTcpSocket *>(sender());
+    if (!s || !attempts.contains(s))
+        return;
+
+    attempts.removeAll(s);
+    s->disconnect(this);
+    cancelConnect();
+
+    // The winner replaces the socket without logging out of anything
+    QTcpSocket *old = socket;
+    socket = 0;
+    setSocket(s);
+    delete old;
+    socketConnected();
 }
 
-bool QtTelnetPrivate::replyNeeded(uchar operation, uchar option)
+void QtTelnetPrivate::attemptError(QAbstractSocket::SocketError error)
 {
-    if (operation == Common::DO || operation == Common::DONT) {
-        // RFC854 requires that we don't acknowledge
-        // requests to enter a mode we're already in
-        if (operation == Common::DO && modes[option])
-            return false;
-        if (operation == Common::DONT && !modes[option])
-            return false;
+    QTcpSocket *s = qobject_cast<QTcpSocket *>(sender());
+    if (!s || !attempts.contains(s))
+        return;
+    attempts.removeAll(s);
+    s->disconnect(this);
+    s->deleteLater();
+    attempterror = error;
+
+    if (!candidates.isEmpty()) {
+        startNextAttempt();
+    } else if (attempts.isEmpty()) {
+        cancelConnect();
+        connectFailed(attempterror);
     }
-    return true;
 }
 
-void QtTelnetPrivate::setMode(uchar operation, uchar option)
+void QtTelnetPrivate::connectTimedOut()
 {
-    if (operation != Common::DO && operation != Common::DONT)
+    if (connected)
         return;
+    cancelConnect();
+    if (socket && socket->state() != QAbstractSocket::UnconnectedState)
+        socket->abort();
+    connectFailed(QAbstractSocket::SocketTimeoutError);
+}
 
-    modes[option] = (operation == Common::DO);
-    if (option == Common::NAWS && modes[Common::NAWS])
-        sendWindowSize();
+/*
+  Reports a failed connection attempt, and retries it later if we are
+  trying to get back a connection that was lost.
+*/
+void QtTelnetPrivate::connectFailed(QAbstractSocket::SocketError error)
+{
+    QTTELNET_TRACE_VALUE("session", "error", this, "error", error);
+    QTTELNET_TRACE_END("session", "connect", this);
+    emit q->connectionError(error);
+    callHook(QtTelnet::ClosedEvent);
+    if (reconnectpending && !connected)
+        scheduleReconnect();
 }
 
-void QtTelnetPrivate::sendWindowSize()
+void QtTelnetPrivate::scheduleReconnect()
 {
-    if (!modes[Common::NAWS])
-        return;
-    if (!q->isValidWindowSize())
+    if (!reconnecttimer) {
+        reconnecttimer = new QTimer(this);
+        reconnecttimer->setSingleShot(true);
+        connect(reconnecttimer, SIGNAL(timeout()), this, SLOT(reconnect()));
+    }
+    if (reconnecttimer->isActive())
         return;
 
-    short h = htons(windowSize.height());
-    short w = htons(windowSize.width());
-    const char c[9] = { Common::IAC, Common::SB, Common::NAWS,
-                        (w & 0x00ff), (w >> 8), (h & 0x00ff), (h >> 8),
-                        Common::IAC, Common::SE };
-    sendCommand(c, sizeof(c));
+    const QString key = lasthost + QLatin1Char(':')
+                        + QString::number(lastport);
+    const int delay = reconnectPolicy()->delay(key, reconnectinitial,
+                                               reconnectmaximum);
+    reconnectpending = true;
+    reconnecttimer->start(delay);
+    emit q->reconnecting(++reconnectattempt, delay);
 }
 
-void QtTelnetPrivate::addSent(uchar operation, uchar option)
+void QtTelnetPrivate::reconnect()
 {
-    osent.append(QPair<uchar, uchar>(operation, option));
+    if (connected || !autoreconnect || userclosed)
+        return;
+    login = savedlogin;
+    pass = savedpass;
+    q->connectToHost(lasthost, lastport);
 }
 
-bool QtTelnetPrivate::alreadySent(uchar operation, uchar option)
+/*
+  Forgets everything negotiated on the previous connection.
+*/
+void QtTelnetPrivate::resetSession()
 {
-    QPair<uchar, uchar> value(operation, option);
-    if (osent.contains(value)) {
-        osent.removeAll(value);
-        return true;
-    }
-    return false;
+    core.reset();
+    peerlocal.clear();
+    peerremote.clear();
+    haspeerstatus = false;
+    pending.clear();
+
+    nocheckp = false;
+    triedlogin = triedpass = false;
+    firsttry = true;
+    loggedin = false;
+    if (curauth)
+        curauth->reset();
+    curauth = 0;
+    nullauth = false;
+    fastloginstate = FastLoginIdle;
+
+    delete lm;
+    lm = 0;
+    syncpending = flushoutput = false;
+    datamarks = 0;
+    stopBinarySource();
+
+    partialline.clear();
+    skiplf = false;
+    setCodec(codec);
+    termtypeindex = 0;
+    environsent = false;
 }
 
-void QtTelnetPrivate::sendString(const QString &str)
+/*
+  Called whenever we find out that the login has succeeded. Commands
+  given while a lost connection was being reestablished are sent now.
+*/
+void QtTelnetPrivate::setLoggedIn()
 {
-    if (!connected || str.length() == 0)
+    endLoginSpan();
+    loggedin = true;
+    emit q->loggedIn();
+    callHook(QtTelnet::LoggedInEvent);
+    if (!reconnectpending)
         return;
 
-    socket->write(str.toLocal8Bit());
+    reconnectpending = false;
+    reconnectattempt = 0;
+    reconnectPolicy()->succeeded(lasthost + QLatin1Char(':')
+                                 + QString::number(lastport));
+    const QStringList commands = pendingcommands;
+    pendingcommands.clear();
+    for (int i = 0; i < commands.size(); ++i)
+        writeData(commands.at(i));
 }
 
-void QtTelnetPrivate::sendCommand(const QByteArray &command)
+/*
+  Ends the "login" trace span, if it is still open, when the login has
+  succeeded, failed or been cut short by the connection closing, so
+  that every span that was begun is ended exactly once.
+*/
+void QtTelnetPrivate::endLoginSpan()
 {
-    if (!connected || command.isEmpty())
+    if (!loginspan)
         return;
+    loginspan = false;
+    QTTELNET_TRACE_END("session", "login", this);
+}
 
-    if (command.size() == 3) {
-        const char operation = command.at(1);
-        const char option = command.at(2);
-        if (alreadySent(operation, option))
-            return;
-        addSent(operation, option);
-    }
-    socket->write(command);
+/*
+  Processes \a length bytes of data received from the server and
+  returns the number of bytes consumed. Any bytes left over are the
+  start of a command that has not been received completely yet.
+*/
+int QtTelnetPrivate::consume(const char *data, int length)
+{
+    return core.receive(data, length);
 }
 
-void QtTelnetPrivate::sendCommand(const char operation, const char option)
+/*
+  Handles a run of \a length data bytes from the server; an escaped
+  IAC arrives on its own as a single byte.
+*/
+void QtTelnetPrivate::telnetData(const char *data, int length)
 {
-    const char c[3] = { Common::IAC, operation, option };
-    sendCommand(c, 3);
+    // SYNC (RFC854): drop the data up to the Data Mark, but keep
+    // processing the Telnet commands in it.
+    if (isDiscarding())
+        return;
+    if (isBinaryReceive()) {
+        writeBinary(data, length);
+        return;
+    }
+    int pos = 0;
+    while (pos < length)
+        pos += parsePlaintext(data + pos, length - pos);
 }
 
-void QtTelnetPrivate::sendCommand(const char *command, int length)
+void QtTelnetPrivate::telnetCommand(uchar command)
 {
-    QByteArray a(command, length);
-    sendCommand(a);
+    if (command == Common::DM) {
+        if (syncpending)
+            endSync();
+        else
+            ++datamarks;
+    }
 }
 
-bool QtTelnetPrivate::allowOption(int /*oper*/, int opt)
+/*
+  Returns true if the server transmits in binary (RFC856) and the data
+  is to be passed to the binary sink instead of being handled as text.
+*/
+bool QtTelnetPrivate::isBinaryReceive() const
 {
-    if (opt == Common::Authentication ||
-        opt == Common::SuppressGoAhead ||
-        opt == Common::LineMode ||
-        opt == Common::Status ||
-        opt == Common::Logout ||
-        opt == Common::TerminalType)
-        return true;
-    if (opt == Common::NAWS && q->isValidWindowSize())
-        return true;
-    return false;
+    return binarysink && core.hismodes.value(Common::Binary);
 }
 
-void QtTelnetPrivate::sendOptions()
+void QtTelnetPrivate::writeBinary(const char *data, int length)
 {
-    sendCommand(Common::WILL, Common::Authentication);
-    sendCommand(Common::DO, Common::SuppressGoAhead);
-    sendCommand(Common::WILL, Common::LineMode);
-    sendCommand(Common::DO, Common::Status);
-    if (q->isValidWindowSize())
-        sendCommand(Common::WILL, Common::NAWS);
+    if (binarysink->write(data, length) != length)
+        qWarning("QtTelnet: could not write binary data: %s",
+                 qPrintable(binarysink->errorString()));
 }
 
-void QtTelnetPrivate::socketConnected()
+/*
+  Sends data from the binary source while the socket has less than
+  64 KB waiting to be written, so that large sources are streamed
+  rather than read into memory at once.
+*/
+void QtTelnetPrivate::sendBinaryChunks()
 {
-    connected = true;
-    delete notifier;
-    notifier = new QSocketNotifier(socket->socketDescriptor(),
-                                   QSocketNotifier::Exception, this);
-    connect(notifier, SIGNAL(activated(int)),
-            this, SLOT(socketException(int)));
-    sendOptions();
+    if (!binarysource || !connected)
+        return;
+
+    const int chunkSize = 16384;
+    const qint64 highWater = 65536;
+    if (binarychunk.size() != chunkSize)
+        binarychunk.resize(chunkSize);
+    while (socket->bytesToWrite() < highWater) {
+        const qint64 n = binarysource->read(binarychunk.data(), chunkSize);
+        if (n < 0 || (n == 0 && (!binarysource->isSequential()
+                                 || binarysourcedone))) {
+            const qint64 sent = binarysent;
+            stopBinarySource();
+            emit q->binaryDataSent(sent);
+            return;
+        }
+        if (n == 0)
+            return; // Wait for readyRead()
+        binaryout.resize(0);
+        qtTelnetAppendEscapedIAC(binaryout, binarychunk.constData(), int(n));
+        writeSocket(binaryout);
+        binarysent += n;
+    }
 }
 
-void QtTelnetPrivate::socketException(int)
+void QtTelnetPrivate::binarySourceFinished()
 {
-    // qDebug("out-of-band data received, should handle that here!");
+    binarysourcedone = true;
+    sendBinaryChunks();
 }
 
-void QtTelnetPrivate::socketConnectionClosed()
+void QtTelnetPrivate::binarySourceDestroyed()
 {
-    delete notifier;
-    notifier = 0;
-    connected = false;
-    emit q->loggedOut();
+    binarysource = 0;
+    stopBinarySource();
 }
 
-void QtTelnetPrivate::socketReadyRead()
+void QtTelnetPrivate::stopBinarySource()
 {
-    buffer.append(socket->readAll());
-    consume();
+    if (binarysource)
+        disconnect(binarysource, 0, this, 0);
+    binarysource = 0;
+    binarysourcedone = false;
+    binarysent = 0;
 }
 
-void QtTelnetPrivate::socketError(QAbstractSocket::SocketError error)
+/*
+  Stops discarding data, either because the Data Mark ending a SYNC
+  has been found or because the server has answered the TIMING-MARK
+  sent along with an interrupt.
+*/
+void QtTelnetPrivate::endSync()
 {
-    emit q->connectionError(error);
+    syncpending = false;
+    if (notifier)
+        notifier->setEnabled(true);
+}
+
+/*
+  Discards the output the server has already sent until it answers a
+  TIMING-MARK, i.e. until it has processed everything sent so far.
+*/
+void QtTelnetPrivate::requestOutputFlush()
+{
+    flushoutput = true;
+    const char tm[3] = { Common::IAC, Common::DO, Common::TimingMark };
+    writeSocket(tm, sizeof(tm));
+}
+
+bool QtTelnetPrivate::isOperation(const uchar c)
+{
+    return (c == Common::WILL || c == Common::WONT
+            || c == Common::DO ||c == Common::DONT);
+}
+
+/*
+  Doubles every IAC in \a data, as required for data bytes in
+  suboptions and in the data stream.
+*/
+static QByteArray escapeIAC(const QByteArray &data)
+{
+    if (data.indexOf(char(Common::IAC)) == -1)
+        return data;
+    QByteArray a;
+    a.reserve(data.size() + 8);
+    for (int i = 0; i < data.size(); ++i) {
+        a.append(data.at(i));
+        if (uchar(data.at(i)) == Common::IAC)
+            a.append(data.at(i));
+    }
+    return a;
+}
+
+void QtTelnetPrivate::parseSubNAWS(const QByteArray &data)
+{
+    Q_UNUSED(data);
+}
+
+void QtTelnetPrivate::parseSubTT(const QByteArray &data)
+{
+    Q_ASSERT(!data.isEmpty() && data[0] == Common::TerminalType);
+
+    if (data.size() < 2 || data[1] != Common::SEND)
+        return;
+
+    // Cycle through the list as described in RFC1091: the last type is
+    // repeated once to mark the end of the list, after which we start
+    // over from the first.
+    int i = termtypeindex;
+    if (i > termtypes.size())
+        i = 0;
+    const QString type = termtypes.at(qMin(i, termtypes.size() - 1));
+    termtypeindex = i + 1;
+
+    QByteArray a;
+    a.append(char(Common::IAC));
+    a.append(char(Common::SB));
+    a.append(Common::TerminalType);
+    a.append(Common::IS);
+    a.append(escapeIAC(type.toLatin1()));
+    a.append(char(Common::IAC));
+    a.append(char(Common::SE));
+    sendCommand(a);
+}
+
+void QtTelnetPrivate::parseSubEnviron(const QByteArray &data)
+{
+    Q_ASSERT(!data.isEmpty() && data[0] == Common::Environment);
+
+    if (data.size() < 2 || data[1] != Common::SEND)
+        return;
+
+    // Collect the requested variable names; an empty request, or a type
+    // without a name, asks for all variables of that type.
+    const QByteArray request = qtTelnetUnescapeIAC(data.mid(2));
+    QByteArray reply;
+    bool allvars = request.isEmpty(), alluservars = request.isEmpty();
+    int i = 0;
+    while (i < request.size()) {
+        const char type = request.at(i++);
+        if (type != Environ::VAR && type != Environ::USERVAR)
+            continue;
+        QByteArray name;
+        while (i < request.size() && request.at(i) != Environ::VAR
+               && request.at(i) != Environ::USERVAR) {
+            if (request.at(i) == Environ::ESC && i + 1 < request.size())
+                ++i;
+            name.append(request.at(i++));
+        }
+        if (name.isEmpty()) {
+            if (type == Environ::VAR)
+                allvars = true;
+            else
+                alluservars = true;
+            continue;
+        }
+        const QString key = QString::fromUtf8(name);
+        Environ::appendVariable(reply, key, environment.value(key),
+                                environment.contains(key));
+    }
+
+    QMap<QString, QString>::const_iterator it;
+    for (it = environment.constBegin(); it != environment.constEnd(); ++it) {
+        const bool wellknown = Environ::isWellKnown(it.key());
+        if ((wellknown && allvars) || (!wellknown && alluservars))
+            Environ::appendVariable(reply, it.key(), it.value(), true);
+    }
+    sendEnviron(Common::IS, reply);
+    environsent = true;
+}
+
+void QtTelnetPrivate::sendEnviron(char type, const QByteArray &variables)
+{
+    QByteArray a;
+    a.append(char(Common::IAC));
+    a.append(char(Common::SB));
+    a.append(Common::Environment);
+    a.append(type);
+    a.append(escapeIAC(variables));
+    a.append(char(Common::IAC));
+    a.append(char(Common::SE));
+    sendCommand(a);
+}
+
+/*
+  Resets the special line characters to the values used by most Unix
+  terminals.
+*/
+void QtTelnetLineMode::resetSLC()
+{
+    using namespace LineMode;
+    memset(slc, 0, sizeof(slc)); // SLC_NOSUPPORT
+    const struct { uchar func, flags, value; } defaults[] = {
+        { SLC_IP,    SLC_VALUE | SLC_FLUSHIN | SLC_FLUSHOUT, 0x03 }, // ^C
+        { SLC_AO,    SLC_VALUE | SLC_FLUSHOUT,               0x0f }, // ^O
+        { SLC_AYT,   SLC_VALUE,                              0x14 }, // ^T
+        { SLC_ABORT, SLC_VALUE | SLC_FLUSHIN | SLC_FLUSHOUT, 0x1c }, // FS
+        { SLC_EOF,   SLC_VALUE,                              0x04 }, // ^D
+        { SLC_SUSP,  SLC_VALUE | SLC_FLUSHIN,                0x1a }, // ^Z
+        { SLC_EC,    SLC_VALUE,                              0x7f }, // DEL
+        { SLC_EL,    SLC_VALUE,                              0x15 }, // ^U
+        { SLC_EW,    SLC_VALUE,                              0x17 }, // ^W
+        { SLC_RP,    SLC_VALUE,                              0x12 }, // ^R
+        { SLC_LNEXT, SLC_VALUE,                              0x16 }, // ^V
+        { SLC_XON,   SLC_VALUE,                              0x11 }, // ^Q
+        { SLC_XOFF,  SLC_VALUE,                              0x13 }  // ^S
+    };
+    for (uint i = 0; i < sizeof(defaults) / sizeof(defaults[0]); ++i) {
+        slc[defaults[i].func][0] = defaults[i].flags;
+        slc[defaults[i].func][1] = defaults[i].value;
+    }
+}
+
+void QtTelnetPrivate::parseSubLineMode(const QByteArray &data)
+{
+    Q_ASSERT(!data.isEmpty() && data[0] == Common::LineMode);
+
+    if (data.size() < 2)
+        return;
+    QtTelnetLineMode *lm = lineModeState();
+
+    const uchar command = uchar(data[1]);
+    if (command == LineMode::Mode) {
+        if (data.size() < 3)
+            return;
+        const uchar mask = uchar(data[2]);
+        if (mask & LineMode::MODE_ACK) // Acknowledgement of our mode
+            return;
+        // SOFT_TAB and LIT_ECHO only concern local echoing, which is
+        // left to the application, so they are not acknowledged
+        const uchar supported = mask & (LineMode::EDIT | LineMode::TRAPSIG);
+        if (supported == lm->mode)
+            return;
+        lm->mode = supported;
+        if (!isLineEditing())
+            flushEditBuffer();
+        const char c[7] = { Common::IAC, Common::SB, Common::LineMode,
+                            LineMode::Mode,
+                            char(supported | LineMode::MODE_ACK),
+                            Common::IAC, Common::SE };
+        sendCommand(c, sizeof(c));
+    } else if (command == LineMode::SLC) {
+        parseLineModeSLC(qtTelnetUnescapeIAC(data.mid(2)));
+    } else if (isOperation(command) && data.size() >= 3
+               && data[2] == LineMode::ForwardMask) {
+        if (command == Common::DO) {
+            const QByteArray mask = qtTelnetUnescapeIAC(data.mid(3));
+            memset(lm->forwardmask, 0, sizeof(lm->forwardmask));
+            memcpy(lm->forwardmask, mask.constData(),
+                   qMin(mask.size(), int(sizeof(lm->forwardmask))));
+            lm->hasforwardmask = true;
+            const char c[7] = { Common::IAC, Common::SB, Common::LineMode,
+                                Common::WILL, LineMode::ForwardMask,
+                                Common::IAC, Common::SE };
+            sendCommand(c, sizeof(c));
+        } else if (command == Common::DONT && lm->hasforwardmask) {
+            lm->hasforwardmask = false;
+            const char c[7] = { Common::IAC, Common::SB, Common::LineMode,
+                                Common::WONT, LineMode::ForwardMask,
+                                Common::IAC, Common::SE };
+            sendCommand(c, sizeof(c));
+        }
+    }
+}
+
+/*
+  Processes the SLC triplets in \a data and answers them as described
+  in RFC1184 section 5.
+*/
+void QtTelnetPrivate::parseLineModeSLC(const QByteArray &data)
+{
+    using namespace LineMode;
+    QtTelnetLineMode *lm = lineModeState();
+    QByteArray reply;
+    for (int i = 0; i + 2 < data.size(); i += 3) {
+        const uchar func = uchar(data[i]);
+        const uchar flags = uchar(data[i + 1]);
+        const uchar value = uchar(data[i + 2]);
+        const uchar level = flags & SLC_LEVELBITS;
+
+        if (func == 0) { // Request for our whole table
+            if (level == SLC_DEFAULT)
+                lm->resetSLC();
+            for (int f = 1; f <= SLC_EEOL; ++f) {
+                reply.append(char(f));
+                reply.append(char(lm->slc[f][0]));
+                reply.append(char(lm->slc[f][1]));
+            }
+            continue;
+        }
+        if (func > SLC_EEOL) {
+            reply.append(char(func));
+            reply.append(char(SLC_NOSUPPORT));
+            reply.append(char(0));
+            continue;
+        }
+
+        uchar *entry = lm->slc[func];
+        const bool same = ((entry[0] & SLC_LEVELBITS) == level
+                           && entry[1] == value);
+        if (flags & SLC_ACK) {
+            if (!same) {
+                entry[0] = flags & ~SLC_ACK;
+                entry[1] = value;
+            }
+            continue;
+        }
+        if (same)
+            continue;
+
+        if (level == SLC_DEFAULT) {
+            // Tell the server what we use by default
+            reply.append(char(func));
+            reply.append(char(entry[0]));
+            reply.append(char(entry[1]));
+        } else if ((entry[0] & SLC_LEVELBITS) == SLC_CANTCHANGE
+                   && level != SLC_NOSUPPORT) {
+            reply.append(char(func));
+            reply.append(char(entry[0]));
+            reply.append(char(entry[1]));
+        } else {
+            entry[0] = flags;
+            entry[1] = value;
+            reply.append(char(func));
+            reply.append(char(flags | SLC_ACK));
+            reply.append(char(value));
+        }
+    }
+    if (reply.isEmpty())
+        return;
+
+    const char c1[4] = { Common::IAC, Common::SB, Common::LineMode,
+                         LineMode::SLC };
+    const char c2[2] = { Common::IAC, Common::SE };
+    sendCommand(QByteArray(c1, sizeof(c1)) + escapeIAC(reply)
+                + QByteArray(c2, sizeof(c2)));
+}
+
+bool QtTelnetPrivate::isLineEditing() const
+{
+    return lm && (lm->mode & LineMode::EDIT)
+        && core.modes.value(Common::LineMode);
+}
+
+bool QtTelnetLineMode::isForwardChar(uchar c) const
+{
+    if (c == '\r' || c == '\n')
+        return true;
+    if (isSLC(LineMode::SLC_FORW1, c) || isSLC(LineMode::SLC_FORW2, c))
+        return true;
+    return hasforwardmask && (forwardmask[c >> 3] & (0x80 >> (c & 7)));
+}
+
+/*
+  Edits the local line buffer with \a input, as negotiated with the
+  LINEMODE MODE command, and sends every completed line to the server
+  in a single write. Signal characters are sent as Telnet commands when
+  TRAPSIG is set.
+*/
+void QtTelnetPrivate::sendLineModeInput(const QByteArray &input)
+{
+    using namespace LineMode;
+    static const struct { uchar func; uchar command; } traps[] = {
+        { SLC_IP, Common::IP }, { SLC_AO, Common::AO },
+        { SLC_AYT, Common::AYT }, { SLC_ABORT, Common::ABORT },
+        { SLC_SUSP, Common::SUSP }, { SLC_BRK, Common::BRK }
+    };
+
+    int forward = 0;
+    for (int i = 0; i < input.size(); ++i) {
+        const uchar c = uchar(input.at(i));
+        if (lm->literalnext) {
+            lm->literalnext = false;
+            lm->editbuffer.append(char(c));
+            continue;
+        }
+
+        bool handled = false;
+        if (lm->mode & TRAPSIG) {
+            for (uint s = 0; s < sizeof(traps) / sizeof(traps[0]); ++s) {
+                if (!lm->isSLC(traps[s].func, c))
+                    continue;
+                const uchar flags = lm->slc[traps[s].func][0];
+                const char command[2] = { Common::IAC,
+                                          char(traps[s].command) };
+                writeSocket(escapeIAC(lm->editbuffer.left(forward)));
+                lm->editbuffer.remove(0, forward);
+                forward = 0;
+                writeSocket(command, sizeof(command));
+                // RFC 1184: FLUSHIN asks us to flush the server's input
+                // with a SYNC, FLUSHOUT to flush the output it has sent
+                // us, which is done with a TIMING-MARK.
+                if (flags & SLC_FLUSHIN)
+                    q->sendSync();
+                if (flags & SLC_FLUSHOUT)
+                    requestOutputFlush();
+                handled = true;
+                break;
+            }
+        }
+        if (handled)
+            continue;
+
+        if (lm->isSLC(SLC_EC, c)) {
+            if (lm->editbuffer.size() > forward)
+                lm->editbuffer.chop(1);
+        } else if (lm->isSLC(SLC_EL, c)) {
+            lm->editbuffer.truncate(forward);
+        } else if (lm->isSLC(SLC_EW, c)) {
+            int n = lm->editbuffer.size();
+            while (n > forward && lm->editbuffer.at(n - 1) == ' ')
+                --n;
+            while (n > forward && lm->editbuffer.at(n - 1) != ' ')
+                --n;
+            lm->editbuffer.truncate(n);
+        } else if (lm->isSLC(SLC_LNEXT, c)) {
+            lm->literalnext = true;
+        } else if (lm->isSLC(SLC_EOF, c)
+                   && lm->editbuffer.size() == forward) {
+            writeSocket(escapeIAC(lm->editbuffer));
+            lm->editbuffer.clear();
+            forward = 0;
+            const char command[2] = { Common::IAC, Common::LineModeEOF };
+            writeSocket(command, sizeof(command));
+        } else {
+            lm->editbuffer.append(char(c));
+            if (lm->isForwardChar(c))
+                forward = lm->editbuffer.size();
+        }
+    }
+
+    if (forward > 0) {
+        writeSocket(escapeIAC(lm->editbuffer.left(forward)));
+        lm->editbuffer.remove(0, forward);
+    }
+}
+
+/*
+  Sends whatever is left in the line editing buffer as is.
+*/
+void QtTelnetPrivate::flushEditBuffer()
+{
+    if (!lm)
+        return;
+    lm->literalnext = false;
+    if (lm->editbuffer.isEmpty())
+        return;
+    if (connected)
+        writeSocket(escapeIAC(lm->editbuffer));
+    lm->editbuffer.clear();
+}
+
+/*
+  Appends the byte \a c to the STATUS IS reply \a a, doubling the
+  values that would otherwise be taken for IAC or SE.
+*/
+static void appendStatusByte(QByteArray &a, uchar c)
+{
+    a.append(char(c));
+    if (c == Common::SE || c == Common::IAC)
+        a.append(char(c));
+}
+
+void QtTelnetPrivate::parseSubStatus(const QByteArray &data)
+{
+    Q_ASSERT(!data.isEmpty() && data[0] == Common::Status);
+
+    if (data.size() < 2)
+        return;
+    if (data[1] == Common::SEND) {
+        if (core.modes.value(Common::Status))
+            sendStatus();
+        return;
+    }
+    if (data[1] != Common::IS)
+        return;
+
+    const QByteArray status = qtTelnetUnescapeIAC(data.mid(2));
+    peerlocal.clear();
+    peerremote.clear();
+    for (int i = 0; i < status.size(); ++i) {
+        const uchar c = uchar(status.at(i));
+        if (c == Common::SB) {
+            // Skip the suboption parameters, SE SE being a literal SE
+            for (++i; i < status.size(); ++i) {
+                if (uchar(status.at(i)) != Common::SE)
+                    continue;
+                if (i + 1 < status.size()
+                    && uchar(status.at(i + 1)) == Common::SE)
+                    ++i;
+                else
+                    break;
+            }
+            continue;
+        }
+        if (!isOperation(c) || i + 1 >= status.size())
+            continue;
+        const char option = status.at(++i);
+        if (i + 1 < status.size() && uchar(option) == Common::SE
+            && uchar(status.at(i + 1)) == Common::SE)
+            ++i;
+        if (c == Common::WILL || c == Common::WONT)
+            peerremote.setValue(option, c == Common::WILL);
+        else
+            peerlocal.setValue(option, c == Common::DO);
+    }
+    haspeerstatus = true;
+    emit q->statusReceived();
+}
+
+/*
+  Sends our view of the option state, as requested by the server with
+  STATUS SEND.
+*/
+void QtTelnetPrivate::sendStatus()
+{
+    QByteArray a;
+    a.append(char(Common::IAC));
+    a.append(char(Common::SB));
+    a.append(Common::Status);
+    a.append(Common::IS);
+    for (int option = 0; option < 256; ++option) {
+        if (!core.modes.value(option))
+            continue;
+        a.append(char(Common::WILL));
+        appendStatusByte(a, uchar(option));
+    }
+    for (int option = 0; option < 256; ++option) {
+        if (!core.hismodes.value(option))
+            continue;
+        a.append(char(Common::DO));
+        appendStatusByte(a, uchar(option));
+    }
+    if (core.modes.value(Common::NAWS) && windowSize.isValid()) {
+        a.append(char(Common::SB));
+        a.append(Common::NAWS);
+        appendStatusByte(a, uchar(windowSize.width() >> 8));
+        appendStatusByte(a, uchar(windowSize.width()));
+        appendStatusByte(a, uchar(windowSize.height() >> 8));
+        appendStatusByte(a, uchar(windowSize.height()));
+        a.append(char(Common::SE));
+    }
+    a.append(char(Common::IAC));
+    a.append(char(Common::SE));
+    sendCommand(a);
+}
+
+/*
+  Handles the START_TLS FOLLOWS sent by the server once it has agreed
+  to negotiate TLS: we answer with our own FOLLOWS and start the TLS
+  handshake right behind it.
+*/
+void QtTelnetPrivate::parseSubStartTLS(const QByteArray &data)
+{
+    Q_ASSERT(!data.isEmpty() && data[0] == Common::StartTLS);
+
+    if (data.size() < 2 || data[1] != Common::TLSFollows)
+        return;
+#ifndef QTTELNET_NO_SSL
+    QSslSocket *ssl = qobject_cast<QSslSocket *>(socket);
+    if (!isStartTls() || !ssl || ssl->isEncrypted())
+        return;
+    const char c[6] = { Common::IAC, Common::SB, Common::StartTLS,
+                        Common::TLSFollows, Common::IAC, Common::SE };
+    sendCommand(c, sizeof(c));
+    ssl->flush();
+    QTTELNET_TRACE_BEGIN("session", "tls", this);
+    ssl->startClientEncryption();
+#endif
+}
+
+void QtTelnetPrivate::parseSubAuth(const QByteArray &data)
+{
+    Q_ASSERT(data[0] == Common::Authentication);
+
+    if (data.size() < 2)
+        return;
+    if (data[1] == Common::SEND) {
+        if (curauth)
+            return;
+        // The mechanisms the server accepts, as type and modifier pairs
+        const QByteArray pairs = qtTelnetUnescapeIAC(data.mid(2));
+        for (int pos = 0; pos + 1 < pairs.size() && !curauth; pos += 2) {
+            for (int i = 0; i < auths.size(); ++i) {
+                if (auths.at(i)->type() == uchar(pairs.at(pos))
+                    && auths.at(i)->modifiers() == uchar(pairs.at(pos + 1))) {
+                    curauth = auths.at(i);
+                    break;
+                }
+            }
+        }
+        if (curauth) {
+            emit q->loginRequired();
+        } else {
+            if (!authnull)
+                authnull = new QtTelnetAuthNull(q);
+            authnull->d->telnet = q;
+            curauth = authnull;
+            nullauth = true;
+            if (!hasLoginPatterns()) {
+                // emit q->loginRequired();
+                nocheckp = true;
+            }
+        }
+        curauth->d->state = QtTelnetAuthenticator::InProgress;
+        QTTELNET_TRACE_VALUE("session", "authentication", this,
+                             "type", curauth->type());
+        curauth->start();
+    } else if (data[1] == Auth::REPLY) {
+        // IAC SB AUTHENTICATION REPLY type modifiers data IAC SE
+        if (!curauth || data.size() < 4
+            || uchar(data[2]) != curauth->type()
+            || uchar(data[3]) != curauth->modifiers()
+            || curauth->state() != QtTelnetAuthenticator::InProgress)
+            return;
+        // A deep copy, as authenticators may keep it until they are
+        // done with their asynchronous steps
+        QByteArray reply = qtTelnetUnescapeIAC(data.mid(4));
+        reply.detach();
+        curauth->receive(reply);
+    }
+}
+
+/*
+  Called when \a auth has succeeded or failed.
+*/
+void QtTelnetPrivate::authFinished(QtTelnetAuthenticator *auth)
+{
+    if (auth != curauth)
+        return;
+    if (auth->state() == QtTelnetAuthenticator::Failed) {
+        QTTELNET_TRACE_INSTANT("session", "login failed", this);
+        endLoginSpan();
+        emit q->loginFailed();
+        callHook(QtTelnet::LoginFailedEvent);
+    } else if (auth->state() == QtTelnetAuthenticator::Succeeded) {
+        // The server knows who we are, so expect no login prompt
+        if (!nullauth || !hasLoginPatterns())
+            setLoggedIn();
+        if (!nullauth)
+            nocheckp = true;
+    }
+}
+
+/*
+  Sees every option negotiation before QtTelnetCore does, and returns
+  false for the ones that are not negotiated as usual.
+*/
+bool QtTelnetPrivate::telnetOptionReceived(uchar operation, uchar option)
+{
+    if (operation == Common::WONT && option == Common::Logout) {
+        q->close();
+        return false;
+    }
+    if (option == Common::TimingMark
+        && (operation == Common::WILL || operation == Common::WONT)) {
+        // The server has caught up with our interrupt
+        flushoutput = false;
+        return false;
+    }
+    if (option == Common::StartTLS
+        && (operation == Common::DONT || operation == Common::WONT)) {
+        startTlsRefused();
+        if (!connected)
+            return false;
+    }
+    if (operation == Common::DONT && option == Common::Authentication) {
+        if (!hasLoginPatterns())
+            setLoggedIn();
+        nullauth = true;
+    }
+    return true;
+}
+
+/*
+  Handles the suboption between IAC SB and IAC SE. The array refers
+  to the read buffer, so it is only valid during the current read
+  cycle; parsers make deep copies of anything they keep.
+*/
+void QtTelnetPrivate::telnetSubOption(const char *data, int length)
+{
+    if (length <= 0)
+        return;
+    const uchar option = uchar(data[0]);
+    if (handlers && handlers[option]) {
+        // A deep copy, as handlers are free to keep it
+        const QByteArray copy(data + 1, length - 1);
+        handlers[option]->subOption(q, option, qtTelnetUnescapeIAC(copy));
+        return;
+    }
+
+    // IAC SB Operation SubOption [...] IAC SE
+    void (QtTelnetPrivate::*parse)(const QByteArray &) =
+        optionTable[option].parse;
+    if (parse)
+        (this->*parse)(QByteArray::fromRawData(data, length));
+    else
+        qWarning("QtTelnetPrivate::telnetSubOption: unknown suboption %d",
+                 option);
+}
+
+/*
+  Splits \a length bytes at \a p into lines terminated by CR LF,
+  LF or CR NUL and emits each complete line. Lines are found in place;
+  a trailing partial line is copied into partialline, and emitLine()
+  copies the lines that are emitted.
+*/
+void QtTelnetPrivate::frameLines(const char *p, int length)
+{
+    int start = 0;
+    for (int i = 0; i < length; ++i) {
+        const char c = p[i];
+        if (skiplf) {
+            skiplf = false;
+            if (c == '\n') { // CR LF
+                start = i + 1;
+                continue;
+            }
+        }
+        if (c == '\n' || c == '\r') {
+            emitLine(p + start, i - start);
+            skiplf = (c == '\r');
+            start = i + 1;
+        } else if (maxlinelength > 0
+                   && partialline.size() + i - start >= maxlinelength) {
+            emitLine(p + start, i - start);
+            start = i;
+        }
+    }
+    if (start < length)
+        partialline.append(p + start, length - start);
+
+    if (!partialline.isEmpty()
+        && patterns()->prompt.matches(partialline,
+                                      decoderkind == Utf8Decoder, codec))
+        emitLine(0, 0);
+}
+
+void QtTelnetPrivate::emitLine(const char *data, int length)
+{
+    // The read data lives in the per-thread arena, which is reset once
+    // the read has been parsed, and a QByteArray cannot share part of
+    // another one's data, so each line is copied; a view of the arena
+    // would dangle as soon as a receiver kept it or got it queued.
+    QByteArray line;
+    if (partialline.isEmpty()) {
+        if (linewanted)
+            line = QByteArray(data, length);
+    } else {
+        partialline.append(data, length);
+        line = partialline;
+        partialline.clear();
+    }
+    if (linewanted)
+        emit q->lineReceived(line);
+}
+
+int QtTelnetPrivate::parsePlaintext(const char *data, int size)
+{
+    const char *nul = static_cast<const char *>(memchr(data, 0, size));
+    if (nul) {
+        const int length = nul - data;
+        processText(data, length, true);
+        return length + 1; // + 1 for removing '\0'
+    }
+    processText(data, size, false);
+    return size;
+}
+
+/*
+  Delivers \a length bytes of text at \a data. \a nul is true if the
+  text was followed by a NUL, which has been removed.
+*/
+void QtTelnetPrivate::processText(const char *data, int length, bool nul)
+{
+    if (textwantedstale) {
+        textwanted = q->receivers(SIGNAL(message(QString))) > 0;
+        promptwanted = q->receivers(SIGNAL(promptReceived())) > 0;
+        linewanted = q->receivers(SIGNAL(lineReceived(QByteArray))) > 0;
+        textwantedstale = false;
+    }
+
+    if (lineframing) {
+        frameLines(data, length);
+        if (nul) // CR NUL
+            skiplf = false;
+    }
+    // Matched on the raw bytes, so that it does not require decoding
+    const bool prompt = (promptwanted || waitingprompt || eventhook)
+        && loggedin
+        && patterns()->prompt.matches(QByteArray::fromRawData(data, length),
+                                      decoderkind == Utf8Decoder, codec);
+    const bool tee = !outputdevice || (outputflags & QtTelnet::TeeOutput);
+    if (outputdevice && !(outputflags & QtTelnet::DecodedOutput))
+        writeOutput(data, length);
+    if (!(outputdevice && (outputflags & QtTelnet::DecodedOutput))
+        && !(textwanted && tee) && !collecting && !eventhooktext
+        && (nocheckp || !nullauth)) {
+        // Nobody needs the text, so don't spend time decoding it
+        utf8pendinglen = 0;
+        if (prompt) {
+            promptseen = true;
+            QTTELNET_TRACE_INSTANT("session", "prompt", this);
+            emit q->promptReceived();
+            callHook(QtTelnet::PromptEvent);
+        }
+        return;
+    }
+    QString text = decode(data, length);
+    if (outputdevice && (outputflags & QtTelnet::DecodedOutput)) {
+        const QByteArray utf8 = text.toUtf8();
+        writeOutput(utf8.constData(), utf8.size());
+    }
+
+    if (!nocheckp && nullauth) {
+        if (patterns()->prompt.matches(text)) {
+            if (fastloginstate == FastLoginSent)
+                stopFastLogin();
+            setLoggedIn();
+            nocheckp = true;
+        }
+    }
+    if (!nocheckp && nullauth && fastloginstate == FastLoginSent)
+        verifyFastLogin(text);
+    if (!nocheckp && nullauth && fastloginstate != FastLoginSent) {
+        if (patterns()->login.matches(text)) {
+            QTTELNET_TRACE_INSTANT("session", "login prompt", this);
+            if (triedlogin || firsttry) {
+                emit q->message(text);    // Display the login prompt
+                text.clear();
+                emit q->loginRequired();  // Get a (new) login
+                firsttry = false;
+                if (triedlogin) { // The credentials were rejected
+                    QTTELNET_TRACE_INSTANT("session", "login failed", this);
+                    endLoginSpan();
+                    callHook(QtTelnet::LoginFailedEvent);
+                }
+            }
+            if (!triedlogin && credentialsHeld()) {
+                heldprompt = LoginPrompt;
+            } else if (!triedlogin) {
+                sendCredential(login, fastlogin);
+                triedlogin = true;
+            }
+        }
+        if (patterns()->pass.matches(text)) {
+            QTTELNET_TRACE_INSTANT("session", "password prompt", this);
+            if (triedpass || firsttry) {
+                emit q->message(text);    // Display the password prompt
+                text.clear();
+                emit q->loginRequired();  // Get a (new) pass
+                firsttry = false;
+                if (triedpass) { // The credentials were rejected
+                    QTTELNET_TRACE_INSTANT("session", "login failed", this);
+                    endLoginSpan();
+                    callHook(QtTelnet::LoginFailedEvent);
+                }
+            }
+            if (!triedpass && credentialsHeld()) {
+                heldprompt = PasswordPrompt;
+            } else if (!triedpass) {
+                sendCredential(pass, fastlogin);
+                triedpass = true;
+                // We don't have to store the password anymore
+                pass.fill(' ');
+                pass.resize(0);
+            }
+        }
+    }
+
+    if (collecting)
+        collected += text;
+    if (!text.isEmpty() && tee)
+        emit q->message(text);
+    if (!text.isEmpty() && eventhooktext)
+        callHook(QtTelnet::TextEvent, text);
+    if (prompt) {
+        promptseen = true;
+        QTTELNET_TRACE_INSTANT("session", "prompt", this);
+        emit q->promptReceived();
+        callHook(QtTelnet::PromptEvent);
+    }
+}
+
+/*
+  Appends output for the output device to the current batch. Batches
+  are written when they reach 64 KB and at the latest 100 ms after
+  they were started.
+*/
+void QtTelnetPrivate::writeOutput(const char *data, int length)
+{
+    if (length <= 0)
+        return;
+    const int batchSize = 65536;
+    if (outputbatch.isEmpty()) {
+        outputbatch.reserve(batchSize);
+        if (!outputtimer) {
+            outputtimer = new QTimer(this);
+            outputtimer->setSingleShot(true);
+            connect(outputtimer, SIGNAL(timeout()),
+                    this, SLOT(outputTimeout()));
+        }
+        outputtimer->start(100);
+    }
+    outputbatch.append(data, length);
+    if (outputbatch.size() >= batchSize)
+        writeOutputBatch();
+}
+
+/*
+  All data is sent to the server through here, so that it can be
+  recorded in the transcript.
+*/
+qint64 QtTelnetPrivate::writeSocket(const char *data, qint64 length)
+{
+    if (!socket)
+        return -1;
+    if (transcript)
+        transcript->append(QtTelnetTranscript::Outbound, data, int(length));
+    return socket->write(data, length);
+}
+
+void QtTelnetPrivate::writeOutputBatch()
+{
+    if (outputtimer)
+        outputtimer->stop();
+    if (outputbatch.isEmpty() || !outputdevice)
+        return;
+    if (outputwriter) {
+        outputwriter->enqueue(outputbatch);
+        return;
+    }
+    if (outputdevice->write(outputbatch) != outputbatch.size())
+        qWarning("QtTelnet: could not write output: %s",
+                 qPrintable(outputdevice->errorString()));
+    outputbatch.clear();
+}
+
+void QtTelnetPrivate::outputTimeout()
+{
+    writeOutputBatch();
+}
+
+/*
+  Sends a user name or password. With fast login, credentials are
+  terminated by CR LF unless the caller has terminated them already;
+  otherwise they are sent as given, like sendData().
+*/
+void QtTelnetPrivate::sendCredential(const QString &str, bool typeahead)
+{
+    if (str.isEmpty())
+        return;
+    QTTELNET_TRACE_INSTANT("session", "credential sent", this);
+    if (!typeahead || str.endsWith(QLatin1Char('\n'))
+        || str.endsWith(QLatin1Char('\r')))
+        writeData(str);
+    else
+        writeData(str + QLatin1String("\r\n"));
+}
+
+/*
+  Answers the login or password prompt that arrived while START_TLS was
+  still being negotiated, now that the connection is either encrypted
+  or known to stay unencrypted.
+*/
+void QtTelnetPrivate::answerHeldPrompt()
+{
+    const PromptKind kind = heldprompt;
+    heldprompt = NoPrompt;
+    if (kind == LoginPrompt && !triedlogin) {
+        sendCredential(login, fastlogin);
+        triedlogin = true;
+    } else if (kind == PasswordPrompt && !triedpass) {
+        sendCredential(pass, fastlogin);
+        triedpass = true;
+        pass.fill(' ');
+        pass.resize(0);
+    }
+}
+
+/*
+  Sends the user name and password right after the option offers,
+  ahead of the prompts. The prompts that follow are only used to
+  verify that the login went through.
+*/
+void QtTelnetPrivate::startFastLogin()
+{
+    QTTELNET_TRACE_INSTANT("session", "fast login", this);
+    sendCredential(login, true);
+    sendCredential(pass, true);
+    triedlogin = triedpass = true;
+    firsttry = false;
+    fastloginstate = FastLoginSent;
+    fastloginprompts[LoginPrompt] = fastloginprompts[PasswordPrompt] = 0;
+    lastprompt = NoPrompt;
+
+    if (!fastlogintimer) {
+        fastlogintimer = new QTimer(this);
+        fastlogintimer->setSingleShot(true);
+        connect(fastlogintimer, SIGNAL(timeout()),
+                this, SLOT(fastLoginTimeout()));
+    }
+    fastlogintimer->start(fastlogintimeout);
+}
+
+/*
+  Leaves fast login mode, either because the login has been verified
+  or because we fall back to answering the prompts one at a time.
+*/
+void QtTelnetPrivate::stopFastLogin()
+{
+    fastloginstate = FastLoginIdle;
+    if (fastlogintimer)
+        fastlogintimer->stop();
+    if (nocheckp || triedpass) {
+        pass.fill(' ');
+        pass.resize(0);
+    }
+}
+
+/*
+  Checks the prompts seen while a fast login is in flight. The first
+  login and password prompts consume the credentials we sent ahead;
+  seeing either again means they were rejected. The prompt is then
+  handled as a failed login, so new credentials are asked for rather
+  than sending the rejected ones again.
+*/
+void QtTelnetPrivate::verifyFastLogin(const QString &text)
+{
+    PromptKind kind = NoPrompt;
+    if (patterns()->login.matches(text))
+        kind = LoginPrompt;
+    else if (patterns()->pass.matches(text))
+        kind = PasswordPrompt;
+    else if (!text.trimmed().isEmpty())
+        lastprompt = NoPrompt;
+
+    if (kind == NoPrompt)
+        return;
+    lastprompt = kind;
+    if (++fastloginprompts[kind] > 1)
+        stopFastLogin();
+}
+
+/*
+  Called when a fast login has not been verified in time. If the server
+  is sitting at a login or password prompt it most likely discarded the
+  credentials we sent ahead, so we send the one it is asking for again.
+*/
+void QtTelnetPrivate::fastLoginTimeout()
+{
+    if (fastloginstate != FastLoginSent)
+        return;
+    const PromptKind kind = lastprompt;
+    if (kind == LoginPrompt) {
+        sendCredential(login, true);
+        triedpass = false;
+    } else if (kind == PasswordPrompt) {
+        sendCredential(pass, true);
+    }
+    stopFastLogin();
+}
+
+void QtTelnetPrivate::telnetOptionChanged(uchar option, bool local,
+                                          bool enabled)
+{
+    if (handlers && handlers[option])
+        handlers[option]->optionChanged(q, option, local
+                                        ? QtTelnet::LocalSide
+                                        : QtTelnet::RemoteSide, enabled);
+    if (!local)
+        return;
+    if (option == Common::NAWS && enabled)
+        sendWindowSize();
+    if (option == Common::LineMode && !enabled) {
+        flushEditBuffer();
+        delete lm;
+        lm = 0;
+    }
+}
+
+void QtTelnetPrivate::sendWindowSize()
+{
+    if (windowSize.isValid())
+        core.sendWindowSize(windowSize.width(), windowSize.height());
+}
+
+void QtTelnetPrivate::sendString(const QString &str)
+{
+    if (!connected || str.length() == 0)
+        return;
+
+    writeSocket(encode(str));
+}
+
+void QtTelnetPrivate::sendCommand(const QByteArray &command)
+{
+    sendCommand(command.constData(), command.size());
+}
+
+/*
+  Sends IAC \a operation \a option through the core, which keeps
+  track of the negotiations we have started.
+*/
+void QtTelnetPrivate::sendCommand(const char operation, const char option)
+{
+    if (!connected)
+        return;
+    core.sendOption(uchar(operation), uchar(option));
+}
+
+/*
+  Sends the \a length bytes at \a command as they are.
+*/
+void QtTelnetPrivate::sendCommand(const char *command, int length)
+{
+    if (!connected || length <= 0)
+        return;
+    writeSocket(command, length);
+}
+
+/*
+  Returns true if we agree to \a opt being enabled on the side that
+  \a oper refers to.
+*/
+bool QtTelnetPrivate::allowOption(int oper, int opt)
+{
+    opt = quint8(opt);
+    if (handlers && handlers[opt]) {
+        const QtTelnet::OptionSide side =
+            (oper == Common::DO || oper == Common::DONT)
+            ? QtTelnet::LocalSide : QtTelnet::RemoteSide;
+        return handlers[opt]->allowOption(q, opt, side);
+    }
+    switch (optionTable[opt].policy) {
+    case QtTelnetOptionEntry::Agree:
+        return true;
+    case QtTelnetOptionEntry::Refuse:
+        return false;
+    default:
+        break;
+    }
+    switch (opt) {
+    case Common::Binary:
+        return binary;
+    case Common::NAWS:
+        return windowSize.isValid();
+    case Common::Environment:
+        return !environment.isEmpty();
+    case Common::StartTLS:
+        return isStartTls() && !isEncrypted();
+    default:
+        return false;
+    }
+}
+
+void QtTelnetPrivate::sendOptions()
+{
+    if (isStartTls() && !isEncrypted())
+        sendCommand(Common::WILL, Common::StartTLS);
+    sendCommand(Common::WILL, Common::Authentication);
+    sendCommand(Common::DO, Common::SuppressGoAhead);
+    sendCommand(Common::WILL, Common::LineMode);
+    sendCommand(Common::DO, Common::Status);
+    if (windowSize.isValid())
+        sendCommand(Common::WILL, Common::NAWS);
+    if (!environment.isEmpty())
+        sendCommand(Common::WILL, Common::Environment);
+    if (binary) {
+        sendCommand(Common::WILL, Common::Binary);
+        sendCommand(Common::DO, Common::Binary);
+    }
+}
+
+void QtTelnetPrivate::socketConnected()
+{
+#ifndef QTTELNET_NO_SSL
+    QSslSocket *ssl = qobject_cast<QSslSocket *>(socket);
+    if (tlsmode == QtTelnet::ImplicitTls && ssl) {
+        // The session starts once the TLS handshake is done
+        QTTELNET_TRACE_BEGIN("session", "tls", this);
+        ssl->startClientEncryption();
+        return;
+    }
+#endif
+    startSession();
+}
+
+void QtTelnetPrivate::socketHostFound()
+{
+    QTTELNET_TRACE_INSTANT("session", "host found", this);
+}
+
+void QtTelnetPrivate::startSession()
+{
+    if (connecttimer)
+        connecttimer->stop();
+    resetSession();
+    connected = true;
+    starttlsrefused = false;
+    heldprompt = NoPrompt;
+    QTTELNET_TRACE_END("session", "connect", this);
+#ifdef QTTELNET_NO_SSL
+    if (tlsmode == QtTelnet::StartTlsRequired) { // Never in the clear
+        emit q->connectionError(QAbstractSocket::SslHandshakeFailedError);
+        q->close();
+        return;
+    }
+#endif
+    QTTELNET_TRACE_BEGIN("session", "login", this);
+    loginspan = true;
+    delete notifier;
+    notifier = new QSocketNotifier(socket->socketDescriptor(),
+                                   QSocketNotifier::Exception, this);
+    connect(notifier, SIGNAL(activated(int)),
+            this, SLOT(socketException(int)));
+
+    // Keep the Data Mark in the data stream so that we know where the
+    // data to discard ends.
+#ifdef Q_OS_WIN
+    const BOOL on = TRUE;
+#else
+    const int on = 1;
+#endif
+    ::setsockopt(socket->socketDescriptor(), SOL_SOCKET, SO_OOBINLINE,
+                 reinterpret_cast<const char *>(&on), sizeof(on));
+
+    sendOptions();
+    if (fastlogin && !login.isEmpty() && !isStartTls())
+        startFastLogin();
+    emit q->connected();
+    callHook(QtTelnet::ConnectedEvent);
+    if (reconnectpending) {
+        emit q->reconnected();
+        if (patterns()->prompt.isEmpty()) // No way to tell we are logged in
+            setLoggedIn();
+    }
+}
+
+void QtTelnetPrivate::socketEncrypted()
+{
+#ifndef QTTELNET_NO_SSL
+    QTTELNET_TRACE_END("session", "tls", this);
+    cacheTlsSession();
+    if (tlsmode == QtTelnet::ImplicitTls) {
+        startSession();
+    } else if (connected) {
+        // All options are reset once TLS is in place (START_TLS draft,
+        // section 3.2), so negotiation starts over.
+        resetSession();
+        sendOptions();
+        if (heldprompt != NoPrompt)
+            answerHeldPrompt();
+        else if (fastlogin && !login.isEmpty())
+            startFastLogin();
+    }
+    emit q->encrypted();
+#endif
+}
+
+void QtTelnetPrivate::socketSessionTicket()
+{
+    cacheTlsSession();
+}
+
+/*
+  Called when the server declines START_TLS. In StartTls mode the
+  session goes on unencrypted, and a prompt that was held back is
+  answered; in StartTlsRequired mode the connection is closed rather
+  than sending anything in the clear.
+*/
+void QtTelnetPrivate::startTlsRefused()
+{
+    if (!credentialsHeld())
+        return;
+    if (tlsmode == QtTelnet::StartTlsRequired) {
+        heldprompt = NoPrompt;
+        emit q->connectionError(QAbstractSocket::SslHandshakeFailedError);
+        q->close();
+        return;
+    }
+    starttlsrefused = true;
+    answerHeldPrompt();
+    if (fastlogin && !login.isEmpty() && !triedlogin && !triedpass)
+        startFastLogin();
+}
+
+/*
+  Returns true if the kernel still reports urgent data on \a fd, i.e.
+  the Data Mark has not been read from it yet.
+*/
+static bool urgentDataPending(int fd)
+{
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    struct timeval timeout = { 0, 0 };
+    return ::select(fd + 1, 0, 0, &set, &timeout) > 0;
+}
+
+/*
+  Called when the server has sent urgent data, i.e. the Data Mark of a
+  SYNC. Everything up to the Data Mark is discarded without being
+  processed as text. The notifier keeps firing until the mark has been
+  read, so it is disabled until then.
+
+  The data may already have been read, mark and all, by the time the
+  notifier fires. If the kernel no longer reports urgent data and a
+  Data Mark has been parsed since the last SYNC, that mark ended it,
+  and nothing is discarded; otherwise discarding would only end at the
+  next SYNC.
+*/
+void QtTelnetPrivate::socketException(int)
+{
+    const bool pending = urgentDataPending(socket->socketDescriptor());
+    const int marks = datamarks;
+    datamarks = 0;
+    if (!pending && marks > 0)
+        return;
+    syncpending = true;
+    if (notifier)
+        notifier->setEnabled(false);
+    socketReadyRead();
+}
+
+void QtTelnetPrivate::socketConnectionClosed()
+{
+    QTTELNET_TRACE_INSTANT("session", "closed", this);
+    endLoginSpan();
+    writeOutputBatch();
+    delete notifier;
+    notifier = 0;
+    connected = false;
+    loggedin = false;
+    emit q->loggedOut();
+    callHook(QtTelnet::ClosedEvent);
+    if (autoreconnect && !userclosed && !lasthost.isEmpty())
+        scheduleReconnect();
+}
+
+/*
+  Reads the available data into the per-thread arena and parses it in
+  place, in chunks of at most 64 KB. Only an incomplete command at the
+  end of a chunk is copied, to be completed by the next read.
+*/
+void QtTelnetPrivate::socketReadyRead()
+{
+    // The exception notifier only fires after this read, so a SYNC
+    // whose Data Mark is still ahead is caught here, before the data
+    // it discards is processed
+    if (notifier && notifier->isEnabled()
+        && urgentDataPending(socket->socketDescriptor())) {
+        syncpending = true;
+        notifier->setEnabled(false);
+    }
+    QtTelnetArena *arena = qtTelnetReadArena();
+    arena->begin();
+    QTcpSocket *s = socket;
+    qint64 available;
+    while (s == socket && (available = s->bytesAvailable()) > 0) {
+        const int chunk = int(qMin(available, qint64(65536)));
+        const int held = pending.size();
+        char *data = arena->allocate(held + chunk);
+        if (held)
+            memcpy(data, pending.constData(), held);
+        const qint64 n = s->read(data + held, chunk);
+        if (n <= 0)
+            break;
+        if (transcript)
+            transcript->append(QtTelnetTranscript::Inbound, data + held,
+                               int(n));
+        pending.clear();
+        const int length = held + int(n);
+        const int used = consume(data, length);
+        if (used < length)
+            pending = QByteArray(data + used, length - used);
+    }
+    arena->end();
+}
+
+void QtTelnetPrivate::socketError(QAbstractSocket::SocketError error)
+{
+    QTTELNET_TRACE_VALUE("session", "error", this, "error", error);
+    if (!connected)
+        QTTELNET_TRACE_END("session", "connect", this);
+    if (connecttimer && !connected)
+        connecttimer->stop();
+    emit q->connectionError(error);
+    callHook(QtTelnet::ClosedEvent);
+    if (reconnectpending && !connected)
+        scheduleReconnect();
+}
+
+/*!
+    \enum QtTelnet::Control
+
+    This enum specifies control messages you can send to the Telnet server
+    using sendControl().
+
+    \value GoAhead Sends the \c GO \c AHEAD control message, meaning that the
+    server can continue to send data.
+
+    \value InterruptProcess Interrupts the current running process on
+    the server. This is the equivalent of pressing \key{Ctrl+C} in most
+    terminal emulators.
+
+    \value AreYouThere Sends the \c ARE \c YOU \c THERE control
+    message, to check if the connection is still alive.
+
+    \value AbortOutput Temporarily suspends the output from the server.
+    The output will resume if you send this control message again.
+
+    \value EraseCharacter Erases the last entered character.
+
+    \value EraseLine Erases the last line.
+
+    \value Break Sends the \c BREAK control message.
+
+    \value EndOfFile Sends the \c END \c OF \c FILE control message.
+
+    \value Suspend Suspends the current running process on the server.
+    Equivalent to pressing \key{Ctrl+Z} in most terminal emulators.
+
+    \value Abort Sends the \c ABORT control message.
+
+    \sa sendControl()
+*/
+
+/*!
+    Constructs a QtTelnet object.
+
+    You must call connectToHost() before calling any of the other
+    member functions.
+
+    The \a parent is sent to the QObject constructor.
+
+    \sa connectToHost()
+*/
+QtTelnet::QtTelnet(QObject *parent)
+    : QObject(parent), d(new QtTelnetPrivate(this))
+{
+}
+
+/*!
+    Destroys the QtTelnet object. This will also close
+    the connection to the server.
+
+    \sa logout()
+*/
+QtTelnet::~QtTelnet()
+{
+    delete d;
+}
+
+/*!
+    Calling this function will make the QtTelnet object attempt to
+    connect to a Telnet server specified by the given \a host and \a
+    port.
+
+    The connected() signal is emitted if the connection
+    succeeds, and the connectionError() signal is emitted if the
+    connection fails. Once the connection is establishe you must call
+    login().
+
+    \sa close(), setConnectTimeout(), setParallelConnectEnabled()
+*/
+void QtTelnet::connectToHost(const QString &host, quint16 port)
+{
+    if (d->connected || d->lookupid != -1 || !d->attempts.isEmpty())
+        return;
+    QTTELNET_TRACE_BEGIN("session", "connect", d);
+    d->userclosed = false;
+    d->lasthost = host;
+    d->lastport = port;
+    if (d->parallelconnect) {
+        d->startParallelConnect(host, port);
+        return;
+    }
+#ifndef QTTELNET_NO_SSL
+    if (d->tlsmode != NoTls && !qobject_cast<QSslSocket *>(d->socket))
+        d->setSocket(d->createSocket());
+#endif
+    if (!d->socket)
+        d->setSocket(d->createSocket());
+    d->configureTls(d->socket);
+    d->startConnectTimer();
+    d->socket->connectToHost(host, port);
+}
+
+/*!
+    Returns true if the connection to the server has been established
+    and has not been closed; otherwise returns false.
+
+    \sa connected(), isLoggedIn()
+*/
+bool QtTelnet::isConnected() const
+{
+    return d->connected;
+}
+
+/*!
+    Returns true if you have been logged in, i.e. loggedIn() has been
+    emitted, and the connection has not been closed since; otherwise
+    returns false.
+
+    \sa loggedIn(), isConnected()
+*/
+bool QtTelnet::isLoggedIn() const
+{
+    return d->connected && d->loggedin;
+}
+
+/*!
+    Sets the time connectToHost() may take to establish a connection to
+    \a msecs milliseconds, including the host name lookup. If the
+    connection has not been established by then, it is aborted and
+    connectionError() is emitted with QAbstractSocket::SocketTimeoutError.
+
+    A timeout of 0, which is the default, leaves it to the operating
+    system to give up.
+
+    \sa connectTimeout(), connectToHost()
+*/
+void QtTelnet::setConnectTimeout(int msecs)
+{
+    d->connecttimeout = qMax(0, msecs);
+}
+
+/*!
+    Returns the connection timeout in milliseconds.
+
+    \sa setConnectTimeout()
+*/
+int QtTelnet::connectTimeout() const
+{
+    return d->connecttimeout;
+}
+
+/*!
+    Enables parallel connection attempts if \a enable is true;
+    otherwise disables them.
+
+    By default, connectToHost() tries the addresses of the host one at a
+    time, so an unreachable address can delay the connection until the
+    operating system gives up on it. With parallel connection attempts
+    enabled, the host name is resolved asynchronously and connections
+    to the addresses found are started 250 milliseconds apart,
+    alternating between IPv6 and IPv4 addresses, as described in
+    RFC8305. The first connection to be established is used, and the
+    others are abandoned. The address that won is available from
+    socket()->peerAddress() once connected() has been emitted.
+
+    The winning connection uses a new QTcpSocket, which replaces any
+    socket passed to setSocket().
+
+    \sa setConnectTimeout(), connected()
+*/
+void QtTelnet::setParallelConnectEnabled(bool enable)
+{
+    d->parallelconnect = enable;
+}
+
+/*!
+    Returns true if parallel connection attempts are enabled; otherwise
+    returns false.
+
+    \sa setParallelConnectEnabled()
+*/
+bool QtTelnet::isParallelConnectEnabled() const
+{
+    return d->parallelconnect;
+}
+
+/*!
+    Closes the connection to a Telnet server.
+
+    \sa connectToHost() login()
+*/
+void QtTelnet::close()
+{
+    QTTELNET_TRACE_INSTANT("session", "close", d);
+    d->userclosed = true;
+    d->reconnectpending = false;
+    d->pendingcommands.clear();
+    if (d->reconnecttimer)
+        d->reconnecttimer->stop();
+    d->cancelConnect();
+    d->writeOutputBatch();
+    if (!d->connected)
+        return;
+    d->endLoginSpan();
+    delete d->notifier;
+    d->notifier = 0;
+    d->connected = false;
+    d->socket->close();
+    emit loggedOut();
+    d->callHook(ClosedEvent);
+}
+
+/*!
+    Sends the control message \a ctrl to the Telnet server the
+    QtTelnet object is connected to.
+
+    InterruptProcess and AbortOutput are followed by a \c SYNC and a
+    \c TIMING-MARK request; output the server sent before it
+    processed the interrupt is discarded rather than emitted through
+    message().
+
+    \sa Control sendData() sendSync()
+*/
+void QtTelnet::sendControl(Control ctrl)
+{
+    bool sendsync = false;
+    char c;
+    switch (ctrl) {
+    case InterruptProcess: // Ctrl-C
+        c = Common::IP;
+        sendsync = true;
+        break;
+    case AbortOutput: // suspend/resume output
+        c = Common::AO;
+        sendsync = true;
+        break;
+    case Break:
+        c = Common::BRK;
+        break;
+    case Suspend: // Ctrl-Z
+        c = Common::SUSP;
+        break;
+    case EndOfFile:
+        c = Common::CEOF;
+        break;
+    case Abort:
+        c = Common::ABORT;
+        break;
+    case GoAhead:
+        c = Common::GA;
+        break;
+    case AreYouThere:
+        c = Common::AYT;
+        sendsync = true;
+        break;
+    case EraseCharacter:
+        c = Common::EC;
+        break;
+    case EraseLine:
+        c = Common::EL;
+        break;
+    default:
+        return;
+    }
+    const char command[2] = {Common::IAC, c};
+    d->sendCommand(command, sizeof(command));
+    if (sendsync)
+        sendSync();
+    if (ctrl == InterruptProcess || ctrl == AbortOutput)
+        d->requestOutputFlush();
+}
+
+/*!
+    Sends the string \a data to the Telnet server. This is often a
+    command the Telnet server will execute.
+
+    If the server has enabled local line editing through the LINEMODE
+    option (RFC1184), \a data is edited locally using the special
+    characters negotiated with the server, and is only sent once a line
+    is complete. Each line is sent in a single write.
+
+    While a lost connection is being reestablished, \a data is queued
+    and sent once the session has logged in again.
+
+    \sa sendControl(), setAutoReconnectEnabled()
+*/
+void QtTelnet::sendData(const QString &data)
+{
+    if (d->reconnectpending) {
+        d->pendingcommands.append(data);
+        return;
+    }
+    d->writeData(data);
+}
+
+void QtTelnetPrivate::writeData(const QString &data)
+{
+    if (!connected)
+        return;
+
+    QByteArray str = encode(data);
+    if (isLineEditing()) {
+        sendLineModeInput(str);
+        return;
+    }
+    writeSocket(str);
+    //socket->write("\r\n\0", 3);
+}
+
+/*!
+    \reimp
+*/
+#if QT_VERSION >= 0x050000
+void QtTelnet::connectNotify(const QMetaMethod &)
+#else
+void QtTelnet::connectNotify(const char *)
+#endif
+{
+    // Checked at the next read; QObject functions must not be called
+    // from here.
+    d->textwantedstale = true;
+}
+
+/*!
+    \reimp
+*/
+#if QT_VERSION >= 0x050000
+void QtTelnet::disconnectNotify(const QMetaMethod &)
+#else
+void QtTelnet::disconnectNotify(const char *)
+#endif
+{
+    d->textwantedstale = true;
+}
+
+/*!
+    This function will log you out of the Telnet server.
+    You cannot send any other data after sending this command.
+
+    \sa login() sendData() sendControl()
+*/
+void QtTelnet::logout()
+{
+    d->userclosed = true;
+    d->sendCommand(Common::DO, Common::Logout);
+}
+
+/*!
+    Sets the client window size to \a size.
+
+    The width and height are given in number of characters.
+    Non-visible clients should pass an invalid size (i.e. QSize()).
+
+    \sa isValidWindowSize()
+*/
+void QtTelnet::setWindowSize(const QSize &size)
+{
+    setWindowSize(size.width(), size.height());
+}
+
+/*!
+    Sets the client window size.
+
+    The \a width and \a height are given in number of characters.
+
+    \overload
+*/
+void QtTelnet::setWindowSize(int width, int height)
+{
+    bool wasvalid = isValidWindowSize();
+
+    d->windowSize.setWidth(width);
+    d->windowSize.setHeight(height);
+
+    if (wasvalid && isValidWindowSize())
+        d->sendWindowSize();
+    else if (isValidWindowSize())
+        d->sendCommand(Common::WILL, Common::NAWS);
+    else if (wasvalid)
+        d->sendCommand(Common::WONT, Common::NAWS);
+}
+
+/*!
+    Returns the window's size. This will be an invalid size
+    if the Telnet server is not using the NAWS option (RFC1073).
+
+    \sa isValidWindowSize()
+*/
+QSize QtTelnet::windowSize() const
+{
+    return (d->core.modes.value(Common::NAWS) ? d->windowSize : QSize());
+}
+
+/*!
+    Returns true if the window size is valid, i.e.
+    windowSize().isValid() returns true; otherwise returns false.
+
+    \sa setWindowSize()
+*/
+bool QtTelnet::isValidWindowSize() const
+{
+    return windowSize().isValid();
+}
+
+/*!
+    Set the \a socket to be used in the communication.
+
+    This function allows you to use your own QSocket subclass. You
+    should call this function before calling connectToHost(); if you
+    call it after a connection has been established the connection
+    will be closed, so in all cases you will need to call
+    connectToHost() after calling this function.
+
+    \sa socket(), connectToHost(), logout()
+*/
+void QtTelnet::setSocket(QTcpSocket *socket)
+{
+    d->setSocket(socket);
+}
+
+/*!
+    Returns the QTcpSocket instance used by this telnet object. The
+    socket is created when it is first needed, i.e. by this function or
+    by connectToHost(), unless one has been set with setSocket().
+
+    \sa setSocket()
+*/
+QTcpSocket *QtTelnet::socket() const
+{
+    if (!d->socket)
+        d->setSocket(d->createSocket());
+    return d->socket;
+}
+
+/*!
+    Sends the Telnet \c SYNC sequence, meaning that the Telnet server
+    should discard any data waiting to be processed once the \c SYNC
+    sequence has been received. This is sent using a TCP urgent
+    notification, or in-band on an encrypted connection.
+
+    A \c SYNC sent by the server is honored the same way: the text
+    preceding its Data Mark is dropped, while the Telnet commands in
+    it are still processed.
+
+    \sa sendControl()
+*/
+void QtTelnet::sendSync()
+{
+    if (!d->connected)
+        return;
+    const char sync[2] = { Common::IAC, Common::DM };
+    if (d->isEncrypted()) { // No urgent data through TLS
+        d->writeSocket(sync, sizeof(sync));
+        return;
+    }
+    d->socket->flush(); // Force the socket to send all the pending data before
+                        // sending the SYNC sequence.
+    int s = d->socket->socketDescriptor();
+    ::send(s, sync, sizeof(sync), MSG_OOB); // Urgent, marking the DATA MARK
+    if (d->transcript)
+        d->transcript->append(QtTelnetTranscript::Outbound, sync, sizeof(sync));
+}
+
+/*!
+    Sets the expected shell prompt pattern.
+
+    The \a pattern is used to automatically recognize when the client
+    has successfully logged in. When a line is read that matches the
+    \a pattern, the loggedIn() signal will be emitted.
+
+    \sa login(), loggedIn()
+*/
+void QtTelnet::setPromptPattern(const QRegExp &pattern)
+{
+    d->writablePatterns()->prompt.setRegExp(pattern);
+}
+
+#if QT_VERSION >= 0x050000
+/*!
+    \overload
+
+    Sets the expected shell prompt pattern to the regular expression
+    \a pattern. The pattern is optimized when set; QRegularExpression
+    is implicitly shared, so sessions given the same pattern object
+    share its compiled code. This function requires Qt 5.
+*/
+void QtTelnet::setPromptPattern(const QRegularExpression &pattern)
+{
+    d->writablePatterns()->prompt.setRegularExpression(pattern);
+}
+#endif
+
+/*!
+    Sets the expected shell prompt to the literal string \a pattern.
+    The prompt is found with a substring search instead of a regular
+    expression, on the raw data where the text codec allows it.
+
+    \overload
+*/
+void QtTelnet::setPromptString(const QString &pattern)
+{
+    d->writablePatterns()->prompt.setLiteral(pattern);
+}
+
+/*!
+    Sets the expected login pattern.
+
+    The \a pattern is used to automatically recognize when the server
+    asks for a username. If no username has been set, the
+    loginRequired() signal will be emitted.
+
+    \sa login()
+*/
+void QtTelnet::setLoginPattern(const QRegExp &pattern)
+{
+    d->writablePatterns()->login.setRegExp(pattern);
+}
+
+#if QT_VERSION >= 0x050000
+/*!
+    \overload
+
+    Sets the expected login pattern to the regular expression
+    \a pattern. This function requires Qt 5.
+
+    \sa setPromptPattern()
+*/
+void QtTelnet::setLoginPattern(const QRegularExpression &pattern)
+{
+    d->writablePatterns()->login.setRegularExpression(pattern);
+}
+#endif
+
+/*!
+    Sets the expected login string to the literal string \a login.
+
+    \overload
+*/
+void QtTelnet::setLoginString(const QString &login)
+{
+    d->writablePatterns()->login.setLiteral(login);
+}
+
+/*!
+    Sets the expected password prompt pattern.
+
+    The \a pattern is used to automatically recognize when the server
+    asks for a password. If no password has been set, the loginRequired()
+    signal will be emitted.
+
+    \sa login()
+*/
+void QtTelnet::setPasswordPattern(const QRegExp &pattern)
+{
+    d->writablePatterns()->pass.setRegExp(pattern);
+}
+
+#if QT_VERSION >= 0x050000
+/*!
+    \overload
+
+    Sets the expected password prompt pattern to the regular expression
+    \a pattern. This function requires Qt 5.
+
+    \sa setPromptPattern()
+*/
+void QtTelnet::setPasswordPattern(const QRegularExpression &pattern)
+{
+    d->writablePatterns()->pass.setRegularExpression(pattern);
+}
+#endif
+
+/*!
+    Sets the expected password prompt to the literal string \a pattern.
+
+    \overload
+*/
+void QtTelnet::setPasswordString(const QString &pattern)
+{
+    d->writablePatterns()->pass.setLiteral(pattern);
+}
+
+/*!
+    Sets the \a username and \a password to be used when logging in to
+    the server.
+
+    \sa setLoginPattern(), setPasswordPattern()
+*/
+void QtTelnet::login(const QString &username, const QString &password)
+{
+    if (d->fastloginstate == QtTelnetPrivate::FastLoginSent)
+        d->stopFastLogin();
+    d->triedpass = d->triedlogin = false;
+    d->login = username;
+    d->pass = password;
+    // Only kept for reconnecting; otherwise the password is wiped once
+    // it has been sent
+    if (d->autoreconnect) {
+        d->savedlogin = username;
+        d->savedpass = password;
+    }
+    if (d->curauth && !d->nullauth
+        && d->curauth->state() == QtTelnetAuthenticator::InProgress)
+        d->curauth->credentialsChanged();
+}
+
+/*!
+    Adds \a authenticator to the mechanisms offered when the server
+    asks for authentication (RFC2941). The first mechanism in the
+    server's list that matches the type and modifiers of an added
+    authenticator is used; if none does, QtTelnet logs in through the
+    login and password prompts. QtTelnet takes ownership of
+    \a authenticator.
+
+    \sa authenticators(), QtTelnetSraAuthenticator
+*/
+void QtTelnet::addAuthenticator(QtTelnetAuthenticator *authenticator)
+{
+    if (!authenticator || d->auths.contains(authenticator))
+        return;
+    if (authenticator->d->telnet) {
+        qWarning("QtTelnet::addAuthenticator: authenticator already used "
+                 "by another session");
+        return;
+    }
+    authenticator->setParent(this);
+    authenticator->d->telnet = this;
+    d->auths.append(authenticator);
+}
+
+/*!
+    Returns the authenticators added with addAuthenticator().
+*/
+QList<QtTelnetAuthenticator *> QtTelnet::authenticators() const
+{
+    return d->auths;
+}
+
+/*!
+    Enables line framing if \a enable is true; otherwise disables it.
+
+    When line framing is enabled, the lineReceived() signal is emitted
+    once for every complete line received from the server, in addition
+    to the message() signal. Lines may be terminated by CR LF, LF or
+    CR NUL; the terminator is not included in the line. Incomplete
+    lines are held back until the rest of the line arrives, until the
+    line reaches maximumLineLength(), until the prompt pattern matches
+    it, or until flushPartialLine() is called.
+
+    Each line is copied into a QByteArray of its own before it is
+    emitted, i.e. there is one allocation per line; no lines are copied
+    while nothing is connected to lineReceived(). Where that cost
+    matters, use setOutputDevice() instead, which passes the received
+    data on in batches rather than line by line.
+
+    Line framing is disabled by default.
+
+    \sa lineReceived(), setMaximumLineLength(), setPromptPattern()
+*/
+void QtTelnet::setLineFramingEnabled(bool enable)
+{
+    if (!enable)
+        flushPartialLine();
+    d->lineframing = enable;
+    d->skiplf = false;
+}
+
+/*!
+    Returns true if line framing is enabled; otherwise returns false.
+
+    \sa setLineFramingEnabled()
+*/
+bool QtTelnet::isLineFramingEnabled() const
+{
+    return d->lineframing;
+}
+
+/*!
+    Sets the maximum line length to \a length bytes. Longer lines are
+    split, and delivered through lineReceived() in pieces of at most
+    \a length bytes. A \a length of 0 or less means that lines are never
+    split.
+
+    The default maximum line length is 8192 bytes.
+
+    \sa setLineFramingEnabled()
+*/
+void QtTelnet::setMaximumLineLength(int length)
+{
+    d->maxlinelength = qMax(0, length);
+}
+
+/*!
+    Returns the maximum line length.
+
+    \sa setMaximumLineLength()
+*/
+int QtTelnet::maximumLineLength() const
+{
+    return d->maxlinelength;
+}
+
+/*!
+    Emits any incomplete line held back by line framing through the
+    lineReceived() signal. This is useful when the server has written
+    a prompt that is not terminated by a newline.
+
+    \sa setLineFramingEnabled()
+*/
+void QtTelnet::flushPartialLine()
+{
+    if (d->partialline.isEmpty())
+        return;
+    d->linewanted = receivers(SIGNAL(lineReceived(QByteArray))) > 0;
+    d->emitLine(0, 0);
+}
+
+/*!
+    Sets the \a codec used to decode the text received from the server
+    and to encode the text passed to sendData(). Passing 0 selects the
+    codec for the current locale, which is the default.
+
+    Decoding is stateful, so a multibyte character that is split across
+    two reads is decoded correctly. UTF-8 and ISO-8859-1 are decoded
+    without going through the codec, and data consisting only of ASCII
+    characters is widened directly.
+
+    \sa textCodec(), message()
+*/
+void QtTelnet::setTextCodec(QTextCodec *codec)
+{
+    d->setCodec(codec);
+}
+
+/*!
+    Returns the codec used for the text sent to and received from the
+    server.
+
+    \sa setTextCodec()
+*/
+QTextCodec *QtTelnet::textCodec() const
+{
+    return d->codec;
+}
+
+/*!
+    \enum QtTelnet::OptionSide
+
+    This enum specifies which side of the connection a Telnet option
+    applies to.
+
+    \value LocalSide The option is performed by this client.
+    \value RemoteSide The option is performed by the server.
+
+    \sa isOptionEnabled()
+*/
+
+/*!
+    Returns true if the Telnet \a option has been negotiated on for the
+    given \a side; otherwise returns false. Options are identified by
+    their number as assigned by IANA, e.g. 31 for NAWS.
+
+    \sa isPeerOptionEnabled()
+*/
+bool QtTelnet::isOptionEnabled(int option, OptionSide side) const
+{
+    const QtTelnetOptionSet &m = (side == LocalSide ? d->core.modes
+                                                    : d->core.hismodes);
+    return m.value(uchar(option));
+}
+
+/*!
+    If \a enable is true, asks the server to use the TRANSMIT-BINARY
+    option (RFC856) in both directions; otherwise asks it to return to
+    NVT text. The request is sent at once when connected and at every
+    connect. The default is false.
+
+    Whether each direction has actually switched can be checked with
+    isOptionEnabled(0, LocalSide) and isOptionEnabled(0, RemoteSide).
+
+    \sa isBinaryMode(), setBinarySink(), sendBinary()
+*/
+void QtTelnet::setBinaryMode(bool enable)
+{
+    if (d->binary == enable)
+        return;
+    d->binary = enable;
+    if (!d->connected)
+        return;
+    const bool local = d->core.modes.value(Common::Binary);
+    const bool remote = d->core.hismodes.value(Common::Binary);
+    if (local != enable)
+        d->sendCommand(enable ? Common::WILL : Common::WONT, Common::Binary);
+    if (remote != enable)
+        d->sendCommand(enable ? Common::DO : Common::DONT, Common::Binary);
+}
+
+/*!
+    Returns true if binary mode has been requested; otherwise returns
+    false.
+
+    \sa setBinaryMode()
+*/
+bool QtTelnet::isBinaryMode() const
+{
+    return d->binary;
+}
+
+/*!
+    Sets the device that receives the data from the server while the
+    server transmits in binary to \a device. The data is written to
+    the device as is, with only doubled IAC bytes undone; message(),
+    lineReceived() and the prompt patterns are bypassed. Telnet
+    commands in the data stream are still processed.
+
+    QtTelnet does not take ownership of \a device, which must be open
+    for writing. Passing 0 returns to handling the received data as
+    text even in binary mode.
+
+    \sa binarySink(), setBinaryMode()
+*/
+void QtTelnet::setBinarySink(QIODevice *device)
+{
+    d->binarysink = device;
 }
 
 /*!
-    \enum QtTelnet::Control
+    Returns the device that receives binary data, or 0 if there is
+    none.
 
-    This enum specifies control messages you can send to the Telnet server
-    using sendControl().
+    \sa setBinarySink()
+*/
+QIODevice *QtTelnet::binarySink() const
+{
+    return d->binarysink;
+}
 
-    \value GoAhead Sends the \c GO \c AHEAD control message, meaning that the
-    server can continue to send data.
+/*!
+    Sends the contents of \a device to the server, doubling every IAC
+    byte. The data is read in chunks as the socket drains, so
+    arbitrarily large devices can be sent without being loaded into
+    memory. Sequential devices are read until they are closed. The
+    binaryDataSent() signal is emitted when all the data has been
+    handed to the socket.
+
+    The server should have agreed to TRANSMIT-BINARY for the data to
+    arrive unchanged; see setBinaryMode(). \a device must be open for
+    reading and remain valid until binaryDataSent() has been emitted.
+    Starting another transfer cancels the current one.
+
+    \sa setBinarySink()
+*/
+void QtTelnet::sendBinary(QIODevice *device)
+{
+    d->stopBinarySource();
+    if (!device || !d->connected)
+        return;
+    d->binarysource = device;
+    if (device->isSequential()) {
+        connect(device, SIGNAL(readyRead()), d, SLOT(sendBinaryChunks()));
+        connect(device, SIGNAL(readChannelFinished()),
+                d, SLOT(binarySourceFinished()));
+        connect(device, SIGNAL(aboutToClose()),
+                d, SLOT(binarySourceFinished()));
+    }
+    connect(device, SIGNAL(destroyed()), d, SLOT(binarySourceDestroyed()));
+    d->sendBinaryChunks();
+}
 
-    \value InterruptProcess Interrupts the current running process on
-    the server. This is the equivalent of pressing \key{Ctrl+C} in most
-    terminal emulators.
+/*!
+    \overload
 
-    \value AreYouThere Sends the \c ARE \c YOU \c THERE control
-    message, to check if the connection is still alive.
+    Sends \a data to the server, doubling every IAC byte.
+*/
+void QtTelnet::sendBinary(const QByteArray &data)
+{
+    if (!d->connected)
+        return;
+    QByteArray a;
+    a.reserve(data.size() + 16);
+    qtTelnetAppendEscapedIAC(a, data.constData(), data.size());
+    d->writeSocket(a);
+}
 
-    \value AbortOutput Temporarily suspends the output from the server.
-    The output will resume if you send this control message again.
+/*!
+    \enum QtTelnet::OutputFlag
 
-    \value EraseCharacter Erases the last entered character.
+    This enum specifies how text received from the server is written
+    to the device set with setOutputDevice().
 
-    \value EraseLine Erases the last line.
+    \value RawOutput The text is written as received, with the Telnet
+    commands removed. This is the default.
 
-    \value Break Sends the \c BREAK control message.
+    \value DecodedOutput The text is decoded with the text codec and
+    written as UTF-8.
 
-    \value EndOfFile Sends the \c END \c OF \c FILE control message.
+    \value TeeOutput The message() signal is still emitted. Without
+    this flag the text only goes to the device.
 
-    \value Suspend Suspends the current running process on the server.
-    Equivalent to pressing \key{Ctrl+Z} in most terminal emulators.
+    \value ThreadedOutput The device is written on a separate thread,
+    so that a slow device does not delay reading from the socket. The
+    device must not be used by anything else while it is set, and must
+    be safe to write from another thread, as QFile is.
 
-    \value Abort Sends the \c ABORT control message.
+    \sa setOutputDevice()
+*/
 
-    \sa sendControl()
+/*!
+    Writes the text received from the server to \a device, as
+    specified by \a flags, instead of emitting it with message(). The
+    text is written from within the parser, without a signal emission
+    or a QString for every chunk, which suits capturing large amounts
+    of output to a file, pipe or QBuffer.
+
+    Writes are batched in blocks of up to 64 KB; a batch is written at
+    the latest 100 ms after it was started, and when the connection is
+    closed. With ThreadedOutput, the batches are written on a separate
+    thread, and reading from the socket only waits for the device if
+    more than 32 MB are queued.
+
+    QtTelnet does not take ownership of \a device, which must be open
+    for writing and remain valid until it is replaced. Passing 0 writes
+    out what is left of the last batch and returns to emitting
+    message().
+
+    \sa outputDevice(), setBinarySink()
 */
+void QtTelnet::setOutputDevice(QIODevice *device, OutputFlags flags)
+{
+    d->writeOutputBatch();
+    delete d->outputwriter; // Waits for the queued batches
+    d->outputwriter = 0;
+    d->outputbatch = QByteArray();
+    d->outputdevice = device;
+    d->outputflags = flags;
+    if (device && (flags & ThreadedOutput)) {
+        d->outputwriter = new QtTelnetOutputWriter(device);
+        d->outputwriter->start();
+    }
+}
 
 /*!
-    Constructs a QtTelnet object.
+    Returns the device the received text is written to, or 0 if there
+    is none.
 
-    You must call connectToHost() before calling any of the other
-    member functions.
+    \sa setOutputDevice()
+*/
+QIODevice *QtTelnet::outputDevice() const
+{
+    return d->outputdevice;
+}
 
-    The \a parent is sent to the QObject constructor.
+/*!
+    Records all data sent and received by this session, including the
+    Telnet commands, in \a transcript. Passing 0 stops recording.
 
-    \sa connectToHost()
+    QtTelnet does not take ownership of \a transcript, which must be
+    open and remain valid until it is replaced.
+
+    \sa transcript()
 */
-QtTelnet::QtTelnet(QObject *parent)
-    : QObject(parent), d(new QtTelnetPrivate(this))
+void QtTelnet::setTranscript(QtTelnetTranscript *transcript)
 {
+    d->transcript = transcript;
 }
 
 /*!
-    Destroys the QtTelnet object. This will also close
-    the connection to the server.
+    Returns the transcript the session is recorded in, or 0 if there is
+    none.
 
-    \sa logout()
+    \sa setTranscript()
 */
-QtTelnet::~QtTelnet()
+QtTelnetTranscript *QtTelnet::transcript() const
 {
-    delete d;
+    return d->transcript;
 }
 
-/*!
-    Calling this function will make the QtTelnet object attempt to
-    connect to a Telnet server specified by the given \a host and \a
-    port.
+/*
+  Returns the time left of \a msecs after \a timer has been running,
+  or -1 for no limit.
+*/
+static int remainingTime(int msecs, const QElapsedTimer &timer)
+{
+    if (msecs < 0)
+        return -1;
+    return qMax(0, msecs - int(timer.elapsed()));
+}
 
-    The connected() signal is emitted if the connection
-    succeeds, and the connectionError() signal is emitted if the
-    connection fails. Once the connection is establishe you must call
-    login().
+/*
+  Delivers the queued calls posted to the current authenticator and
+  its children, and none of those posted to other objects, whose
+  slots would otherwise run from within a waiting function.
+*/
+void QtTelnetPrivate::deliverAuthCalls()
+{
+    QCoreApplication::sendPostedEvents(curauth, QEvent::MetaCall);
+    const QObjectList children = curauth->children();
+    for (int i = 0; i < children.size(); ++i)
+        QCoreApplication::sendPostedEvents(children.at(i), QEvent::MetaCall);
+}
+
+/*
+  Reads and processes data from the socket without an event loop
+  until \a flag becomes true, the connection is closed or \a msecs
+  milliseconds have passed. Replies are written out while waiting.
+*/
+bool QtTelnetPrivate::waitFor(const bool &flag, int msecs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!flag) {
+        if (!socket)
+            return false;
+        const int remaining = remainingTime(msecs, timer);
+        if (remaining == 0)
+            return false;
+        if (!connected) {
+            // Still connecting, e.g. right after connectToHost()
+            if (socket->state() == QAbstractSocket::UnconnectedState
+                || !q->waitForConnected(remaining))
+                return false;
+            continue;
+        }
+        socket->flush();
+        if (curauth && !nullauth
+            && curauth->state() == QtTelnetAuthenticator::InProgress) {
+            // Authenticators finish their steps through queued calls,
+            // which need delivering without an event loop
+            deliverAuthCalls();
+            if (!socket->waitForReadyRead(qMin(remaining, 10))
+                && socket->state() != QAbstractSocket::ConnectedState)
+                return flag;
+            continue;
+        }
+        // Emits readyRead(), which parses the data through
+        // socketReadyRead() as usual
+        if (!socket->waitForReadyRead(remaining))
+            return flag;
+    }
+    socket->flush();
+    return true;
+}
 
-    \sa close()
+/*!
+    Waits until the connection started by connectToHost() has been
+    established, or until \a msecs milliseconds have passed. If
+    \a msecs is -1, this function does not time out. Returns true if
+    the connection has been established; otherwise returns false.
+
+    Like QAbstractSocket::waitForConnected(), this function blocks and
+    drives the socket directly, without an event loop, so it can be
+    used in threads that do not run one. The connected() signal is
+    emitted before it returns. With implicit TLS, it also waits for the
+    handshake to complete.
+
+    Parallel connection attempts rely on the event loop, so this
+    function fails if they are enabled. Features driven by timers,
+    such as the connection timeout, fast login fallback, reconnection
+    and the flushing of the output device, do not work without an
+    event loop either.
+
+    \sa waitForLoggedIn(), setParallelConnectEnabled()
 */
-void QtTelnet::connectToHost(const QString &host, quint16 port)
+bool QtTelnet::waitForConnected(int msecs)
 {
     if (d->connected)
+        return true;
+    if (d->lookupid != -1 || !d->attempts.isEmpty()) {
+        qWarning("QtTelnet::waitForConnected: parallel connection attempts"
+                 " require an event loop");
+        return false;
+    }
+    if (!d->socket || d->socket->state() == QAbstractSocket::UnconnectedState)
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+    if (d->socket->state() != QAbstractSocket::ConnectedState
+        && !d->socket->waitForConnected(msecs))
+        return false;
+#ifndef QTTELNET_NO_SSL
+    QSslSocket *ssl = qobject_cast<QSslSocket *>(d->socket);
+    if (!d->connected && ssl && d->tlsmode == ImplicitTls)
+        ssl->waitForEncrypted(remainingTime(msecs, timer));
+#endif
+    if (d->connected)
+        d->socket->flush();
+    return d->connected;
+}
+
+/*!
+    Waits until you have been logged in, i.e. loggedIn() has been
+    emitted, or until \a msecs milliseconds have passed. If \a msecs
+    is -1, this function does not time out. Returns true if you are
+    logged in; otherwise returns false.
+
+    The data received while waiting is processed as usual, and the
+    replies it needs, such as option negotiation and the credentials
+    given to login(), are sent. Signals are emitted as data arrives.
+    If the connection is still being established, the function waits
+    for it first, so it can directly follow connectToHost() and
+    login(). It works without an event loop; see waitForConnected().
+
+    \sa login(), setPromptPattern()
+*/
+bool QtTelnet::waitForLoggedIn(int msecs)
+{
+    return d->waitFor(d->loggedin, msecs);
+}
+
+/*!
+    Waits until text matching the prompt pattern is received after
+    you have been logged in, or until \a msecs milliseconds have
+    passed. If \a msecs is -1, this function does not time out.
+    Returns true if the prompt was received; otherwise returns false.
+
+    Only a prompt received after this function is called counts. The
+    function works without an event loop; see waitForConnected().
+
+    \sa promptReceived(), execute()
+*/
+bool QtTelnet::waitForPrompt(int msecs)
+{
+    d->promptseen = false;
+    d->waitingprompt = true;
+    const bool seen = d->waitFor(d->promptseen, msecs);
+    d->waitingprompt = false;
+    return seen;
+}
+
+/*!
+    Sends \a command as a line to the server and waits for the prompt
+    that follows its output, for at most \a msecs milliseconds, or
+    without a limit if \a msecs is -1. Returns the text received in
+    the meantime, which includes the echo of the command, if any, and
+    the prompt. If \a ok is not 0, *\a{ok} is set to true if the
+    prompt was received, and to false if the command timed out or the
+    connection was closed.
+
+    You must have been logged in. The function works without an event
+    loop; see waitForConnected(). The text is still delivered with
+    message() as well.
+
+    \sa waitForPrompt(), sendData()
+*/
+QString QtTelnet::execute(const QString &command, int msecs, bool *ok)
+{
+    d->collected.clear();
+    d->collecting = true;
+    d->promptseen = false;
+    d->waitingprompt = true;
+    sendData(command + QLatin1String("\r\n"));
+    const bool done = d->waitFor(d->promptseen, msecs);
+    d->waitingprompt = false;
+    d->collecting = false;
+    if (ok)
+        *ok = done;
+    const QString output = d->collected;
+    d->collected.clear();
+    return output;
+}
+
+/*!
+    \enum QtTelnet::HookEvent
+
+    This enum describes the events passed to an event hook.
+
+    \value ConnectedEvent The connection has been established.
+    \value LoggedInEvent You have been logged in.
+    \value LoginFailedEvent The server rejected the login.
+    \value PromptEvent The prompt was received after login.
+    \value TextEvent Text has been received; only passed if the hook
+    asked for text.
+    \value ClosedEvent The connection was closed or could not be
+    established.
+*/
+
+/*!
+    \typedef QtTelnet::EventHook
+
+    A function that is called with the context pointer given to
+    setEventHook(), the event and, for TextEvent, the text received.
+*/
+
+/*!
+    Sets the function called for the session's events to \a hook, with
+    \a context as its first argument; 0 removes the hook. If \a text
+    is true, the text received is passed as well, as TextEvent.
+
+    The hook is called directly from the code that handles the event,
+    after the corresponding signal has been emitted, for example from
+    within the parser for PromptEvent. Unlike connecting to the signals,
+    calling a hook involves no allocations, so it is suited for driving
+    many sessions from state machines or coroutines; qttelnetcoro.h
+    uses it. The hook must not delete the QtTelnet object.
+*/
+void QtTelnet::setEventHook(EventHook hook, void *context, bool text)
+{
+    d->eventhook = hook;
+    d->eventhookcontext = context;
+    d->eventhooktext = hook && text;
+}
+
+/*!
+    Makes \a handler handle the Telnet \a option for this session, in
+    place of the built-in handling, or restores the built-in handling if
+    \a handler is 0. The handler decides whether the option may be
+    enabled, is told when it has been, and gets the option's
+    suboptions. The same handler may be set for several options and
+    sessions. QtTelnet does not take ownership of \a handler, which must
+    stay valid while it is set.
+
+    Options are identified by their number as assigned by IANA. Note
+    that options the built-in handling refuses can only be enabled if
+    the server asks for them.
+
+    \sa optionHandler(), sendSubOption(), QtTelnetOptionHandler
+*/
+void QtTelnet::setOptionHandler(int option, QtTelnetOptionHandler *handler)
+{
+    if (option < 0 || option > 255) {
+        qWarning("QtTelnet::setOptionHandler: invalid option %d", option);
         return;
-    d->socket->connectToHost(host, port);
+    }
+    if (!d->handlers) {
+        if (!handler)
+            return;
+        d->handlers = new QtTelnetOptionHandler *[256];
+        memset(d->handlers, 0, 256 * sizeof(QtTelnetOptionHandler *));
+    }
+    d->handlers[option] = handler;
 }
 
 /*!
-    Closes the connection to a Telnet server.
+    Returns the handler set for the Telnet \a option, or 0 if the
+    option has the built-in handling.
 
-    \sa connectToHost() login()
+    \sa setOptionHandler()
 */
-void QtTelnet::close()
+QtTelnetOptionHandler *QtTelnet::optionHandler(int option) const
 {
-    if (!d->connected)
+    if (!d->handlers || option < 0 || option > 255)
+        return 0;
+    return d->handlers[option];
+}
+
+/*!
+    Sends \a data as a suboption of the Telnet \a option, i.e. between
+    IAC SB \e option and IAC SE. Any IAC bytes in \a data are escaped.
+    Nothing is sent if \a option is not between 0 and 255.
+
+    \sa setOptionHandler()
+*/
+void QtTelnet::sendSubOption(int option, const QByteArray &data)
+{
+    if (option < 0 || option > 255) {
+        qWarning("QtTelnet::sendSubOption: invalid option %d", option);
         return;
-    delete d->notifier;
-    d->notifier = 0;
-    d->connected = false;
-    d->socket->close();
-    emit loggedOut();
+    }
+    QByteArray a;
+    a.reserve(data.size() + 5);
+    a.append(Common::IAC);
+    a.append(Common::SB);
+    a.append(char(option));
+    qtTelnetAppendEscapedIAC(a, data.constData(), data.size());
+    a.append(Common::IAC);
+    a.append(Common::SE);
+    d->sendCommand(a);
 }
 
 /*!
-    Sends the control message \a ctrl to the Telnet server the
-    QtTelnet object is connected to.
+    Asks the server to report the option state it believes is in effect
+    using the STATUS option (RFC859). The statusReceived() signal is
+    emitted when the server answers. Nothing is sent if the server has
+    not agreed to use the STATUS option.
 
-    \sa Control sendData() sendSync()
+    \sa isPeerOptionEnabled(), reconcileStatus()
 */
-void QtTelnet::sendControl(Control ctrl)
+void QtTelnet::requestStatus()
 {
-    bool sendsync = false;
-    char c;
-    switch (ctrl) {
-    case InterruptProcess: // Ctrl-C
-        c = Common::IP;
-        sendsync = true;
-        break;
-    case AbortOutput: // suspend/resume output
-        c = Common::AO;
-        sendsync = true;
-        break;
-    case Break:
-        c = Common::BRK;
-        break;
-    case Suspend: // Ctrl-Z
-        c = Common::SUSP;
-        break;
-    case EndOfFile:
-        c = Common::CEOF;
-        break;
-    case Abort:
-        c = Common::ABORT;
-        break;
-    case GoAhead:
-        c = Common::GA;
-        break;
-    case AreYouThere:
-        c = Common::AYT;
-        sendsync = true;
-        break;
-    case EraseCharacter:
-        c = Common::EC;
-        break;
-    case EraseLine:
-        c = Common::EL;
-        break;
-    default:
+    if (!d->core.hismodes.value(Common::Status))
         return;
+    const char c[6] = { Common::IAC, Common::SB, Common::Status,
+                        Common::SEND, Common::IAC, Common::SE };
+    d->sendCommand(c, sizeof(c));
+}
+
+/*!
+    Returns true if the server has reported its option state since the
+    connection was established; otherwise returns false.
+
+    \sa requestStatus()
+*/
+bool QtTelnet::hasPeerStatus() const
+{
+    return d->haspeerstatus;
+}
+
+/*!
+    Returns true if the server, in its last STATUS report, said that
+    the Telnet \a option is enabled for the given \a side; otherwise
+    returns false. The \a side is given from the point of view of this
+    client, i.e. LocalSide refers to the options the server expects this
+    client to perform.
+
+    \sa requestStatus(), isOptionEnabled()
+*/
+bool QtTelnet::isPeerOptionEnabled(int option, OptionSide side) const
+{
+    const QtTelnetOptionSet &m = (side == LocalSide ? d->peerlocal
+                                                    : d->peerremote);
+    return m.value(uchar(option));
+}
+
+/*!
+    Updates the local option table to match the last STATUS report
+    received from the server, without renegotiating any options. Returns
+    the number of options that were changed. If the window size option
+    is enabled as a result, the window size is sent to the server.
+
+    \sa requestStatus(), hasPeerStatus()
+*/
+int QtTelnet::reconcileStatus()
+{
+    if (!d->haspeerstatus)
+        return 0;
+
+    int changed = 0;
+    for (int option = 0; option < 256; ++option) {
+        const uchar opt = uchar(option);
+        if (d->peerlocal.value(opt) != d->core.modes.value(opt)) {
+            d->core.setMode(d->peerlocal.value(opt) ? Common::DO
+                                                    : Common::DONT, opt);
+            ++changed;
+        }
+        if (d->peerremote.value(opt) != d->core.hismodes.value(opt)) {
+            d->core.setMode(d->peerremote.value(opt) ? Common::WILL
+                                                     : Common::WONT, opt);
+            ++changed;
+        }
     }
-    const char command[2] = {Common::IAC, c};
-    d->sendCommand(command, sizeof(command));
-    if (sendsync)
-        sendSync();
+    return changed;
 }
 
 /*!
-    Sends the string \a data to the Telnet server. This is often a
-    command the Telnet server will execute.
+    Sets the list of terminal \a types reported to the server through
+    the TERMINAL-TYPE option (RFC1091). The server can cycle through the
+    list to pick the type it supports best, so the preferred type should
+    come first. An empty list is treated as a list containing just
+    "UNKNOWN", which is the default.
 
-    \sa sendControl()
+    \sa terminalTypes()
 */
-void QtTelnet::sendData(const QString &data)
+void QtTelnet::setTerminalTypes(const QStringList &types)
 {
-    if (!d->connected)
+    d->termtypes = types;
+    if (d->termtypes.isEmpty())
+        d->termtypes = *defaultTerminalTypes();
+    d->termtypeindex = 0;
+}
+
+/*!
+    Returns the list of terminal types reported to the server.
+
+    \sa setTerminalTypes()
+*/
+QStringList QtTelnet::terminalTypes() const
+{
+    return d->termtypes;
+}
+
+/*!
+    Sets the variables passed to the server through the NEW-ENVIRON
+    option (RFC1572) to \a environment.
+
+    Servers that support this option can use variables such as \c USER
+    instead of prompting for them, which saves a round trip when
+    logging in. The well-known variables \c USER, \c JOB, \c ACCT,
+    \c PRINTER, \c SYSTEMTYPE and \c DISPLAY are sent as such; all
+    other variables are sent as user variables. The option is only
+    offered to the server if the environment is not empty.
+
+    The environment should be set before calling connectToHost().
+
+    \sa setEnvironmentVariable(), environment()
+*/
+void QtTelnet::setEnvironment(const QMap<QString, QString> &environment)
+{
+    d->environment = environment;
+}
+
+/*!
+    Returns the variables passed to the server through the NEW-ENVIRON
+    option.
+
+    \sa setEnvironment()
+*/
+QMap<QString, QString> QtTelnet::environment() const
+{
+    return d->environment;
+}
+
+/*!
+    Sets the environment variable \a name to \a value. If the variables
+    have already been sent to the server, the change is reported to it
+    with a NEW-ENVIRON INFO command.
+
+    \sa setEnvironment()
+*/
+void QtTelnet::setEnvironmentVariable(const QString &name,
+                                      const QString &value)
+{
+    if (d->environment.contains(name) && d->environment.value(name) == value)
         return;
+    d->environment.insert(name, value);
+    if (d->environsent && d->core.modes.value(Common::Environment)) {
+        QByteArray a;
+        Environ::appendVariable(a, name, value, true);
+        d->sendEnviron(Common::INFO, a);
+    }
+}
 
-    QByteArray str = data.toLocal8Bit();
-    d->socket->write(str);
-    //d->socket->write("\r\n\0", 3);
+/*!
+    Enables fast login if \a enable is true; otherwise disables it.
+
+    With fast login enabled, the user name and password given to
+    login() are sent together with the initial option offers, right
+    after the connection is established, instead of waiting for the
+    server to prompt for them. This saves several round trips on high
+    latency links, but should only be used with servers that are known
+    to read typed-ahead input at their login prompts. login() must be
+    called before connectToHost().
+
+    The user name and password are each terminated by CR LF, unless
+    they already end with a line terminator. Without fast login, they
+    are sent as given.
+
+    The login and password patterns are then only used to verify the
+    login. If the server is still waiting at one of the prompts after
+    fastLoginTimeout(), the credential it is asking for is sent once
+    more, since the server most likely discarded the typed-ahead input.
+    If it prompts for the user name or password a second time, the
+    credentials were rejected, and loginRequired() is emitted. When the
+    prompt pattern matches, loggedIn() is emitted as usual.
+
+    Fast login is disabled by default.
+
+    \sa login(), setPromptPattern(), setFastLoginTimeout()
+*/
+void QtTelnet::setFastLoginEnabled(bool enable)
+{
+    d->fastlogin = enable;
 }
 
 /*!
-    This function will log you out of the Telnet server.
-    You cannot send any other data after sending this command.
+    Sets the time a fast login may take to be verified to \a msecs
+    milliseconds. The default is 10000 milliseconds.
 
-    \sa login() sendData() sendControl()
+    \sa setFastLoginEnabled()
 */
-void QtTelnet::logout()
+void QtTelnet::setFastLoginTimeout(int msecs)
 {
-    d->sendCommand(Common::DO, Common::Logout);
+    d->fastlogintimeout = qMax(0, msecs);
 }
 
 /*!
-    Sets the client window size to \a size.
+    Returns the fast login timeout in milliseconds.
 
-    The width and height are given in number of characters.
-    Non-visible clients should pass an invalid size (i.e. QSize()).
-
-    \sa isValidWindowSize()
+    \sa setFastLoginTimeout()
 */
-void QtTelnet::setWindowSize(const QSize &size)
+int QtTelnet::fastLoginTimeout() const
 {
-    setWindowSize(size.width(), size.height());
+    return d->fastlogintimeout;
 }
 
 /*!
-    Sets the client window size.
+    Returns true if fast login is enabled; otherwise returns false.
 
-    The \a width and \a height are given in number of characters.
+    \sa setFastLoginEnabled()
+*/
+bool QtTelnet::isFastLoginEnabled() const
+{
+    return d->fastlogin;
+}
 
-    \overload
+/*!
+    Enables automatic reconnection if \a enable is true; otherwise
+    disables it.
+
+    When automatic reconnection is enabled and the connection is lost
+    without close() or logout() having been called, QtTelnet connects
+    to the same host again after a delay, negotiates the options anew
+    and logs in with the credentials last passed to login() while
+    automatic reconnection was enabled. The credentials are therefore
+    kept in memory until automatic reconnection is disabled or the
+    QtTelnet object is destroyed. Otherwise the password is wiped from
+    memory once it has been sent, so if automatic reconnection is
+    enabled after login() has been called, call login() again to
+    provide the credentials for reconnecting.
+    Data passed to sendData() in the meantime is queued, and sent once
+    loggedIn() has been emitted for the new connection. If no prompt
+    pattern has been set, there is no way to tell when the login has
+    completed, so the queued data is sent right after connecting.
+
+    The delay grows exponentially with each failed attempt, with random
+    jitter so that sessions do not reconnect in lockstep. The number of
+    failures is shared by all sessions connected to the same host and
+    port, and is reset when a session logs in to it successfully. The
+    reconnecting() signal is emitted for every attempt, and
+    reconnected() when the connection is back.
+
+    Automatic reconnection is disabled by default.
+
+    \sa setReconnectBackoff(), setReconnectRateLimit()
 */
-void QtTelnet::setWindowSize(int width, int height)
+void QtTelnet::setAutoReconnectEnabled(bool enable)
 {
-    bool wasvalid = isValidWindowSize();
+    d->autoreconnect = enable;
+    if (!enable) {
+        d->savedlogin.clear();
+        d->savedpass.fill(QLatin1Char(' '));
+        d->savedpass.clear();
+        if (d->reconnecttimer)
+            d->reconnecttimer->stop();
+        d->reconnectpending = false;
+        d->pendingcommands.clear();
+    }
+}
 
-    d->windowSize.setWidth(width);
-    d->windowSize.setHeight(height);
+/*!
+    Returns true if automatic reconnection is enabled; otherwise returns
+    false.
 
-    if (wasvalid && isValidWindowSize())
-        d->sendWindowSize();
-    else if (isValidWindowSize())
-        d->sendCommand(Common::WILL, Common::NAWS);
-    else if (wasvalid)
-        d->sendCommand(Common::WONT, Common::NAWS);
+    \sa setAutoReconnectEnabled()
+*/
+bool QtTelnet::isAutoReconnectEnabled() const
+{
+    return d->autoreconnect;
 }
 
 /*!
-    Returns the window's size. This will be an invalid size
-    if the Telnet server is not using the NAWS option (RFC1073).
+    Sets the delay before the first reconnection attempt to
+    \a initialMsecs milliseconds, doubling with every failed attempt up
+    to \a maximumMsecs milliseconds. The actual delay is picked at
+    random between half of that and the full value.
 
-    \sa isValidWindowSize()
+    The defaults are 1 second and 60 seconds.
+
+    \sa setAutoReconnectEnabled()
 */
-QSize QtTelnet::windowSize() const
+void QtTelnet::setReconnectBackoff(int initialMsecs, int maximumMsecs)
 {
-    return (d->modes[Common::NAWS] ? d->windowSize : QSize());
+    d->reconnectinitial = qMax(1, initialMsecs);
+    d->reconnectmaximum = qMax(d->reconnectinitial, maximumMsecs);
 }
 
 /*!
-    Returns true if the window size is valid, i.e.
-    windowSize().isValid() returns true; otherwise returns false.
+    Limits the number of automatic reconnection attempts made by all
+    QtTelnet objects in the process to \a reconnectsPerSecond. Attempts
+    beyond the limit are delayed. A limit of 0, which is the default,
+    means no limit.
 
-    \sa setWindowSize()
+    \sa setAutoReconnectEnabled()
 */
-bool QtTelnet::isValidWindowSize() const
+void QtTelnet::setReconnectRateLimit(int reconnectsPerSecond)
 {
-    return windowSize().isValid();
+    QtTelnetReconnectPolicy *policy = reconnectPolicy();
+    QMutexLocker locker(&policy->mutex);
+    policy->rate = qMax(0, reconnectsPerSecond);
 }
 
 /*!
-    Set the \a socket to be used in the communication.
+    \enum QtTelnet::TlsMode
 
-    This function allows you to use your own QSocket subclass. You
-    should call this function before calling connectToHost(); if you
-    call it after a connection has been established the connection
-    will be closed, so in all cases you will need to call
-    connectToHost() after calling this function.
+    This enum specifies whether, and how, the connection to the Telnet
+    server is encrypted with TLS.
 
-    \sa socket(), connectToHost(), logout()
+    \value NoTls The connection is not encrypted. This is the default.
+
+    \value ImplicitTls The TLS handshake is done as soon as the TCP
+    connection is established, before any Telnet data is exchanged.
+    This is used by Telnet servers listening on port 992.
+
+    \value StartTls The connection starts unencrypted, and QtTelnet
+    offers the START_TLS option to the server. If the server accepts,
+    the connection is encrypted before the login, and all options are
+    negotiated anew. If the server declines, the session continues
+    unencrypted; use isEncrypted() to check before sending anything
+    sensitive.
+
+    \value StartTlsRequired Like StartTls, except that the connection
+    is closed, and connectionError() is emitted with
+    QAbstractSocket::SslHandshakeFailedError, if the server declines
+    START_TLS.
+
+    \sa setTlsMode()
 */
-void QtTelnet::setSocket(QTcpSocket *socket)
-{
-    d->setSocket(socket);
-}
 
 /*!
-    Returns the QTcpSocket instance used by this telnet object.
+    Sets the TLS \a mode used for subsequent connections.
 
-    \sa setSocket()
+    Encrypted connections use a QSslSocket, which replaces any socket
+    passed to setSocket() that is not a QSslSocket. The session of each
+    TLS connection is remembered per host and port for the lifetime of
+    the process, and offered to the server on the next connection to
+    it, so that reconnects and additional sessions to the same server
+    can skip the full handshake (requires Qt 5.4 or later).
+
+    The login is only sent once the connection is encrypted, except in
+    StartTls mode when the server declines to use TLS. A login or
+    password prompt that arrives before the server has answered the
+    START_TLS offer is held back until it has.
+
+    \sa tlsMode(), setSslConfiguration(), encrypted()
 */
-QTcpSocket *QtTelnet::socket() const
+void QtTelnet::setTlsMode(TlsMode mode)
 {
-    return d->socket;
+    d->tlsmode = mode;
 }
 
 /*!
-    Sends the Telnet \c SYNC sequence, meaning that the Telnet server
-    should discard any data waiting to be processed once the \c SYNC
-    sequence has been received. This is sent using a TCP urgent
-    notification.
+    Returns the TLS mode.
 
-    \sa sendControl()
+    \sa setTlsMode()
 */
-void QtTelnet::sendSync()
+QtTelnet::TlsMode QtTelnet::tlsMode() const
 {
-    if (!d->connected)
-        return;
-    d->socket->flush(); // Force the socket to send all the pending data before
-                        // sending the SYNC sequence.
-    int s = d->socket->socketDescriptor();
-    char tosend = (char)Common::DM;
-    ::send(s, &tosend, 1, MSG_OOB); // Send the DATA MARK as out-of-band
+    return d->tlsmode;
 }
 
 /*!
-    Sets the expected shell prompt pattern.
-
-    The \a pattern is used to automatically recognize when the client
-    has successfully logged in. When a line is read that matches the
-    \a pattern, the loggedIn() signal will be emitted.
+    Returns true if the connection to the server is encrypted;
+    otherwise returns false.
 
-    \sa login(), loggedIn()
+    \sa encrypted()
 */
-void QtTelnet::setPromptPattern(const QRegExp &pattern)
+bool QtTelnet::isEncrypted() const
 {
-    d->promptp = pattern;
+    return d->isEncrypted();
 }
 
+#ifndef QTTELNET_NO_SSL
 /*!
-    \fn void QtTelnet::setPromptString(const QString &pattern)
-
-    Sets the expected shell prompt to \a pattern.
+    Sets the TLS \a configuration used for encrypted connections, e.g.
+    to add the certificate of a server with a self-signed certificate to
+    the trusted CA certificates.
 
-    \overload
+    \sa sslConfiguration(), setTlsMode()
 */
+void QtTelnet::setSslConfiguration(const QSslConfiguration &configuration)
+{
+    d->sslconfig = configuration;
+}
 
 /*!
-    Sets the expected login pattern.
+    Returns the TLS configuration used for encrypted connections.
 
-    The \a pattern is used to automatically recognize when the server
-    asks for a username. If no username has been set, the
-    loginRequired() signal will be emitted.
-
-    \sa login()
+    \sa setSslConfiguration()
 */
-void QtTelnet::setLoginPattern(const QRegExp &pattern)
+QSslConfiguration QtTelnet::sslConfiguration() const
 {
-    d->loginp = pattern;
+    return d->sslconfig;
 }
+#endif
 
 /*!
-    \fn void QtTelnet::setLoginString(const QString &login)
+    \fn void QtTelnet::encrypted()
 
-    Sets the expected login string to \a login.
+    This signal is emitted when the TLS handshake with the server has
+    completed.
 
-    \overload
+    \sa setTlsMode(), isEncrypted()
 */
 
 /*!
-    Sets the expected password prompt pattern.
+    \fn void QtTelnet::connected()
 
-    The \a pattern is used to automatically recognize when the server
-    asks for a password. If no password has been set, the loginRequired()
-    signal will be emitted.
+    This signal is emitted when the connection to the Telnet server has
+    been established and the initial options have been offered.
 
-    \sa login()
+    \sa connectToHost(), login()
 */
-void QtTelnet::setPasswordPattern(const QRegExp &pattern)
-{
-    d->passp = pattern;
-}
 
 /*!
-    \fn void QtTelnet::setPasswordString(const QString &pattern)
+    \fn void QtTelnet::reconnecting(int attempt, int delay)
 
-    Sets the expected password prompt to \a pattern.
+    This signal is emitted when the connection has been lost, or a
+    reconnection attempt has failed, and QtTelnet will try to connect
+    again in \a delay milliseconds. \a attempt is the number of the
+    attempt, starting from 1.
 
-    \overload
+    \sa setAutoReconnectEnabled(), reconnected()
 */
 
 /*!
-    Sets the \a username and \a password to be used when logging in to
-    the server.
+    \fn void QtTelnet::reconnected()
 
-    \sa setLoginPattern(), setPasswordPattern()
+    This signal is emitted when a lost connection has been
+    reestablished. It is emitted after connected().
+
+    \sa reconnecting()
 */
-void QtTelnet::login(const QString &username, const QString &password)
-{
-    d->triedpass = d->triedlogin = false;
-    d->login = username;
-    d->pass = password;
-}
 
 /*!
     \fn void QtTelnet::loginRequired()
@@ -1391,5 +4868,315 @@ void QtTelnet::login(const QString &username, const QString &password)
     \sa sendData()
 */
 
+/*!
+    \fn void QtTelnet::promptReceived()
+
+    This signal is emitted after you have been logged in, whenever
+    text matching the prompt pattern has been received, i.e. the server
+    is ready for the next command. The text itself is delivered with
+    message() first.
+
+    The pattern is matched against each piece of text as it is
+    received, so a prompt that is split across two reads is not
+    recognized.
+
+    \sa setPromptPattern(), loggedIn()
+*/
+
+/*!
+    \fn void QtTelnet::lineReceived(const QByteArray &line)
+
+    This signal is emitted when line framing is enabled and a complete
+    \a line has been received from the Telnet server. The line
+    terminator is not part of \a line.
+
+    Each \a line is a copy of its own, made only when something is
+    connected to this signal, so it may be kept and passed across
+    threads.
+
+    \sa setLineFramingEnabled(), message()
+*/
+
+/*!
+    \fn void QtTelnet::binaryDataSent(qint64 bytes)
+
+    This signal is emitted when a transfer started with sendBinary()
+    has been completed. \a bytes is the number of bytes read from the
+    device.
+
+    \sa sendBinary()
+*/
+
+/*!
+    \fn void QtTelnet::statusReceived()
+
+    This signal is emitted when the server has reported the option state
+    it believes is in effect, usually in reply to requestStatus().
+
+    \sa isPeerOptionEnabled(), reconcileStatus()
+*/
+
+/*!
+    \class QtTelnetOptionHandler
+    \brief The QtTelnetOptionHandler class handles a Telnet option for
+    QtTelnet sessions.
+
+    Subclass it and set it with QtTelnet::setOptionHandler() to
+    implement an option QtTelnet does not support, or to replace the
+    built-in handling of one it does. QtTelnet calls the handler from
+    its parser, in the thread the session lives in.
+
+    The default implementation refuses the option and ignores its
+    suboptions.
+*/
+
+/*!
+    Destroys the handler. It must not be set for any session anymore.
+*/
+QtTelnetOptionHandler::~QtTelnetOptionHandler()
+{
+}
+
+/*!
+    Returns true if \a telnet may enable \a option on the given
+    \a side at the other side's request, i.e. agree to a DO for the
+    local side or a WILL for the remote side. The answer is sent by
+    QtTelnet.
+
+    The default implementation returns false.
+*/
+bool QtTelnetOptionHandler::allowOption(QtTelnet *telnet, int option,
+                                        QtTelnet::OptionSide side)
+{
+    Q_UNUSED(telnet);
+    Q_UNUSED(option);
+    Q_UNUSED(side);
+    return false;
+}
+
+/*!
+    Called when \a option has been \a enabled or disabled on the given
+    \a side of \a telnet.
+
+    The default implementation does nothing.
+*/
+void QtTelnetOptionHandler::optionChanged(QtTelnet *telnet, int option,
+                                          QtTelnet::OptionSide side,
+                                          bool enabled)
+{
+    Q_UNUSED(telnet);
+    Q_UNUSED(option);
+    Q_UNUSED(side);
+    Q_UNUSED(enabled);
+}
+
+/*!
+    Called when \a telnet has received a suboption of \a option. \a data
+    is what came between IAC SB \e option and IAC SE, with IAC bytes
+    unescaped.
+
+    The default implementation does nothing.
+
+    \sa QtTelnet::sendSubOption()
+*/
+void QtTelnetOptionHandler::subOption(QtTelnet *telnet, int option,
+                                      const QByteArray &data)
+{
+    Q_UNUSED(telnet);
+    Q_UNUSED(option);
+    Q_UNUSED(data);
+}
+
+/*!
+    \class QtTelnetAuthenticator
+    \brief The QtTelnetAuthenticator class is the base of the
+    authentication mechanisms of the Telnet AUTHENTICATION option.
+
+    A subclass implements one mechanism, identified by its type and
+    modifiers as assigned by IANA, and is added to a session with
+    QtTelnet::addAuthenticator(). When the server asks for the
+    mechanism, start() is called; each REPLY the server sends for it
+    is passed to receive(). The authenticator answers with send() and
+    ends with setSucceeded() or setFailed().
+
+    The steps are asynchronous: start() and receive() may return
+    before their answer is ready, e.g. while a key is computed on a
+    worker thread, and the parser carries on with the rest of the
+    data. The answer must then be sent later from the thread the
+    session lives in, typically from a slot connected to the worker
+    with a queued connection. The receiver of such queued calls must
+    be the authenticator itself or one of its children: without an
+    event loop, QtTelnet::waitForLoggedIn() and the other waiting
+    functions deliver the queued calls posted to those objects, and
+    only to those.
+
+    \sa QtTelnetSraAuthenticator
+*/
+
+/*!
+    \enum QtTelnetAuthenticator::State
+
+    \value Idle The server has not asked for this mechanism.
+    \value InProgress The mechanism is being negotiated.
+    \value Succeeded The server has accepted the authentication.
+    \value Failed The server has rejected the authentication.
+*/
+
+/*!
+    Constructs an authenticator for the mechanism with the given
+    \a type and \a modifiers, e.g. 6 and 0 for SRA one-way client to
+    server authentication. \a parent is passed to the QObject
+    constructor.
+*/
+QtTelnetAuthenticator::QtTelnetAuthenticator(int type, int modifiers,
+                                             QObject *parent)
+    : QObject(parent), d(new QtTelnetAuthenticatorPrivate(type, modifiers))
+{
+}
+
+/*!
+    Destroys the authenticator.
+*/
+QtTelnetAuthenticator::~QtTelnetAuthenticator()
+{
+    delete d;
+}
+
+/*!
+    Returns the authentication type of the mechanism.
+*/
+int QtTelnetAuthenticator::type() const
+{
+    return d->type;
+}
+
+/*!
+    Returns the modifiers of the mechanism, i.e. who authenticates and
+    how.
+*/
+int QtTelnetAuthenticator::modifiers() const
+{
+    return d->modifiers;
+}
+
+/*!
+    Returns the state of the authentication in the current connection.
+*/
+QtTelnetAuthenticator::State QtTelnetAuthenticator::state() const
+{
+    return d->state;
+}
+
+/*!
+    Returns the session the authenticator has been added to, or 0.
+*/
+QtTelnet *QtTelnetAuthenticator::telnet() const
+{
+    return d->telnet;
+}
+
+/*!
+    Called when the server has asked for this mechanism. The default
+    implementation sends an empty IS.
+*/
+void QtTelnetAuthenticator::start()
+{
+    send(QByteArray());
+}
+
+/*!
+    \fn void QtTelnetAuthenticator::receive(const QByteArray &data)
+
+    Called for every REPLY the server sends for this mechanism, with
+    the \a data that follows the type and modifiers.
+*/
+
+/*!
+    Called when QtTelnet::login() has been called during the
+    authentication, e.g. in answer to QtTelnet::loginRequired(). The
+    default implementation does nothing.
+
+    \sa userName(), password()
+*/
+void QtTelnetAuthenticator::credentialsChanged()
+{
+}
+
+/*!
+    Called when the connection has been closed during or after the
+    authentication, so that the authenticator can be used again in
+    the next connection. Reimplementations should abandon any
+    asynchronous step in progress and call the base implementation.
+*/
+void QtTelnetAuthenticator::reset()
+{
+    d->state = Idle;
+}
+
+/*!
+    Sends \a data to the server in an IS for this mechanism. Nothing is
+    sent unless the authentication is in progress.
+*/
+void QtTelnetAuthenticator::send(const QByteArray &data)
+{
+    if (!d->telnet || d->state != InProgress)
+        return;
+    QByteArray a;
+    a.reserve(data.size() + 8);
+    a.append(Common::IAC);
+    a.append(Common::SB);
+    a.append(Common::Authentication);
+    a.append(Common::IS);
+    a.append(char(d->type));
+    a.append(char(d->modifiers));
+    qtTelnetAppendEscapedIAC(a, data.constData(), data.size());
+    a.append(Common::IAC);
+    a.append(Common::SE);
+    d->telnet->d->sendCommand(a);
+}
+
+/*!
+    Ends the authentication successfully.
+
+    \sa setFailed()
+*/
+void QtTelnetAuthenticator::setSucceeded()
+{
+    if (!d->telnet || d->state != InProgress)
+        return;
+    d->state = Succeeded;
+    d->telnet->d->authFinished(this);
+}
+
+/*!
+    Ends the authentication with a failure. QtTelnet emits
+    QtTelnet::loginFailed().
+
+    \sa setSucceeded()
+*/
+void QtTelnetAuthenticator::setFailed()
+{
+    if (!d->telnet || d->state != InProgress)
+        return;
+    d->state = Failed;
+    d->telnet->d->authFinished(this);
+}
+
+/*!
+    Returns the user name passed to QtTelnet::login().
+*/
+QString QtTelnetAuthenticator::userName() const
+{
+    return d->telnet ? d->telnet->d->login : QString();
+}
+
+/*!
+    Returns the password passed to QtTelnet::login().
+*/
+QString QtTelnetAuthenticator::password() const
+{
+    return d->telnet ? d->telnet->d->pass : QString();
+}
+
 #include "qttelnet.moc"
 
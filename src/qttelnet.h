@@ -47,34 +47,37 @@
 #ifndef QTTELNET_H
 #define QTTELNET_H
 
+#include "qttelnetglobal.h"
 #include <QtCore/QObject>
 #include <QtCore/QString>
 #include <QtCore/QSize>
+#include <QtCore/QMap>
+#include <QtCore/QStringList>
 #include <QtCore/QRegExp>
+#if QT_VERSION >= 0x050000
+#  include <QtCore/QRegularExpression>
+#endif
 #include <QtNetwork/QTcpSocket>
 
-class QtTelnetPrivate;
-
-#if defined(Q_WS_WIN)
-#  if !defined(QT_QTTELNET_EXPORT) && !defined(QT_QTTELNET_IMPORT)
-#    define QT_QTTELNET_EXPORT
-#  elif defined(QT_QTTELNET_IMPORT)
-#    if defined(QT_QTTELNET_EXPORT)
-#      undef QT_QTTELNET_EXPORT
-#    endif
-#    define QT_QTTELNET_EXPORT __declspec(dllimport)
-#  elif defined(QT_QTTELNET_EXPORT)
-#    undef QT_QTTELNET_EXPORT
-#    define QT_QTTELNET_EXPORT __declspec(dllexport)
-#  endif
+#if (QT_VERSION >= 0x050000 && defined(QT_NO_SSL)) \
+    || (QT_VERSION < 0x050000 && defined(QT_NO_OPENSSL))
+#  define QTTELNET_NO_SSL
 #else
-#  define QT_QTTELNET_EXPORT
+#  include <QtNetwork/QSslConfiguration>
 #endif
 
+class QtTelnetPrivate;
+class QtTelnetTranscript;
+class QtTelnetOptionHandler;
+class QtTelnetAuthenticator;
+class QtTelnetAuthenticatorPrivate;
+class QTextCodec;
+
 class QT_QTTELNET_EXPORT QtTelnet : public QObject
 {
     Q_OBJECT
     friend class QtTelnetPrivate;
+    friend class QtTelnetAuthenticator;
 public:
     QtTelnet(QObject *parent = 0);
     ~QtTelnet();
@@ -83,9 +86,47 @@ public:
                    EraseCharacter, EraseLine, Break, EndOfFile, Suspend,
                    Abort };
 
+    enum OptionSide { LocalSide, RemoteSide };
+
+    enum TlsMode { NoTls, ImplicitTls, StartTls, StartTlsRequired };
+
+    enum OutputFlag { RawOutput = 0x0, DecodedOutput = 0x1, TeeOutput = 0x2,
+                      ThreadedOutput = 0x4 };
+    Q_DECLARE_FLAGS(OutputFlags, OutputFlag)
+
+    enum HookEvent { ConnectedEvent, LoggedInEvent, LoginFailedEvent,
+                     PromptEvent, TextEvent, ClosedEvent };
+    typedef void (*EventHook)(void *context, HookEvent event,
+                              const QString &text);
+
     void connectToHost(const QString &host, quint16 port = 23);
+    void setConnectTimeout(int msecs);
+    int connectTimeout() const;
+    void setParallelConnectEnabled(bool enable);
+    bool isParallelConnectEnabled() const;
+
+    void setAutoReconnectEnabled(bool enable);
+    bool isAutoReconnectEnabled() const;
+    void setReconnectBackoff(int initialMsecs, int maximumMsecs);
+    static void setReconnectRateLimit(int reconnectsPerSecond);
+
+    void setTlsMode(TlsMode mode);
+    TlsMode tlsMode() const;
+    bool isEncrypted() const;
+#ifndef QTTELNET_NO_SSL
+    void setSslConfiguration(const QSslConfiguration &configuration);
+    QSslConfiguration sslConfiguration() const;
+#endif
 
+    bool isConnected() const;
+    bool isLoggedIn() const;
     void login(const QString &user, const QString &pass);
+    void addAuthenticator(QtTelnetAuthenticator *authenticator);
+    QList<QtTelnetAuthenticator *> authenticators() const;
+    void setFastLoginEnabled(bool enable);
+    bool isFastLoginEnabled() const;
+    void setFastLoginTimeout(int msecs);
+    int fastLoginTimeout() const;
 
     void setWindowSize(const QSize &size);
     void setWindowSize(int width, int height); // In number of characters
@@ -96,32 +137,147 @@ public:
     QTcpSocket *socket() const;
 
     void setPromptPattern(const QRegExp &pattern);
-    void setPromptString(const QString &pattern)
-    { setPromptPattern(QRegExp(QRegExp::escape(pattern))); }
+#if QT_VERSION >= 0x050000
+    void setPromptPattern(const QRegularExpression &pattern);
+#endif
+    void setPromptString(const QString &pattern);
+
+    void setLineFramingEnabled(bool enable);
+    bool isLineFramingEnabled() const;
+    void setMaximumLineLength(int length);
+    int maximumLineLength() const;
+
+    void setTextCodec(QTextCodec *codec);
+    QTextCodec *textCodec() const;
+
+    bool isOptionEnabled(int option, OptionSide side = LocalSide) const;
+    bool hasPeerStatus() const;
+    bool isPeerOptionEnabled(int option, OptionSide side = LocalSide) const;
+    int reconcileStatus();
+
+    void setOptionHandler(int option, QtTelnetOptionHandler *handler);
+    QtTelnetOptionHandler *optionHandler(int option) const;
+    void sendSubOption(int option, const QByteArray &data);
+
+    void setTerminalTypes(const QStringList &types);
+    QStringList terminalTypes() const;
+    void setEnvironment(const QMap<QString, QString> &environment);
+    QMap<QString, QString> environment() const;
+    void setEnvironmentVariable(const QString &name, const QString &value);
+
+    void setBinaryMode(bool enable);
+    bool isBinaryMode() const;
+    void setBinarySink(QIODevice *device);
+    QIODevice *binarySink() const;
+    void sendBinary(QIODevice *device);
+    void sendBinary(const QByteArray &data);
+
+    void setOutputDevice(QIODevice *device, OutputFlags flags = RawOutput);
+    QIODevice *outputDevice() const;
+    void setTranscript(QtTelnetTranscript *transcript);
+    QtTelnetTranscript *transcript() const;
+
+    bool waitForConnected(int msecs = 30000);
+    bool waitForLoggedIn(int msecs = 30000);
+    bool waitForPrompt(int msecs = 30000);
+    QString execute(const QString &command, int msecs = 30000, bool *ok = 0);
+
+    void setEventHook(EventHook hook, void *context, bool text = false);
 public Q_SLOTS:
     void close();
     void logout();
     void sendControl(Control ctrl);
     void sendData(const QString &data);
     void sendSync();
+    void flushPartialLine();
+    void requestStatus();
 
 Q_SIGNALS:
+    void connected();
+    void encrypted();
     void loginRequired();
     void loginFailed();
     void loggedIn();
     void loggedOut();
     void connectionError(QAbstractSocket::SocketError error);
+    void reconnecting(int attempt, int delay);
+    void reconnected();
     void message(const QString &data);
+    void lineReceived(const QByteArray &line);
+    void promptReceived();
+    void statusReceived();
+    void binaryDataSent(qint64 bytes);
 
 public:
     void setLoginPattern(const QRegExp &pattern);
-    void setLoginString(const QString &pattern)
-    { setLoginPattern(QRegExp(QRegExp::escape(pattern))); }
+#if QT_VERSION >= 0x050000
+    void setLoginPattern(const QRegularExpression &pattern);
+#endif
+    void setLoginString(const QString &pattern);
     void setPasswordPattern(const QRegExp &pattern);
-    void setPasswordString(const QString &pattern)
-    { setPasswordPattern(QRegExp(QRegExp::escape(pattern))); }
+#if QT_VERSION >= 0x050000
+    void setPasswordPattern(const QRegularExpression &pattern);
+#endif
+    void setPasswordString(const QString &pattern);
+
+protected:
+#if QT_VERSION >= 0x050000
+    void connectNotify(const QMetaMethod &signal);
+    void disconnectNotify(const QMetaMethod &signal);
+#else
+    void connectNotify(const char *signal);
+    void disconnectNotify(const char *signal);
+#endif
 
 private:
     QtTelnetPrivate *d;
 };
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(QtTelnet::OutputFlags)
+
+class QT_QTTELNET_EXPORT QtTelnetOptionHandler
+{
+public:
+    virtual ~QtTelnetOptionHandler();
+
+    virtual bool allowOption(QtTelnet *telnet, int option,
+                             QtTelnet::OptionSide side);
+    virtual void optionChanged(QtTelnet *telnet, int option,
+                               QtTelnet::OptionSide side, bool enabled);
+    virtual void subOption(QtTelnet *telnet, int option,
+                           const QByteArray &data);
+};
+
+class QT_QTTELNET_EXPORT QtTelnetAuthenticator : public QObject
+{
+    Q_OBJECT
+    friend class QtTelnet;
+    friend class QtTelnetPrivate;
+public:
+    enum State { Idle, InProgress, Succeeded, Failed };
+
+    QtTelnetAuthenticator(int type, int modifiers, QObject *parent = 0);
+    ~QtTelnetAuthenticator();
+
+    int type() const;
+    int modifiers() const;
+    State state() const;
+    QtTelnet *telnet() const;
+
+protected:
+    virtual void start();
+    virtual void receive(const QByteArray &data) = 0;
+    virtual void credentialsChanged();
+    virtual void reset();
+
+    void send(const QByteArray &data);
+    void setSucceeded();
+    void setFailed();
+    QString userName() const;
+    QString password() const;
+
+private:
+    QtTelnetAuthenticatorPrivate *d;
+};
+
 #endif
@@ -5,9 +5,23 @@ DEPENDPATH += $$PWD
 qttelnet-uselib:!qttelnet-buildlib {
     LIBS += -L$$QTTELNET_LIBDIR -l$$QTTELNET_LIBNAME
 } else {
-    SOURCES += $$PWD/qttelnet.cpp
-    HEADERS += $$PWD/qttelnet.h
-    win32:LIBS += -lWs2_32
+    SOURCES += $$PWD/qttelnet.cpp \
+               $$PWD/qttelnettranscript.cpp \
+               $$PWD/qttelnetserver.cpp \
+               $$PWD/qttelnetbroadcast.cpp \
+               $$PWD/qttelnetsraauthenticator.cpp \
+               $$PWD/qttelnettrace.cpp
+    HEADERS += $$PWD/qttelnetglobal.h \
+               $$PWD/qttelnet.h \
+               $$PWD/qttelnettranscript.h \
+               $$PWD/qttelnetserver.h \
+               $$PWD/qttelnetbroadcast.h \
+               $$PWD/qttelnetsraauthenticator.h \
+               $$PWD/qttelnettrace.h \
+               $$PWD/qttelnetcoro.h \
+               $$PWD/qttelnetcore.h \
+               $$PWD/qttelnet_p.h
+    win32:LIBS += -lWs2_32 -lAdvapi32
 }
 QT += network
 
@@ -0,0 +1,286 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+#ifndef QTTELNET_P_H
+#define QTTELNET_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QtTelnet API. It is shared by the
+// client and server implementations and may change from version to
+// version without notice, or even be removed.
+//
+
+#include <QtCore/QByteArray>
+#include <string.h>
+#include <stdlib.h>
+
+namespace Common // RFC854
+{
+    // Commands
+    const uchar CEOF  = 236;
+    const uchar SUSP  = 237;
+    const uchar ABORT = 238;
+    const uchar SE    = 240;
+    const uchar NOP   = 241;
+    const uchar DM    = 242;
+    const uchar BRK   = 243;
+    const uchar IP    = 244;
+    const uchar AO    = 245;
+    const uchar AYT   = 246;
+    const uchar EC    = 247;
+    const uchar EL    = 248;
+    const uchar GA    = 249;
+    const uchar SB    = 250;
+    const uchar WILL  = 251;
+    const uchar WONT  = 252;
+    const uchar DO    = 253;
+    const uchar DONT  = 254;
+    const uchar IAC   = 255;
+
+    // Types
+    const char IS    = 0;
+    const char SEND  = 1;
+    const char INFO  = 2;
+
+    const char Binary = 0; // RFC856, implemented
+    const char Authentication = 37; // RFC1416,
+                                    // implemented to always return NULL
+    const char SuppressGoAhead = 3; // RFC858
+    const char Echo = 1; // RFC857, implemented by QtTelnetServer
+    const char LineMode = 34; // RFC1184, implemented
+    const uchar LineModeEOF = 236, // RFC1184, implemented
+                LineModeSUSP = 237,
+                LineModeABORT = 238;
+    const char Status = 5; // RFC859, implemented
+    const char Logout = 18; // RFC727, implemented
+    const char TerminalType = 24; // RFC1091, implemented
+    const char TimingMark = 6; // RFC860, used to flush output
+    const char NAWS = 31; // RFC1073, implemented
+    const char TerminalSpeed = 32; // RFC1079, not implemented
+    const char FlowControl = 33; // RFC1372, should be implemented?
+    const char XDisplayLocation = 35; // RFC1096, not implemented
+    const char EnvironmentOld = 36; // RFC1408, should not be implemented!
+    const char Environment = 39; // RFC1572, implemented
+    const char Encrypt = 38; // RFC2946, not implemented
+    const char StartTLS = 46; // draft-altman-telnet-starttls, implemented
+    const char TLSFollows = 1;
+};
+
+/*
+  A set of Telnet options, one bit per option number. Used instead of
+  a map so that the option state of a session is a fixed 32 bytes that
+  never needs to be allocated.
+*/
+class QtTelnetOptionSet
+{
+public:
+    QtTelnetOptionSet() { clear(); }
+
+    bool value(uchar option) const
+    { return (bits[option >> 5] >> (option & 31)) & 1; }
+    void setValue(uchar option, bool enabled)
+    {
+        if (enabled)
+            bits[option >> 5] |= (1u << (option & 31));
+        else
+            bits[option >> 5] &= ~(1u << (option & 31));
+    }
+    void clear() { memset(bits, 0, sizeof(bits)); }
+
+private:
+    quint32 bits[8];
+};
+
+/*
+  A bump allocator for the temporaries of one read cycle: the bytes
+  read from the socket and the parser state that refers to them. Each
+  thread has one arena, shared by all its sessions, which is reset
+  when the outermost read cycle ends. Reads that do not fit are served
+  from separate blocks, and the arena grows to cover them at the next
+  reset, so that a steady stream of reads allocates nothing.
+*/
+class QtTelnetArena
+{
+public:
+    QtTelnetArena() : block(0), capacity(0), used(0), overflow(0),
+                      overflowsize(0), depth(0) {}
+    ~QtTelnetArena()
+    {
+        releaseOverflow();
+        ::free(block);
+    }
+
+    void begin() { ++depth; }
+    void end()
+    {
+        if (--depth == 0)
+            reset();
+    }
+    char *allocate(int size);
+
+private:
+    struct Overflow { Overflow *next; };
+
+    void reset();
+    void releaseOverflow();
+
+    char *block;
+    int capacity, used;
+    Overflow *overflow;
+    int overflowsize;
+    int depth;
+};
+
+QtTelnetArena *qtTelnetReadArena();
+
+/*
+  Appends \a length bytes at \a data to \a out, doubling every IAC.
+  Runs of bytes without an IAC are copied in one go.
+*/
+inline void qtTelnetAppendEscapedIAC(QByteArray &out, const char *data,
+                                     int length)
+{
+    const char *end = data + length;
+    while (data < end) {
+        const char *iac = static_cast<const char *>(
+            memchr(data, Common::IAC, end - data));
+        if (!iac) {
+            out.append(data, end - data);
+            return;
+        }
+        out.append(data, iac - data + 1);
+        out.append(char(Common::IAC));
+        data = iac + 1;
+    }
+}
+
+/*
+  Reverses qtTelnetAppendEscapedIAC().
+*/
+inline QByteArray qtTelnetUnescapeIAC(const QByteArray &data)
+{
+    if (data.indexOf(char(Common::IAC)) == -1)
+        return data;
+    QByteArray a;
+    a.reserve(data.size());
+    for (int i = 0; i < data.size(); ++i) {
+        a.append(data.at(i));
+        if (uchar(data.at(i)) == Common::IAC && i + 1 < data.size()
+            && uchar(data.at(i + 1)) == Common::IAC)
+            ++i;
+    }
+    return a;
+}
+
+/*
+  Splits \a length bytes of a Telnet data stream at \a data into data,
+  commands, option negotiations and suboptions, and passes them to
+  \a handler, which must provide:
+
+  \list
+  \i telnetData(const char *data, int length): a run of data bytes;
+     an escaped IAC is passed on its own as a single 255 byte.
+  \i telnetCommand(uchar command): a two byte command such as IAC GA.
+  \i telnetOption(uchar operation, uchar option): WILL, WONT, DO or
+     DONT.
+  \i telnetSubOption(const char *data, int length): the contents of an
+     IAC SB ... IAC SE sequence, still escaped.
+  \endlist
+
+  Returns the number of bytes consumed; the rest is the beginning of a
+  command that has not been received completely.
+*/
+template <typename Handler>
+int qtTelnetScan(Handler *handler, const char *data, int length)
+{
+    int pos = 0;
+    while (pos < length) {
+        if (uchar(data[pos]) != Common::IAC) {
+            const char *iac = static_cast<const char *>(
+                memchr(data + pos, Common::IAC, length - pos));
+            const int end = iac ? int(iac - data) : length;
+            handler->telnetData(data + pos, end - pos);
+            pos = end;
+            continue;
+        }
+        if (pos + 1 >= length)
+            break;
+        const uchar command = uchar(data[pos + 1]);
+        if (command == Common::IAC) { // Data 255
+            handler->telnetData(data + pos, 1);
+            pos += 2;
+        } else if (command >= Common::WILL && command <= Common::DONT) {
+            if (pos + 2 >= length)
+                break;
+            handler->telnetOption(command, uchar(data[pos + 2]));
+            pos += 3;
+        } else if (command == Common::SB) {
+            int end = pos + 2;
+            while (end + 1 < length) {
+                if (uchar(data[end]) == Common::IAC) {
+                    if (uchar(data[end + 1]) == Common::SE)
+                        break;
+                    if (uchar(data[end + 1]) == Common::IAC)
+                        ++end; // Escaped 255 data byte
+                }
+                ++end;
+            }
+            if (end + 1 >= length)
+                break; // Wait for IAC SE
+            handler->telnetSubOption(data + pos + 2, end - pos - 2);
+            pos = end + 2;
+        } else {
+            handler->telnetCommand(command);
+            pos += 2;
+        }
+    }
+    return pos;
+}
+
+#endif
@@ -0,0 +1,733 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+
+/*!
+    \class QtTelnetBroadcast
+    \brief The QtTelnetBroadcast class runs the same commands on many
+    Telnet servers.
+
+    Set the servers with setHosts() and the commands with
+    setCommands(), then call start(). Each server is connected to and
+    logged in to with the credentials given to setLogin(), and the
+    commands are sent one at a time; a command is complete when the
+    prompt is seen again (see setPromptPattern()). The output of the
+    commands is collected and reported with hostFinished() as soon as
+    a server is done. finished() is emitted when all servers are done;
+    results() and resultCount() summarize the run.
+
+    At most concurrency() servers are worked on at a time, each within
+    timeout() milliseconds. The sessions run in threadCount() worker
+    threads, and all the work for a server is done by the same thread.
+    If keepSessions() is true, the sessions of servers that succeeded
+    stay logged in after a run, and the next run reuses them instead
+    of connecting and logging in again.
+*/
+
+#include "qttelnetbroadcast.h"
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMultiHash>
+
+struct QtTelnetBroadcastSettings
+{
+    QtTelnetBroadcastSettings()
+        : prompt(QLatin1String("[$#>]\\s*$")), timeout(30000), keep(false)
+    {}
+
+    QStringList commands;
+    QString username, password;
+    QRegExp prompt;
+    QString promptstring;
+    int timeout;
+    bool keep;
+};
+
+class QtTelnetBroadcastJob;
+
+/*
+  Returns the key of the pooled sessions for \a host and \a port. It
+  includes the user name, so that a session logged in as one user is
+  never reused for another.
+*/
+static QString poolKey(const QtTelnetBroadcastSettings *settings,
+                       const QString &host, int port)
+{
+    return settings->username + QLatin1Char('@') + host + QLatin1Char(':')
+        + QString::number(port);
+}
+
+/*
+  Lives in a worker thread and runs the jobs routed to it, keeping
+  the sessions that are to be reused.
+*/
+class QtTelnetBroadcastWorker : public QObject
+{
+    Q_OBJECT
+public:
+    QtTelnetBroadcastWorker(const QtTelnetBroadcastSettings *settings)
+        : settings(settings) {}
+
+    void jobFinished(QtTelnetBroadcastJob *job, QtTelnet *telnet,
+                     const QString &key, int index,
+                     const QtTelnetBroadcast::Result &result);
+
+    const QtTelnetBroadcastSettings *settings;
+
+public slots:
+    void run(int index, const QString &host, int port);
+    void abortAll();
+
+signals:
+    void done(int index, const QtTelnetBroadcast::Result &result);
+
+private slots:
+    void pooledSessionClosed();
+
+private:
+    QMultiHash<QString, QtTelnet *> pool;
+    QList<QtTelnetBroadcastJob *> jobs;
+};
+
+/*
+  Works on one server: connects or takes a pooled session, logs in,
+  sends the commands one prompt at a time and collects the output.
+*/
+class QtTelnetBroadcastJob : public QObject
+{
+    Q_OBJECT
+public:
+    QtTelnetBroadcastJob(QtTelnetBroadcastWorker *worker, int index,
+                         const QString &host, int port, QtTelnet *pooled);
+
+    void start();
+    void finish(QtTelnetBroadcast::Status status);
+
+private slots:
+    void loggedIn();
+    void loginRequired();
+    void promptReceived();
+    void message(const QString &text);
+    void lost();
+    void timedOut();
+
+private:
+    void sendNext();
+
+    QtTelnetBroadcastWorker *worker;
+    const QtTelnetBroadcastSettings *settings;
+    QtTelnet *telnet;
+    int index;
+    QString key;
+    QtTelnetBroadcast::Result result;
+    QTimer timer;
+    QElapsedTimer clock;
+    int next;
+    int loginprompts;
+};
+
+QtTelnetBroadcastJob::QtTelnetBroadcastJob(QtTelnetBroadcastWorker *w,
+                                           int i, const QString &host,
+                                           int port, QtTelnet *pooled)
+    : QObject(w), worker(w), settings(w->settings), telnet(pooled),
+      index(i), next(0), loginprompts(0)
+{
+    clock.start();
+    result.host = host;
+    result.port = port;
+    key = poolKey(settings, host, port);
+
+    timer.setSingleShot(true);
+    connect(&timer, SIGNAL(timeout()), this, SLOT(timedOut()));
+}
+
+void QtTelnetBroadcastJob::start()
+{
+    if (settings->timeout > 0)
+        timer.start(settings->timeout);
+    const bool fresh = !telnet;
+    if (fresh)
+        telnet = new QtTelnet(worker);
+    // A pooled session was set up by an earlier run, whose settings
+    // may have changed since
+    if (!settings->promptstring.isEmpty())
+        telnet->setPromptString(settings->promptstring);
+    else
+        telnet->setPromptPattern(settings->prompt);
+    if (fresh && !settings->username.isEmpty())
+        telnet->login(settings->username, settings->password);
+    connect(telnet, SIGNAL(loggedIn()), this, SLOT(loggedIn()));
+    connect(telnet, SIGNAL(loginRequired()), this, SLOT(loginRequired()));
+    connect(telnet, SIGNAL(promptReceived()), this, SLOT(promptReceived()));
+    connect(telnet, SIGNAL(message(QString)), this, SLOT(message(QString)));
+    connect(telnet, SIGNAL(loggedOut()), this, SLOT(lost()));
+    connect(telnet, SIGNAL(connectionError(QAbstractSocket::SocketError)),
+            this, SLOT(lost()));
+    if (fresh)
+        telnet->connectToHost(result.host, result.port);
+    else
+        sendNext();
+}
+
+void QtTelnetBroadcastJob::loggedIn()
+{
+    if (next == 0)
+        sendNext();
+}
+
+/*
+  The server asks for a login. The first request is answered with
+  the credentials; another one means they were rejected.
+*/
+void QtTelnetBroadcastJob::loginRequired()
+{
+    if (settings->username.isEmpty() || ++loginprompts > 1)
+        finish(QtTelnetBroadcast::LoginFailed);
+}
+
+void QtTelnetBroadcastJob::promptReceived()
+{
+    if (next > 0)
+        sendNext();
+}
+
+void QtTelnetBroadcastJob::message(const QString &text)
+{
+    if (next > 0)
+        result.output += text;
+}
+
+/*
+  The connection was lost or could not be made. A server that closes
+  the connection in response to the last command has succeeded.
+*/
+void QtTelnetBroadcastJob::lost()
+{
+    if (next > 0 && next == settings->commands.size())
+        finish(QtTelnetBroadcast::Succeeded);
+    else
+        finish(QtTelnetBroadcast::ConnectionFailed);
+}
+
+void QtTelnetBroadcastJob::timedOut()
+{
+    finish(QtTelnetBroadcast::TimedOut);
+}
+
+void QtTelnetBroadcastJob::sendNext()
+{
+    if (next == settings->commands.size()) {
+        finish(QtTelnetBroadcast::Succeeded);
+        return;
+    }
+    telnet->sendData(settings->commands.at(next++) + QLatin1String("\r\n"));
+}
+
+void QtTelnetBroadcastJob::finish(QtTelnetBroadcast::Status status)
+{
+    if (!telnet)
+        return;
+    timer.stop();
+    telnet->disconnect(this);
+    result.status = status;
+    result.elapsed = int(clock.elapsed());
+    QtTelnet *session = telnet;
+    telnet = 0;
+    worker->jobFinished(this, session, key, index, result);
+}
+
+void QtTelnetBroadcastWorker::run(int index, const QString &host, int port)
+{
+    const QString key = poolKey(settings, host, port);
+    QtTelnet *telnet = 0;
+    while (!telnet && pool.contains(key)) {
+        QtTelnet *pooled = pool.take(key);
+        pooled->disconnect(this);
+        if (pooled->socket()->state() == QAbstractSocket::ConnectedState)
+            telnet = pooled;
+        else
+            pooled->deleteLater();
+    }
+    QtTelnetBroadcastJob *job =
+        new QtTelnetBroadcastJob(this, index, host, port, telnet);
+    jobs.append(job);
+    job->start();
+}
+
+void QtTelnetBroadcastWorker::abortAll()
+{
+    const QList<QtTelnetBroadcastJob *> running = jobs;
+    for (int i = 0; i < running.size(); ++i)
+        running.at(i)->finish(QtTelnetBroadcast::Aborted);
+}
+
+void QtTelnetBroadcastWorker::jobFinished(QtTelnetBroadcastJob *job,
+                                          QtTelnet *telnet,
+                                          const QString &key, int index,
+                                          const QtTelnetBroadcast::Result
+                                          &result)
+{
+    jobs.removeAll(job);
+    job->deleteLater();
+    if (result.status == QtTelnetBroadcast::Succeeded && settings->keep
+        && telnet->socket()->state() == QAbstractSocket::ConnectedState) {
+        pool.insert(key, telnet);
+        connect(telnet, SIGNAL(loggedOut()),
+                this, SLOT(pooledSessionClosed()));
+    } else {
+        telnet->close();
+        telnet->deleteLater();
+    }
+    emit done(index, result);
+}
+
+void QtTelnetBroadcastWorker::pooledSessionClosed()
+{
+    QtTelnet *telnet = static_cast<QtTelnet *>(sender());
+    QMultiHash<QString, QtTelnet *>::iterator it = pool.begin();
+    while (it != pool.end()) {
+        if (it.value() == telnet)
+            it = pool.erase(it);
+        else
+            ++it;
+    }
+    telnet->deleteLater();
+}
+
+class QtTelnetBroadcastPrivate : public QObject
+{
+    Q_OBJECT
+public:
+    QtTelnetBroadcastPrivate(QtTelnetBroadcast *parent);
+    ~QtTelnetBroadcastPrivate();
+
+    void startThreads();
+    void stopThreads();
+    void dispatch();
+
+    QtTelnetBroadcast *q;
+    QtTelnetBroadcastSettings settings;
+    QtTelnetBroadcastSettings active; // Read by the workers during a run
+    QStringList hosts;
+    quint16 port;
+    int concurrency;
+    int threadcount;
+    QList<QThread *> threads;
+    QList<QtTelnetBroadcastWorker *> workers;
+    bool running;
+    int nexthost;
+    int inflight;
+    QList<QtTelnetBroadcast::Result> results;
+
+public slots:
+    void jobDone(int index, const QtTelnetBroadcast::Result &result);
+};
+
+QtTelnetBroadcastPrivate::QtTelnetBroadcastPrivate(QtTelnetBroadcast *parent)
+    : q(parent), port(23), concurrency(16),
+      threadcount(qMax(1, QThread::idealThreadCount())), running(false),
+      nexthost(0), inflight(0)
+{
+    qRegisterMetaType<QtTelnetBroadcast::Result>("QtTelnetBroadcast::Result");
+}
+
+QtTelnetBroadcastPrivate::~QtTelnetBroadcastPrivate()
+{
+    stopThreads();
+}
+
+void QtTelnetBroadcastPrivate::startThreads()
+{
+    if (threads.size() == threadcount)
+        return;
+    stopThreads();
+    for (int i = 0; i < threadcount; ++i) {
+        QThread *thread = new QThread;
+        QtTelnetBroadcastWorker *worker = new QtTelnetBroadcastWorker(&active);
+        worker->moveToThread(thread);
+        connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+        connect(worker, SIGNAL(done(int,QtTelnetBroadcast::Result)),
+                this, SLOT(jobDone(int,QtTelnetBroadcast::Result)));
+        thread->start();
+        threads.append(thread);
+        workers.append(worker);
+    }
+}
+
+/*
+  Stops the worker threads, which deletes the workers along with
+  their pooled sessions.
+*/
+void QtTelnetBroadcastPrivate::stopThreads()
+{
+    for (int i = 0; i < threads.size(); ++i) {
+        threads.at(i)->quit();
+        threads.at(i)->wait();
+        delete threads.at(i);
+    }
+    threads.clear();
+    workers.clear();
+}
+
+/*
+  Starts work on servers until the concurrency limit is reached. A
+  server is always handled by the same worker, so that its pooled
+  session is found again.
+*/
+void QtTelnetBroadcastPrivate::dispatch()
+{
+    while (inflight < concurrency && nexthost < results.size()) {
+        const QtTelnetBroadcast::Result &r = results.at(nexthost);
+        const QString key = r.host + QLatin1Char(':')
+                            + QString::number(r.port);
+        QtTelnetBroadcastWorker *worker =
+            workers.at(qHash(key) % uint(workers.size()));
+        QMetaObject::invokeMethod(worker, "run", Qt::QueuedConnection,
+                                  Q_ARG(int, nexthost),
+                                  Q_ARG(QString, r.host),
+                                  Q_ARG(int, r.port));
+        ++nexthost;
+        ++inflight;
+    }
+    if (inflight == 0 && running) {
+        running = false;
+        emit q->finished();
+    }
+}
+
+void QtTelnetBroadcastPrivate::jobDone(int index,
+                                       const QtTelnetBroadcast::Result &result)
+{
+    results[index] = result;
+    --inflight;
+    emit q->hostFinished(result);
+    dispatch();
+}
+
+/*!
+    Constructs a broadcast with the given \a parent.
+*/
+QtTelnetBroadcast::QtTelnetBroadcast(QObject *parent)
+    : QObject(parent), d(new QtTelnetBroadcastPrivate(this))
+{
+}
+
+/*!
+    Destroys the broadcast, aborting a run in progress and closing the
+    pooled sessions.
+*/
+QtTelnetBroadcast::~QtTelnetBroadcast()
+{
+    delete d;
+}
+
+/*!
+    Sets the servers to run the commands on to \a hosts. Each entry is
+    a host name or address, optionally followed by a colon and a port;
+    otherwise port() is used.
+*/
+void QtTelnetBroadcast::setHosts(const QStringList &hosts)
+{
+    d->hosts = hosts;
+}
+
+/*!
+    Returns the servers to run the commands on.
+*/
+QStringList QtTelnetBroadcast::hosts() const
+{
+    return d->hosts;
+}
+
+/*!
+    Sets the port used for servers that do not specify one to
+    \a port. The default is 23.
+*/
+void QtTelnetBroadcast::setPort(quint16 port)
+{
+    d->port = port;
+}
+
+/*!
+    Returns the port used for servers that do not specify one.
+*/
+quint16 QtTelnetBroadcast::port() const
+{
+    return d->port;
+}
+
+/*!
+    Sets the commands to run on each server to \a commands. Each
+    command is sent as a line once the previous one has been answered
+    with a prompt.
+*/
+void QtTelnetBroadcast::setCommands(const QStringList &commands)
+{
+    d->settings.commands = commands;
+}
+
+/*!
+    Returns the commands to run on each server.
+*/
+QStringList QtTelnetBroadcast::commands() const
+{
+    return d->settings.commands;
+}
+
+/*!
+    Sets the \a username and \a password to log in with. If no
+    username is set, a server that asks for one fails with
+    LoginFailed.
+
+    \sa QtTelnet::login()
+*/
+void QtTelnetBroadcast::setLogin(const QString &username,
+                                 const QString &password)
+{
+    d->settings.username = username;
+    d->settings.password = password;
+}
+
+/*!
+    Sets the prompt pattern of the servers to \a pattern. The default
+    matches text ending with $, # or >.
+
+    \sa QtTelnet::setPromptPattern()
+*/
+void QtTelnetBroadcast::setPromptPattern(const QRegExp &pattern)
+{
+    d->settings.prompt = pattern;
+    d->settings.promptstring.clear();
+}
+
+/*!
+    Sets the prompt of the servers to the literal string \a pattern.
+
+    \sa QtTelnet::setPromptString()
+*/
+void QtTelnetBroadcast::setPromptString(const QString &pattern)
+{
+    d->settings.promptstring = pattern;
+}
+
+/*!
+    Sets the maximum number of servers worked on at the same time to
+    \a count. The default is 16.
+*/
+void QtTelnetBroadcast::setConcurrency(int count)
+{
+    d->concurrency = qMax(1, count);
+}
+
+/*!
+    Returns the maximum number of servers worked on at the same time.
+*/
+int QtTelnetBroadcast::concurrency() const
+{
+    return d->concurrency;
+}
+
+/*!
+    Sets the time a server may take, from connecting to the answer to
+    the last command, to \a msecs milliseconds. A value of 0 or less
+    means that servers never time out. The default is 30 seconds.
+*/
+void QtTelnetBroadcast::setTimeout(int msecs)
+{
+    d->settings.timeout = qMax(0, msecs);
+}
+
+/*!
+    Returns the time in milliseconds a server may take.
+*/
+int QtTelnetBroadcast::timeout() const
+{
+    return d->settings.timeout;
+}
+
+/*!
+    Sets the number of worker threads to \a count. The default is
+    QThread::idealThreadCount(). Changing the number of threads closes
+    the pooled sessions at the next start().
+*/
+void QtTelnetBroadcast::setThreadCount(int count)
+{
+    d->threadcount = qMax(1, count);
+}
+
+/*!
+    Returns the number of worker threads.
+*/
+int QtTelnetBroadcast::threadCount() const
+{
+    return d->threadcount;
+}
+
+/*!
+    Keeps the sessions of servers that succeeded logged in for the
+    next run if \a keep is true. The default is false.
+*/
+void QtTelnetBroadcast::setKeepSessions(bool keep)
+{
+    d->settings.keep = keep;
+}
+
+/*!
+    Returns true if sessions are kept for the next run.
+*/
+bool QtTelnetBroadcast::keepSessions() const
+{
+    return d->settings.keep;
+}
+
+/*!
+    Returns true while a run is in progress.
+*/
+bool QtTelnetBroadcast::isRunning() const
+{
+    return d->running;
+}
+
+/*!
+    Returns the results of the last run, in the order of hosts().
+    Servers that have not been worked on yet have the status Aborted.
+*/
+QList<QtTelnetBroadcast::Result> QtTelnetBroadcast::results() const
+{
+    return d->results;
+}
+
+/*!
+    Returns the number of servers in the last run that have \a status.
+*/
+int QtTelnetBroadcast::resultCount(Status status) const
+{
+    int count = 0;
+    for (int i = 0; i < d->results.size(); ++i) {
+        if (d->results.at(i).status == status)
+            ++count;
+    }
+    return count;
+}
+
+/*!
+    Starts running the commands on the servers. Does nothing if a run
+    is already in progress. Changes to the settings made during a run
+    take effect at the next one.
+*/
+void QtTelnetBroadcast::start()
+{
+    if (d->running)
+        return;
+    d->active = d->settings;
+    d->startThreads();
+    d->results.clear();
+    for (int i = 0; i < d->hosts.size(); ++i) {
+        Result r;
+        r.host = d->hosts.at(i);
+        r.port = d->port;
+        const int colon = r.host.lastIndexOf(QLatin1Char(':'));
+        if (colon > 0 && r.host.count(QLatin1Char(':')) == 1) {
+            r.port = r.host.mid(colon + 1).toUShort();
+            r.host.truncate(colon);
+        }
+        d->results.append(r);
+    }
+    d->nexthost = 0;
+    d->running = true;
+    d->dispatch();
+}
+
+/*!
+    Aborts the run in progress. The servers being worked on finish
+    with the status Aborted, and the remaining servers are skipped.
+*/
+void QtTelnetBroadcast::abort()
+{
+    if (!d->running)
+        return;
+    d->nexthost = d->results.size();
+    for (int i = 0; i < d->workers.size(); ++i)
+        QMetaObject::invokeMethod(d->workers.at(i), "abortAll",
+                                  Qt::QueuedConnection);
+}
+
+/*!
+    \enum QtTelnetBroadcast::Status
+
+    This enum describes the outcome for a server.
+
+    \value Succeeded All commands were answered.
+    \value ConnectionFailed The connection could not be made or was
+    lost.
+    \value LoginFailed The server did not accept the login.
+    \value TimedOut The server did not finish within timeout().
+    \value Aborted The run was aborted before the server finished.
+*/
+
+/*!
+    \class QtTelnetBroadcast::Result
+    \brief The Result class holds the outcome for one server.
+
+    \a host and \a port identify the server, \a status is the outcome
+    and \a output the text received in response to the commands.
+    \a elapsed is the time taken in milliseconds.
+*/
+
+/*!
+    \fn void QtTelnetBroadcast::hostFinished(const QtTelnetBroadcast::Result &result)
+
+    This signal is emitted when a server is done, with its \a result.
+*/
+
+/*!
+    \fn void QtTelnetBroadcast::finished()
+
+    This signal is emitted when all servers are done.
+*/
+
+#include "qttelnetbroadcast.moc"
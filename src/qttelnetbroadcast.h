@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+#ifndef QTTELNETBROADCAST_H
+#define QTTELNETBROADCAST_H
+
+#include "qttelnet.h"
+#include <QtCore/QList>
+#include <QtCore/QMetaType>
+
+class QtTelnetBroadcastPrivate;
+
+class QT_QTTELNET_EXPORT QtTelnetBroadcast : public QObject
+{
+    Q_OBJECT
+public:
+    enum Status { Succeeded, ConnectionFailed, LoginFailed, TimedOut,
+                  Aborted };
+
+    struct Result
+    {
+        Result() : port(0), status(Aborted), elapsed(0) {}
+
+        QString host;
+        quint16 port;
+        Status status;
+        QString output;
+        int elapsed;
+    };
+
+    explicit QtTelnetBroadcast(QObject *parent = 0);
+    ~QtTelnetBroadcast();
+
+    void setHosts(const QStringList &hosts);
+    QStringList hosts() const;
+    void setPort(quint16 port);
+    quint16 port() const;
+    void setCommands(const QStringList &commands);
+    QStringList commands() const;
+    void setLogin(const QString &username, const QString &password);
+    void setPromptPattern(const QRegExp &pattern);
+    void setPromptString(const QString &pattern);
+
+    void setConcurrency(int count);
+    int concurrency() const;
+    void setTimeout(int msecs);
+    int timeout() const;
+    void setThreadCount(int count);
+    int threadCount() const;
+    void setKeepSessions(bool keep);
+    bool keepSessions() const;
+
+    bool isRunning() const;
+    QList<Result> results() const;
+    int resultCount(Status status) const;
+
+public Q_SLOTS:
+    void start();
+    void abort();
+
+Q_SIGNALS:
+    void hostFinished(const QtTelnetBroadcast::Result &result);
+    void finished();
+
+private:
+    friend class QtTelnetBroadcastPrivate;
+    Q_DISABLE_COPY(QtTelnetBroadcast)
+    QtTelnetBroadcastPrivate *d;
+};
+
+Q_DECLARE_METATYPE(QtTelnetBroadcast::Result)
+#endif
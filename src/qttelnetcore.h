@@ -0,0 +1,260 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+#ifndef QTTELNETCORE_H
+#define QTTELNETCORE_H
+
+#include "qttelnet_p.h"
+#include "qttelnettrace.h"
+
+/*
+  The Telnet protocol core: parses the data stream and negotiates the
+  options (RFC854, RFC1143 style loop prevention) for one connection,
+  independent of QObject and of the socket classes. It is a template
+  on two policies, so that the compiler can inline the delivery of
+  data and the writes; nothing is dispatched through virtual
+  functions or signals.
+
+  The Sink receives what the core parses and decides on the options:
+
+      void telnetData(const char *data, int length);
+      void telnetCommand(uchar command);
+      void telnetSubOption(const char *data, int length);
+      bool telnetOptionReceived(uchar operation, uchar option);
+      bool telnetAllowOption(uchar operation, uchar option);
+      void telnetOptionChanged(uchar option, bool local, bool enabled);
+
+  telnetData() and telnetSubOption() get pointers into the buffer
+  passed to receive(); the data must be copied to be kept.
+  telnetOptionReceived() sees every WILL, WONT, DO and DONT first and
+  returns false if it has handled it, otherwise the core negotiates
+  it: it asks telnetAllowOption() whether to agree, answers, and
+  reports the new state with telnetOptionChanged(). \a local is true
+  for the options we perform (DO/DONT), false for those of the peer.
+
+  The Transport sends bytes to the peer:
+
+      void telnetWrite(const char *data, int length);
+
+  QtTelnet and QtTelnetServerConnection use their private classes as
+  both policies.
+*/
+template <typename Sink, typename Transport>
+class QtTelnetCore
+{
+public:
+    QtTelnetCore(Sink *sink, Transport *transport)
+        : sink(sink), transport(transport) {}
+
+    // Parses \a length bytes received from the peer and returns the
+    // number consumed; the rest is an incomplete command to be passed
+    // again, followed by more data.
+    int receive(const char *data, int length)
+    { return qtTelnetScan(this, data, length); }
+
+    // Forgets the negotiated state, for a new connection
+    void reset()
+    {
+        modes.clear();
+        hismodes.clear();
+        for (int i = 0; i < 4; ++i)
+            sent[i].clear();
+    }
+
+    // Sends IAC \a operation \a option. A negotiation that answers one
+    // we sent ourselves is not sent again.
+    void sendOption(uchar operation, uchar option)
+    {
+        if (operation >= Common::WILL && operation <= Common::DONT) {
+            QtTelnetOptionSet &s = sent[operation - Common::WILL];
+            if (s.value(option)) {
+                s.setValue(option, false);
+                return;
+            }
+            s.setValue(option, true);
+        }
+        QTTELNET_TRACE_VALUE("option", operationName(operation, true), sink,
+                             "option", option);
+        const char command[3] = { char(Common::IAC), char(operation),
+                                  char(option) };
+        transport->telnetWrite(command, 3);
+    }
+
+    // Sends \a length bytes of data, doubling every IAC, without
+    // copying the data
+    void sendData(const char *data, int length)
+    {
+        const char *end = data + length;
+        while (data < end) {
+            const char *iac = static_cast<const char *>(
+                memchr(data, Common::IAC, end - data));
+            if (!iac) {
+                transport->telnetWrite(data, int(end - data));
+                return;
+            }
+            transport->telnetWrite(data, int(iac - data + 1));
+            transport->telnetWrite(iac, 1);
+            data = iac + 1;
+        }
+    }
+
+    // Sends the window size (RFC1073) if NAWS is enabled
+    void sendWindowSize(int width, int height)
+    {
+        if (!modes.value(Common::NAWS))
+            return;
+        static const char start[3] = { char(Common::IAC), char(Common::SB),
+                                       Common::NAWS };
+        static const char stop[2] = { char(Common::IAC), char(Common::SE) };
+        const char size[4] = { char(width >> 8), char(width),
+                               char(height >> 8), char(height) };
+        QTTELNET_TRACE_VALUE("option", "SB sent", sink, "option",
+                             Common::NAWS);
+        transport->telnetWrite(start, 3);
+        sendData(size, 4);
+        transport->telnetWrite(stop, 2);
+    }
+
+    // Records the state of \a option after \a operation, e.g. DO makes
+    // it a local option we perform if \a allowed
+    void setMode(uchar operation, uchar option, bool allowed = true)
+    {
+        bool local;
+        bool enabled;
+        if (operation == Common::WILL || operation == Common::WONT) {
+            local = false;
+            enabled = (operation == Common::WILL && allowed);
+            hismodes.setValue(option, enabled);
+        } else if (operation == Common::DO || operation == Common::DONT) {
+            local = true;
+            enabled = (operation == Common::DO && allowed);
+            modes.setValue(option, enabled);
+        } else {
+            return;
+        }
+        sink->telnetOptionChanged(option, local, enabled);
+    }
+
+    bool isEnabled(uchar option, bool local) const
+    { return local ? modes.value(option) : hismodes.value(option); }
+
+    // Called by qtTelnetScan()
+    void telnetData(const char *data, int length)
+    { sink->telnetData(data, length); }
+    void telnetCommand(uchar command)
+    { sink->telnetCommand(command); }
+    void telnetSubOption(const char *data, int length)
+    {
+        QTTELNET_TRACE_VALUE("option", "SB received", sink, "option",
+                             length > 0 ? uchar(data[0]) : -1);
+        sink->telnetSubOption(data, length);
+    }
+    void telnetOption(uchar operation, uchar option)
+    {
+        QTTELNET_TRACE_VALUE("option", operationName(operation, false), sink,
+                             "option", option);
+        if (!sink->telnetOptionReceived(operation, option)
+            || !replyNeeded(operation, option))
+            return;
+        const bool allowed = sink->telnetAllowOption(operation, option);
+        sendOption(opposite(operation, allowed), option);
+        setMode(operation, option, allowed);
+    }
+
+    QtTelnetOptionSet modes;    // Options we perform
+    QtTelnetOptionSet hismodes; // Options the peer performs
+
+private:
+    // RFC854 requires that we don't acknowledge requests to enter a
+    // mode we're already in, nor the peer entering a mode it is
+    // already in
+    bool replyNeeded(uchar operation, uchar option) const
+    {
+        switch (operation) {
+        case Common::DO:
+            return !modes.value(option);
+        case Common::DONT:
+            return modes.value(option);
+        case Common::WILL:
+            return !hismodes.value(option);
+        case Common::WONT:
+            return hismodes.value(option);
+        default:
+            return false;
+        }
+    }
+
+    // Returns the answer to \a operation, which is one of WILL, WONT,
+    // DO and DONT. A DONT may not be answered with WILL, nor a WONT
+    // with DO.
+    static uchar opposite(uchar operation, bool positive)
+    {
+        static const uchar answers[4][2] = {
+            { Common::DONT, Common::DO },   // WILL
+            { Common::DONT, Common::DONT }, // WONT
+            { Common::WONT, Common::WILL }, // DO
+            { Common::WONT, Common::WONT }  // DONT
+        };
+        return answers[(operation - Common::WILL) & 3][positive];
+    }
+
+    // Returns the name of a WILL, WONT, DO or DONT for tracing
+    static const char *operationName(uchar operation, bool sent)
+    {
+        static const char *const names[2][4] = {
+            { "WILL received", "WONT received", "DO received",
+              "DONT received" },
+            { "WILL sent", "WONT sent", "DO sent", "DONT sent" }
+        };
+        return names[sent][(operation - Common::WILL) & 3];
+    }
+
+    Sink *sink;
+    Transport *transport;
+    QtTelnetOptionSet sent[4]; // By operation, WILL to DONT
+};
+
+#endif
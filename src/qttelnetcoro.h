@@ -0,0 +1,310 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+#ifndef QTTELNETCORO_H
+#define QTTELNETCORO_H
+
+#include "qttelnet.h"
+
+/*
+  C++20 coroutine interface for QtTelnet. A script is a coroutine
+  returning QtTelnetTask that awaits the operations of a
+  QtTelnetSession:
+
+      QtTelnetTask script(QtTelnetSession &session)
+      {
+          if (!co_await session.connect(host, 23))
+              co_return;
+          if (!co_await session.login(user, password))
+              co_return;
+          const QtTelnetReply reply = co_await session.execute("show ver");
+          ...
+      }
+
+  The coroutine is resumed directly from QtTelnet's event hook, i.e.
+  from within the parser when the event occurs, with no queued calls
+  in between. An await allocates nothing: the awaiter lives in the
+  coroutine frame and the session holds a pointer to it. Only the
+  frame itself is allocated, once per script. A session supports one
+  pending await at a time.
+
+  There are no timeouts, since they would need timers; call
+  QtTelnet::close() or use QtTelnet::setConnectTimeout() to make a
+  pending await fail. Destroying the session also makes a pending
+  await fail, and every await after that fails at once.
+
+  Since the script runs inside QtTelnet's own code, it must not
+  delete the QtTelnet object, or the session, while it is resumed;
+  use QObject::deleteLater() for the QtTelnet object, and destroy the
+  session after the script has returned.
+
+  This header is only usable with a compiler that implements
+  coroutines; otherwise it declares nothing.
+*/
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#  if __has_include(<coroutine>)
+#    define QTTELNET_HAVE_COROUTINES
+#  endif
+#endif
+
+#ifdef QTTELNET_HAVE_COROUTINES
+
+#include <coroutine>
+#include <exception>
+
+/*
+  The return type of a script coroutine. The coroutine starts right
+  away and destroys itself when it returns.
+*/
+struct QtTelnetTask
+{
+    struct promise_type
+    {
+        QtTelnetTask get_return_object() noexcept { return QtTelnetTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+struct QtTelnetReply
+{
+    bool ok;      // False if the connection was closed first
+    QString text; // Including the echo of the command and the prompt
+};
+
+class QtTelnetSession
+{
+public:
+    explicit QtTelnetSession(QtTelnet *telnet)
+        : t(telnet), pending(nullptr), closing(false)
+    { t->setEventHook(&QtTelnetSession::hook, this); }
+    ~QtTelnetSession()
+    {
+        t->setEventHook(0, 0);
+        closing = true;
+        // Resume a script that is still waiting, so that its frame is
+        // not leaked; the await returns a failure
+        if (Awaiter *awaiter = pending) {
+            pending = nullptr;
+            awaiter->ok = false;
+            awaiter->handle.resume();
+        }
+    }
+
+    QtTelnetSession(const QtTelnetSession &) = delete;
+    QtTelnetSession &operator=(const QtTelnetSession &) = delete;
+
+    QtTelnet *telnet() const { return t; }
+
+    class Awaiter
+    {
+    public:
+        bool await_ready() const noexcept { return false; }
+
+    protected:
+        explicit Awaiter(QtTelnetSession *session) : session(session) {}
+        ~Awaiter() = default;
+
+        // Returns true if the coroutine is to be resumed
+        virtual bool event(QtTelnet::HookEvent event,
+                           const QString &text) = 0;
+
+        // Returns false if the await is to fail at once
+        bool wait(std::coroutine_handle<> h, bool text = false)
+        {
+            if (session->closing)
+                return false;
+            handle = h;
+            session->pending = this;
+            session->t->setEventHook(&QtTelnetSession::hook, session, text);
+            return true;
+        }
+
+        QtTelnetSession *session;
+        std::coroutine_handle<> handle;
+        bool ok = false;
+
+        friend class QtTelnetSession;
+    };
+
+    class ConnectAwaiter : public Awaiter
+    {
+    public:
+        ConnectAwaiter(QtTelnetSession *session, const QString &host,
+                       quint16 port)
+            : Awaiter(session), host(host), port(port) {}
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            if (session->t->isConnected()) {
+                ok = true;
+                return false;
+            }
+            if (!wait(h))
+                return false;
+            session->t->connectToHost(host, port);
+            return true;
+        }
+        bool await_resume() const noexcept { return ok; }
+
+    protected:
+        bool event(QtTelnet::HookEvent event, const QString &) override
+        {
+            ok = (event == QtTelnet::ConnectedEvent);
+            return ok || event == QtTelnet::ClosedEvent;
+        }
+
+    private:
+        QString host;
+        quint16 port;
+    };
+
+    class LoginAwaiter : public Awaiter
+    {
+    public:
+        LoginAwaiter(QtTelnetSession *session, const QString &user,
+                     const QString &password)
+            : Awaiter(session), user(user), password(password) {}
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            if (session->t->isLoggedIn()) {
+                ok = true;
+                return false;
+            }
+            if (!session->t->isConnected())
+                return false;
+            if (!wait(h))
+                return false;
+            session->t->login(user, password);
+            return true;
+        }
+        bool await_resume() const noexcept { return ok; }
+
+    protected:
+        bool event(QtTelnet::HookEvent event, const QString &) override
+        {
+            ok = (event == QtTelnet::LoggedInEvent);
+            return ok || event == QtTelnet::LoginFailedEvent
+                || event == QtTelnet::ClosedEvent;
+        }
+
+    private:
+        QString user, password;
+    };
+
+    class ExecuteAwaiter : public Awaiter
+    {
+    public:
+        ExecuteAwaiter(QtTelnetSession *session, const QString &command)
+            : Awaiter(session), command(command) {}
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            if (!session->t->isLoggedIn())
+                return false;
+            if (!wait(h, true))
+                return false;
+            session->t->sendData(command + QLatin1String("\r\n"));
+            return true;
+        }
+        QtTelnetReply await_resume() noexcept
+        {
+            QtTelnetReply reply = { ok, output };
+            return reply;
+        }
+
+    protected:
+        bool event(QtTelnet::HookEvent event, const QString &text) override
+        {
+            if (event == QtTelnet::TextEvent) {
+                output += text;
+                return false;
+            }
+            ok = (event == QtTelnet::PromptEvent);
+            return ok || event == QtTelnet::ClosedEvent;
+        }
+
+    private:
+        QString command;
+        QString output;
+    };
+
+    // Connects to \a host and \a port; true once connected
+    ConnectAwaiter connect(const QString &host, quint16 port = 23)
+    { return ConnectAwaiter(this, host, port); }
+
+    // Logs in; true once logged in, false if the login was rejected
+    LoginAwaiter login(const QString &user, const QString &password)
+    { return LoginAwaiter(this, user, password); }
+
+    // Sends \a command as a line and collects the text up to the prompt
+    ExecuteAwaiter execute(const QString &command)
+    { return ExecuteAwaiter(this, command); }
+
+private:
+    static void hook(void *context, QtTelnet::HookEvent event,
+                     const QString &text)
+    {
+        QtTelnetSession *session = static_cast<QtTelnetSession *>(context);
+        Awaiter *awaiter = session->pending;
+        if (!awaiter || !awaiter->event(event, text))
+            return;
+        session->pending = nullptr;
+        session->t->setEventHook(&QtTelnetSession::hook, session, false);
+        awaiter->handle.resume();
+    }
+
+    QtTelnet *t;
+    Awaiter *pending;
+    bool closing;
+};
+
+#endif // QTTELNET_HAVE_COROUTINES
+#endif
@@ -0,0 +1,717 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+
+/*!
+    \class QtTelnetServer
+    \brief The QtTelnetServer class accepts Telnet connections and
+    negotiates the server side of the Telnet options.
+
+    Call listen() to accept connections. For each client that
+    connects, QtTelnetServer creates a QtTelnetServerConnection,
+    which starts negotiating the options() right away, and emits
+    newConnection(). Call nextPendingConnection() to take the
+    connection and connect to its signals.
+
+    To handle connections in a subclass of QtTelnetServerConnection,
+    reimplement createConnection().
+
+    Connections use the same parser as QtTelnet. Incoming data is
+    parsed in place in a buffer shared by all the connections of a
+    thread, and the per-connection state is a few hundred bytes plus
+    the socket, so a single event loop can serve thousands of clients.
+*/
+
+/*!
+    \class QtTelnetServerConnection
+    \brief The QtTelnetServerConnection class is the server side of
+    a Telnet connection.
+
+    The connection negotiates the options it is given when it is
+    created: it offers to echo and to suppress go-aheads, and asks
+    the client for its window size (RFC1073) and terminal type
+    (RFC1091), as selected. Options the client asks for that were not
+    selected are refused.
+
+    Data from the client is delivered with dataReceived(), without
+    Telnet commands and without the NUL bytes of the network virtual
+    terminal; commands such as Interrupt Process are delivered with
+    controlReceived(). sendData() sends data to the client, escaping
+    IAC bytes as needed.
+
+    When the client disconnects, disconnected() is emitted. Delete
+    the connection with deleteLater() when it is no longer needed.
+*/
+
+#include "qttelnetserver.h"
+#include "qttelnetcore.h"
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QtCore/QList>
+#include <QtCore/QPointer>
+
+class QtTelnetServerPrivate : public QObject
+{
+    Q_OBJECT
+public:
+    QtTelnetServerPrivate(QtTelnetServer *parent);
+
+    QtTelnetServer *q;
+    QTcpServer *server;
+    QtTelnetServer::Options options;
+    QList<QPointer<QtTelnetServerConnection> > pending;
+
+public slots:
+    void acceptConnections();
+};
+
+QtTelnetServerPrivate::QtTelnetServerPrivate(QtTelnetServer *parent)
+    : q(parent), server(new QTcpServer(this)),
+      options(QtTelnetServer::Echo | QtTelnetServer::SuppressGoAhead
+              | QtTelnetServer::WindowSize | QtTelnetServer::TerminalType)
+{
+    connect(server, SIGNAL(newConnection()), this, SLOT(acceptConnections()));
+}
+
+/*
+  Takes every connection from the QTcpServer as soon as it arrives,
+  so that option negotiation starts before the application gets
+  around to calling nextPendingConnection().
+*/
+void QtTelnetServerPrivate::acceptConnections()
+{
+    while (server->hasPendingConnections()) {
+        QTcpSocket *socket = server->nextPendingConnection();
+        QtTelnetServerConnection *connection = q->createConnection(socket);
+        if (!connection) {
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+        pending.append(connection);
+        emit q->newConnection();
+    }
+}
+
+class QtTelnetServerConnectionPrivate : public QObject
+{
+    Q_OBJECT
+public:
+    QtTelnetServerConnectionPrivate(QtTelnetServerConnection *parent,
+                                    QTcpSocket *socket,
+                                    QtTelnetServer::Options options);
+
+    void start();
+    bool offersLocal(uchar option) const;
+    bool acceptsRemote(uchar option) const;
+    void flushData();
+
+    // The policies of QtTelnetCore
+    void telnetData(const char *data, int length);
+    void telnetCommand(uchar command);
+    void telnetSubOption(const char *data, int length);
+    bool telnetOptionReceived(uchar operation, uchar option);
+    bool telnetAllowOption(uchar operation, uchar option);
+    void telnetOptionChanged(uchar option, bool local, bool enabled);
+    void telnetWrite(const char *data, int length)
+    { socket->write(data, length); }
+
+    QtTelnetCore<QtTelnetServerConnectionPrivate,
+                 QtTelnetServerConnectionPrivate> core;
+    QtTelnetServerConnection *q;
+    QTcpSocket *socket;
+    QtTelnetServer::Options options;
+    QByteArray pending, received;
+    QSize windowsize;
+    QString terminaltype;
+
+public slots:
+    void socketReadyRead();
+    void socketDisconnected();
+};
+
+QtTelnetServerConnectionPrivate::QtTelnetServerConnectionPrivate(
+    QtTelnetServerConnection *parent, QTcpSocket *s,
+    QtTelnetServer::Options o)
+    : core(this, this), q(parent), socket(s), options(o)
+{
+    connect(socket, SIGNAL(readyRead()), this, SLOT(socketReadyRead()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+}
+
+void QtTelnetServerConnectionPrivate::start()
+{
+    if (options & QtTelnetServer::Echo)
+        core.sendOption(Common::WILL, Common::Echo);
+    if (options & QtTelnetServer::SuppressGoAhead)
+        core.sendOption(Common::WILL, Common::SuppressGoAhead);
+    if (options & QtTelnetServer::Binary) {
+        core.sendOption(Common::WILL, Common::Binary);
+        core.sendOption(Common::DO, Common::Binary);
+    }
+    if (options & QtTelnetServer::WindowSize)
+        core.sendOption(Common::DO, Common::NAWS);
+    if (options & QtTelnetServer::TerminalType)
+        core.sendOption(Common::DO, Common::TerminalType);
+}
+
+bool QtTelnetServerConnectionPrivate::offersLocal(uchar option) const
+{
+    switch (option) {
+    case Common::Echo:
+        return options.testFlag(QtTelnetServer::Echo);
+    case Common::SuppressGoAhead:
+        return options.testFlag(QtTelnetServer::SuppressGoAhead);
+    case Common::Binary:
+        return options.testFlag(QtTelnetServer::Binary);
+    default:
+        return false;
+    }
+}
+
+bool QtTelnetServerConnectionPrivate::acceptsRemote(uchar option) const
+{
+    switch (option) {
+    case Common::NAWS:
+        return options.testFlag(QtTelnetServer::WindowSize);
+    case Common::TerminalType:
+        return options.testFlag(QtTelnetServer::TerminalType);
+    case Common::SuppressGoAhead:
+        return options.testFlag(QtTelnetServer::SuppressGoAhead);
+    case Common::Binary:
+        return options.testFlag(QtTelnetServer::Binary);
+    default:
+        return false;
+    }
+}
+
+/*
+  Emits the data collected during the current read cycle, if any.
+  The data is copied out of the read buffer, so receivers may keep
+  it.
+*/
+void QtTelnetServerConnectionPrivate::flushData()
+{
+    if (received.isEmpty())
+        return;
+    const QByteArray data = received;
+    received.clear();
+    emit q->dataReceived(data);
+}
+
+void QtTelnetServerConnectionPrivate::telnetData(const char *data,
+                                                 int length)
+{
+    if (core.hismodes.value(Common::Binary)) {
+        received.append(data, length);
+        return;
+    }
+    // NUL is a no-op in the network virtual terminal, and follows a
+    // CR that is not part of an end of line
+    const char *end = data + length;
+    while (data < end) {
+        const char *nul = static_cast<const char *>(
+            memchr(data, 0, end - data));
+        if (!nul) {
+            received.append(data, end - data);
+            return;
+        }
+        received.append(data, nul - data);
+        data = nul + 1;
+    }
+}
+
+void QtTelnetServerConnectionPrivate::telnetCommand(uchar command)
+{
+    QtTelnet::Control ctrl;
+    switch (command) {
+    case Common::IP:
+        ctrl = QtTelnet::InterruptProcess;
+        break;
+    case Common::AO:
+        ctrl = QtTelnet::AbortOutput;
+        break;
+    case Common::AYT:
+        ctrl = QtTelnet::AreYouThere;
+        break;
+    case Common::EC:
+        ctrl = QtTelnet::EraseCharacter;
+        break;
+    case Common::EL:
+        ctrl = QtTelnet::EraseLine;
+        break;
+    case Common::BRK:
+        ctrl = QtTelnet::Break;
+        break;
+    case Common::GA:
+        ctrl = QtTelnet::GoAhead;
+        break;
+    case Common::CEOF:
+        ctrl = QtTelnet::EndOfFile;
+        break;
+    case Common::SUSP:
+        ctrl = QtTelnet::Suspend;
+        break;
+    case Common::ABORT:
+        ctrl = QtTelnet::Abort;
+        break;
+    default: // NOP, DM and unknown commands
+        return;
+    }
+    flushData();
+    emit q->controlReceived(ctrl);
+}
+
+bool QtTelnetServerConnectionPrivate::telnetOptionReceived(uchar operation,
+                                                           uchar option)
+{
+    if (operation == Common::DO && option == Common::TimingMark) {
+        // RFC860: everything before the mark has been processed
+        flushData();
+        const char mark[3] = { char(Common::IAC), char(Common::WILL),
+                               Common::TimingMark };
+        telnetWrite(mark, sizeof(mark));
+        return false;
+    }
+    return true;
+}
+
+bool QtTelnetServerConnectionPrivate::telnetAllowOption(uchar operation,
+                                                        uchar option)
+{
+    if (operation == Common::DO || operation == Common::DONT)
+        return offersLocal(option);
+    return acceptsRemote(option);
+}
+
+void QtTelnetServerConnectionPrivate::telnetOptionChanged(uchar option,
+                                                          bool local,
+                                                          bool enabled)
+{
+    if (!local && enabled && option == Common::TerminalType) {
+        const char send[6] = { char(Common::IAC), char(Common::SB),
+                               Common::TerminalType, Common::SEND,
+                               char(Common::IAC), char(Common::SE) };
+        telnetWrite(send, sizeof(send));
+    }
+}
+
+void QtTelnetServerConnectionPrivate::telnetSubOption(const char *data,
+                                                      int length)
+{
+    if (length <= 0)
+        return;
+    const QByteArray suboption =
+        qtTelnetUnescapeIAC(QByteArray::fromRawData(data, length));
+
+    switch (suboption.at(0)) {
+    case Common::NAWS: {
+        if (!core.hismodes.value(Common::NAWS) || suboption.size() < 5)
+            return;
+        const uchar *p = reinterpret_cast<const uchar *>(suboption.constData());
+        const QSize size((p[1] << 8) | p[2], (p[3] << 8) | p[4]);
+        if (size == windowsize)
+            return;
+        windowsize = size;
+        flushData();
+        emit q->windowSizeChanged(size);
+        break;
+    }
+    case Common::TerminalType:
+        if (!core.hismodes.value(Common::TerminalType)
+            || suboption.size() < 2
+            || suboption.at(1) != Common::IS)
+            return;
+        terminaltype = QString::fromLatin1(suboption.constData() + 2,
+                                           suboption.size() - 2);
+        flushData();
+        emit q->terminalTypeReceived(terminaltype);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+  Reads the available data into the per-thread arena and parses it
+  in place, like QtTelnet does. Only an incomplete command at the end
+  of a chunk is copied, to be completed by the next read.
+*/
+void QtTelnetServerConnectionPrivate::socketReadyRead()
+{
+    QtTelnetArena *arena = qtTelnetReadArena();
+    arena->begin();
+    qint64 available;
+    while ((available = socket->bytesAvailable()) > 0) {
+        const int chunk = int(qMin(available, qint64(65536)));
+        const int held = pending.size();
+        char *data = arena->allocate(held + chunk);
+        if (held)
+            memcpy(data, pending.constData(), held);
+        const qint64 n = socket->read(data + held, chunk);
+        if (n <= 0)
+            break;
+        pending.clear();
+        const int length = held + int(n);
+        const int used = core.receive(data, length);
+        if (used < length)
+            pending = QByteArray(data + used, length - used);
+    }
+    flushData();
+    arena->end();
+}
+
+void QtTelnetServerConnectionPrivate::socketDisconnected()
+{
+    emit q->disconnected();
+}
+
+/*!
+    Constructs a Telnet server with the given \a parent. Call listen()
+    to start accepting connections.
+*/
+QtTelnetServer::QtTelnetServer(QObject *parent)
+    : QObject(parent), d(new QtTelnetServerPrivate(this))
+{
+}
+
+/*!
+    Destroys the server. Connections that have been taken with
+    nextPendingConnection() are not affected.
+*/
+QtTelnetServer::~QtTelnetServer()
+{
+    delete d;
+}
+
+/*!
+    Starts listening for connections on \a address and \a port. If
+    \a port is 0, a port is chosen automatically; serverPort()
+    returns it. Returns true on success; otherwise returns false and
+    errorString() describes the error.
+*/
+bool QtTelnetServer::listen(const QHostAddress &address, quint16 port)
+{
+    return d->server->listen(address, port);
+}
+
+/*!
+    Stops listening for connections. Existing connections stay open.
+*/
+void QtTelnetServer::close()
+{
+    d->server->close();
+}
+
+/*!
+    Returns true if the server is listening for connections.
+*/
+bool QtTelnetServer::isListening() const
+{
+    return d->server->isListening();
+}
+
+/*!
+    Returns the address the server is listening on.
+*/
+QHostAddress QtTelnetServer::serverAddress() const
+{
+    return d->server->serverAddress();
+}
+
+/*!
+    Returns the port the server is listening on.
+*/
+quint16 QtTelnetServer::serverPort() const
+{
+    return d->server->serverPort();
+}
+
+/*!
+    Returns a description of the last error that occurred.
+*/
+QString QtTelnetServer::errorString() const
+{
+    return d->server->errorString();
+}
+
+/*!
+    Returns the QTcpServer that accepts the connections, for example
+    to set a proxy or to pause accepting.
+*/
+QTcpServer *QtTelnetServer::tcpServer() const
+{
+    return d->server;
+}
+
+/*!
+    Sets the options that new connections negotiate to \a options.
+    The default is Echo, SuppressGoAhead, WindowSize and TerminalType.
+    Connections that already exist are not affected.
+
+    \sa options()
+*/
+void QtTelnetServer::setOptions(Options options)
+{
+    d->options = options;
+}
+
+/*!
+    Returns the options that new connections negotiate.
+
+    \sa setOptions()
+*/
+QtTelnetServer::Options QtTelnetServer::options() const
+{
+    return d->options;
+}
+
+/*!
+    Returns true if there are connections that have not been taken
+    with nextPendingConnection() yet.
+*/
+bool QtTelnetServer::hasPendingConnections() const
+{
+    for (int i = 0; i < d->pending.size(); ++i) {
+        if (d->pending.at(i))
+            return true;
+    }
+    return false;
+}
+
+/*!
+    Returns the next pending connection, or 0 if there is none. The
+    connection remains a child of the server; call
+    QObject::setParent() to change that, or delete it when it is done.
+*/
+QtTelnetServerConnection *QtTelnetServer::nextPendingConnection()
+{
+    while (!d->pending.isEmpty()) {
+        QtTelnetServerConnection *connection = d->pending.takeFirst();
+        if (connection)
+            return connection;
+    }
+    return 0;
+}
+
+/*!
+    Creates the connection for \a socket, a client that has just
+    connected. The default implementation creates a
+    QtTelnetServerConnection with the server's options() as a child
+    of the server. Reimplement it to use a subclass of
+    QtTelnetServerConnection. Returning 0 refuses the client.
+*/
+QtTelnetServerConnection *QtTelnetServer::createConnection(
+    QTcpSocket *socket)
+{
+    return new QtTelnetServerConnection(socket, d->options, this);
+}
+
+/*!
+    \fn void QtTelnetServer::newConnection()
+
+    This signal is emitted when a client has connected. Call
+    nextPendingConnection() to take the connection.
+*/
+
+/*!
+    \enum QtTelnetServer::Option
+
+    This enum describes the options that connections negotiate.
+
+    \value NoOptions No options are negotiated.
+    \value Echo The server echoes what the client sends (RFC857).
+    The application is responsible for sending the echo.
+    \value SuppressGoAhead Go-aheads are suppressed (RFC858).
+    \value WindowSize The client is asked for its window size (RFC1073).
+    \value TerminalType The client is asked for its terminal type
+    (RFC1091).
+    \value Binary Both sides transmit in binary (RFC856), so that NUL
+    bytes from the client are kept.
+*/
+
+/*!
+    Constructs a connection for \a socket, a connected socket, which
+    negotiates \a options, with the given \a parent. The connection
+    takes ownership of \a socket and starts negotiating immediately.
+*/
+QtTelnetServerConnection::QtTelnetServerConnection(
+    QTcpSocket *socket, QtTelnetServer::Options options, QObject *parent)
+    : QObject(parent),
+      d(new QtTelnetServerConnectionPrivate(this, socket, options))
+{
+    socket->setParent(this);
+    d->start();
+}
+
+/*!
+    Destroys the connection and its socket, closing it if necessary.
+*/
+QtTelnetServerConnection::~QtTelnetServerConnection()
+{
+    delete d;
+}
+
+/*!
+    Returns the socket of the connection.
+*/
+QTcpSocket *QtTelnetServerConnection::socket() const
+{
+    return d->socket;
+}
+
+/*!
+    Returns true if the client is still connected.
+*/
+bool QtTelnetServerConnection::isConnected() const
+{
+    return d->socket->state() == QAbstractSocket::ConnectedState;
+}
+
+/*!
+    Returns true if \a option has been agreed on. If \a side is
+    QtTelnet::LocalSide, the server performs the option; if it is
+    QtTelnet::RemoteSide, the client does.
+*/
+bool QtTelnetServerConnection::isOptionEnabled(int option,
+                                               QtTelnet::OptionSide side)
+    const
+{
+    if (option < 0 || option > 255)
+        return false;
+    return d->core.isEnabled(uchar(option), side == QtTelnet::LocalSide);
+}
+
+/*!
+    Returns the window size last reported by the client, or an
+    invalid size if the client has not reported one.
+
+    \sa windowSizeChanged()
+*/
+QSize QtTelnetServerConnection::windowSize() const
+{
+    return d->windowsize;
+}
+
+/*!
+    Returns the terminal type reported by the client, or an empty
+    string if the client has not reported one.
+
+    \sa terminalTypeReceived()
+*/
+QString QtTelnetServerConnection::terminalType() const
+{
+    return d->terminaltype;
+}
+
+/*!
+    Sends \a data to the client. IAC bytes are escaped; the data is
+    otherwise sent as is, so lines should end with CR LF.
+*/
+void QtTelnetServerConnection::sendData(const QByteArray &data)
+{
+    d->core.sendData(data.constData(), data.size());
+}
+
+/*!
+    Sends the control message \a ctrl to the client, for example
+    QtTelnet::GoAhead when go-aheads are not suppressed.
+*/
+void QtTelnetServerConnection::sendControl(QtTelnet::Control ctrl)
+{
+    static const uchar commands[] = {
+        Common::GA, Common::IP, Common::AYT, Common::AO, Common::EC,
+        Common::EL, Common::BRK, Common::CEOF, Common::SUSP, Common::ABORT
+    };
+    if (uint(ctrl) >= sizeof(commands))
+        return;
+    const char command[2] = { char(Common::IAC), char(commands[ctrl]) };
+    d->socket->write(command, sizeof(command));
+}
+
+/*!
+    Closes the connection once the data that has been sent has been
+    written.
+*/
+void QtTelnetServerConnection::close()
+{
+    d->socket->disconnectFromHost();
+}
+
+/*!
+    \fn void QtTelnetServerConnection::dataReceived(const QByteArray &data)
+
+    This signal is emitted when \a data has been received from the
+    client, once per read at most.
+*/
+
+/*!
+    \fn void QtTelnetServerConnection::controlReceived(QtTelnet::Control ctrl)
+
+    This signal is emitted when the client sends the control message
+    \a ctrl, for example QtTelnet::InterruptProcess.
+*/
+
+/*!
+    \fn void QtTelnetServerConnection::windowSizeChanged(const QSize &size)
+
+    This signal is emitted when the client reports its window \a size.
+*/
+
+/*!
+    \fn void QtTelnetServerConnection::terminalTypeReceived(const QString &type)
+
+    This signal is emitted when the client reports its terminal
+    \a type.
+*/
+
+/*!
+    \fn void QtTelnetServerConnection::disconnected()
+
+    This signal is emitted when the client has disconnected.
+*/
+
+#include "qttelnetserver.moc"
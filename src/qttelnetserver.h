@@ -0,0 +1,132 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+#ifndef QTTELNETSERVER_H
+#define QTTELNETSERVER_H
+
+#include "qttelnet.h"
+#include <QtCore/QByteArray>
+#include <QtNetwork/QHostAddress>
+
+class QTcpServer;
+class QtTelnetServerConnection;
+class QtTelnetServerPrivate;
+class QtTelnetServerConnectionPrivate;
+
+class QT_QTTELNET_EXPORT QtTelnetServer : public QObject
+{
+    Q_OBJECT
+public:
+    enum Option { NoOptions = 0x0, Echo = 0x1, SuppressGoAhead = 0x2,
+                  WindowSize = 0x4, TerminalType = 0x8, Binary = 0x10 };
+    Q_DECLARE_FLAGS(Options, Option)
+
+    explicit QtTelnetServer(QObject *parent = 0);
+    ~QtTelnetServer();
+
+    bool listen(const QHostAddress &address = QHostAddress::Any,
+                quint16 port = 0);
+    void close();
+    bool isListening() const;
+    QHostAddress serverAddress() const;
+    quint16 serverPort() const;
+    QString errorString() const;
+    QTcpServer *tcpServer() const;
+
+    void setOptions(Options options);
+    Options options() const;
+
+    bool hasPendingConnections() const;
+    QtTelnetServerConnection *nextPendingConnection();
+
+Q_SIGNALS:
+    void newConnection();
+
+protected:
+    virtual QtTelnetServerConnection *createConnection(QTcpSocket *socket);
+
+private:
+    friend class QtTelnetServerPrivate;
+    Q_DISABLE_COPY(QtTelnetServer)
+    QtTelnetServerPrivate *d;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(QtTelnetServer::Options)
+
+class QT_QTTELNET_EXPORT QtTelnetServerConnection : public QObject
+{
+    Q_OBJECT
+public:
+    QtTelnetServerConnection(QTcpSocket *socket,
+                             QtTelnetServer::Options options,
+                             QObject *parent = 0);
+    ~QtTelnetServerConnection();
+
+    QTcpSocket *socket() const;
+    bool isConnected() const;
+    bool isOptionEnabled(int option, QtTelnet::OptionSide side
+                         = QtTelnet::LocalSide) const;
+    QSize windowSize() const;
+    QString terminalType() const;
+
+public Q_SLOTS:
+    void sendData(const QByteArray &data);
+    void sendControl(QtTelnet::Control ctrl);
+    void close();
+
+Q_SIGNALS:
+    void dataReceived(const QByteArray &data);
+    void controlReceived(QtTelnet::Control ctrl);
+    void windowSizeChanged(const QSize &size);
+    void terminalTypeReceived(const QString &type);
+    void disconnected();
+
+private:
+    friend class QtTelnetServerConnectionPrivate;
+    Q_DISABLE_COPY(QtTelnetServerConnection)
+    QtTelnetServerConnectionPrivate *d;
+};
+#endif
@@ -0,0 +1,817 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+/*!
+    \class QtTelnetSraAuthenticator
+    \brief The QtTelnetSraAuthenticator class logs in to a Telnet server
+    with the Secure RPC Authentication (SRA) mechanism.
+
+    SRA is the authentication type 6 of the Telnet AUTHENTICATION
+    option (RFC2941), as implemented by the BSD telnet and telnetd.
+    Client and server agree on a DES key with a Diffie-Hellman key
+    exchange over a fixed 192 bit modulus, and the client sends the
+    user name and password encrypted with it, so that they do not
+    cross the network in the clear. It offers no protection against an
+    active attacker, and the keys are far too short by today's
+    standards; prefer TLS (see QtTelnet::setTlsMode()) where the server
+    supports it.
+
+    Add the authenticator to a session with
+    QtTelnet::addAuthenticator(). It sends the user name and password
+    passed to QtTelnet::login(); if they have not been set when the
+    server asks for them, it waits for login() to be called in answer
+    to QtTelnet::loginRequired().
+
+    The modular exponentiations of the key exchange are run on
+    QThreadPool::globalInstance(), so they do not hold up the session's
+    thread. Their results are cached per host and port for the life of
+    the process: later connections to the same server reuse the key
+    pair, and skip the exchange entirely if the server presents the
+    same public key again, which the BSD telnetd does for as long as
+    it runs. clearKeyCache() discards the cache.
+
+    The key pair is made from the operating system's random source
+    (CryptGenRandom() on Windows, \c /dev/urandom elsewhere, or
+    QRandomGenerator::system() with Qt 5.10 and later). If that cannot
+    be read, the authentication fails.
+*/
+
+#include "qttelnetsraauthenticator.h"
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QThreadPool>
+#if QT_VERSION >= 0x050a00
+#  include <QtCore/QRandomGenerator>
+#elif defined(Q_OS_WIN)
+#  include <windows.h>
+#  include <wincrypt.h>
+#else
+#  include <QtCore/QFile>
+#endif
+#include <string.h>
+
+/*
+  DES (FIPS 46-3), only encryption, as SRA uses it. Bits are numbered
+  from 1 at the most significant end, as in the standard's tables.
+*/
+namespace Des
+{
+    static const uchar IP[64] = {
+        58, 50, 42, 34, 26, 18, 10, 2, 60, 52, 44, 36, 28, 20, 12, 4,
+        62, 54, 46, 38, 30, 22, 14, 6, 64, 56, 48, 40, 32, 24, 16, 8,
+        57, 49, 41, 33, 25, 17, 9, 1, 59, 51, 43, 35, 27, 19, 11, 3,
+        61, 53, 45, 37, 29, 21, 13, 5, 63, 55, 47, 39, 31, 23, 15, 7
+    };
+    static const uchar FP[64] = {
+        40, 8, 48, 16, 56, 24, 64, 32, 39, 7, 47, 15, 55, 23, 63, 31,
+        38, 6, 46, 14, 54, 22, 62, 30, 37, 5, 45, 13, 53, 21, 61, 29,
+        36, 4, 44, 12, 52, 20, 60, 28, 35, 3, 43, 11, 51, 19, 59, 27,
+        34, 2, 42, 10, 50, 18, 58, 26, 33, 1, 41, 9, 49, 17, 57, 25
+    };
+    static const uchar E[48] = {
+        32, 1, 2, 3, 4, 5, 4, 5, 6, 7, 8, 9, 8, 9, 10, 11,
+        12, 13, 12, 13, 14, 15, 16, 17, 16, 17, 18, 19, 20, 21, 20, 21,
+        22, 23, 24, 25, 24, 25, 26, 27, 28, 29, 28, 29, 30, 31, 32, 1
+    };
+    static const uchar P[32] = {
+        16, 7, 20, 21, 29, 12, 28, 17, 1, 15, 23, 26, 5, 18, 31, 10,
+        2, 8, 24, 14, 32, 27, 3, 9, 19, 13, 30, 6, 22, 11, 4, 25
+    };
+    static const uchar PC1[56] = {
+        57, 49, 41, 33, 25, 17, 9, 1, 58, 50, 42, 34, 26, 18,
+        10, 2, 59, 51, 43, 35, 27, 19, 11, 3, 60, 52, 44, 36,
+        63, 55, 47, 39, 31, 23, 15, 7, 62, 54, 46, 38, 30, 22,
+        14, 6, 61, 53, 45, 37, 29, 21, 13, 5, 28, 20, 12, 4
+    };
+    static const uchar PC2[48] = {
+        14, 17, 11, 24, 1, 5, 3, 28, 15, 6, 21, 10,
+        23, 19, 12, 4, 26, 8, 16, 7, 27, 20, 13, 2,
+        41, 52, 31, 37, 47, 55, 30, 40, 51, 45, 33, 48,
+        44, 49, 39, 56, 34, 53, 46, 42, 50, 36, 29, 32
+    };
+    static const uchar Shifts[16] = {
+        1, 1, 2, 2, 2, 2, 2, 2, 1, 2, 2, 2, 2, 2, 2, 1
+    };
+    static const uchar S[8][64] = {
+        { 14, 4, 13, 1, 2, 15, 11, 8, 3, 10, 6, 12, 5, 9, 0, 7,
+          0, 15, 7, 4, 14, 2, 13, 1, 10, 6, 12, 11, 9, 5, 3, 8,
+          4, 1, 14, 8, 13, 6, 2, 11, 15, 12, 9, 7, 3, 10, 5, 0,
+          15, 12, 8, 2, 4, 9, 1, 7, 5, 11, 3, 14, 10, 0, 6, 13 },
+        { 15, 1, 8, 14, 6, 11, 3, 4, 9, 7, 2, 13, 12, 0, 5, 10,
+          3, 13, 4, 7, 15, 2, 8, 14, 12, 0, 1, 10, 6, 9, 11, 5,
+          0, 14, 7, 11, 10, 4, 13, 1, 5, 8, 12, 6, 9, 3, 2, 15,
+          13, 8, 10, 1, 3, 15, 4, 2, 11, 6, 7, 12, 0, 5, 14, 9 },
+        { 10, 0, 9, 14, 6, 3, 15, 5, 1, 13, 12, 7, 11, 4, 2, 8,
+          13, 7, 0, 9, 3, 4, 6, 10, 2, 8, 5, 14, 12, 11, 15, 1,
+          13, 6, 4, 9, 8, 15, 3, 0, 11, 1, 2, 12, 5, 10, 14, 7,
+          1, 10, 13, 0, 6, 9, 8, 7, 4, 15, 14, 3, 11, 5, 2, 12 },
+        { 7, 13, 14, 3, 0, 6, 9, 10, 1, 2, 8, 5, 11, 12, 4, 15,
+          13, 8, 11, 5, 6, 15, 0, 3, 4, 7, 2, 12, 1, 10, 14, 9,
+          10, 6, 9, 0, 12, 11, 7, 13, 15, 1, 3, 14, 5, 2, 8, 4,
+          3, 15, 0, 6, 10, 1, 13, 8, 9, 4, 5, 11, 12, 7, 2, 14 },
+        { 2, 12, 4, 1, 7, 10, 11, 6, 8, 5, 3, 15, 13, 0, 14, 9,
+          14, 11, 2, 12, 4, 7, 13, 1, 5, 0, 15, 10, 3, 9, 8, 6,
+          4, 2, 1, 11, 10, 13, 7, 8, 15, 9, 12, 5, 6, 3, 0, 14,
+          11, 8, 12, 7, 1, 14, 2, 13, 6, 15, 0, 9, 10, 4, 5, 3 },
+        { 12, 1, 10, 15, 9, 2, 6, 8, 0, 13, 3, 4, 14, 7, 5, 11,
+          10, 15, 4, 2, 7, 12, 9, 5, 6, 1, 13, 14, 0, 11, 3, 8,
+          9, 14, 15, 5, 2, 8, 12, 3, 7, 0, 4, 10, 1, 13, 11, 6,
+          4, 3, 2, 12, 9, 5, 15, 10, 11, 14, 1, 7, 6, 0, 8, 13 },
+        { 4, 11, 2, 14, 15, 0, 8, 13, 3, 12, 9, 7, 5, 10, 6, 1,
+          13, 0, 11, 7, 4, 9, 1, 10, 14, 3, 5, 12, 2, 15, 8, 6,
+          1, 4, 11, 13, 12, 3, 7, 14, 10, 15, 6, 8, 0, 5, 9, 2,
+          6, 11, 13, 8, 1, 4, 10, 7, 9, 5, 0, 15, 14, 2, 3, 12 },
+        { 13, 2, 8, 4, 6, 15, 11, 1, 10, 9, 3, 14, 5, 0, 12, 7,
+          1, 15, 13, 8, 10, 3, 7, 4, 12, 5, 6, 11, 0, 14, 9, 2,
+          7, 11, 4, 1, 9, 12, 14, 2, 0, 6, 10, 13, 15, 3, 5, 8,
+          2, 1, 14, 7, 4, 10, 8, 13, 15, 12, 9, 0, 3, 5, 6, 11 }
+    };
+
+    // Picks the \a count bits of the \a width bit \a value listed in
+    // \a table
+    static quint64 permute(quint64 value, int width, const uchar *table,
+                           int count)
+    {
+        quint64 result = 0;
+        for (int i = 0; i < count; ++i)
+            result = (result << 1) | ((value >> (width - table[i])) & 1);
+        return result;
+    }
+
+    static quint32 rotate28(quint32 half, int n)
+    {
+        return ((half << n) | (half >> (28 - n))) & 0x0fffffff;
+    }
+
+    struct Schedule
+    {
+        quint64 subkeys[16];
+    };
+
+    static void schedule(Schedule &s, quint64 key)
+    {
+        const quint64 cd = permute(key, 64, PC1, 56);
+        quint32 c = quint32(cd >> 28);
+        quint32 d = quint32(cd & 0x0fffffff);
+        for (int round = 0; round < 16; ++round) {
+            c = rotate28(c, Shifts[round]);
+            d = rotate28(d, Shifts[round]);
+            s.subkeys[round] =
+                permute((quint64(c) << 28) | d, 56, PC2, 48);
+        }
+    }
+
+    static quint32 f(quint32 r, quint64 subkey)
+    {
+        const quint64 x = permute(r, 32, E, 48) ^ subkey;
+        quint32 out = 0;
+        for (int i = 0; i < 8; ++i) {
+            const int six = int(x >> (42 - 6 * i)) & 0x3f;
+            const int row = ((six & 0x20) >> 4) | (six & 1);
+            const int col = (six >> 1) & 0xf;
+            out = (out << 4) | S[i][row * 16 + col];
+        }
+        return quint32(permute(out, 32, P, 32));
+    }
+
+    static quint64 encrypt(const Schedule &s, quint64 block)
+    {
+        block = permute(block, 64, IP, 64);
+        quint32 l = quint32(block >> 32);
+        quint32 r = quint32(block);
+        for (int round = 0; round < 16; ++round) {
+            const quint32 t = r;
+            r = l ^ f(r, s.subkeys[round]);
+            l = t;
+        }
+        return permute((quint64(r) << 32) | l, 64, FP, 64);
+    }
+
+    static quint64 load(const uchar *p)
+    {
+        quint64 v = 0;
+        for (int i = 0; i < 8; ++i)
+            v = (v << 8) | p[i];
+        return v;
+    }
+
+    static void store(quint64 v, uchar *p)
+    {
+        for (int i = 7; i >= 0; --i, v >>= 8)
+            p[i] = uchar(v);
+    }
+}
+
+/*
+  The arithmetic SRA needs: numbers below the 192 bit modulus, in
+  32 bit limbs with the least significant first, and one more limb
+  for the carry of a sum.
+*/
+namespace Sra
+{
+    enum { Limbs = 7, KeyHexDigits = 48 };
+
+    struct Number
+    {
+        quint32 d[Limbs];
+    };
+
+    static const char Modulus[] =
+        "d4a0ba0250b6fd2ec626e7efd637df76c716e22d0944b88b";
+    static const quint32 Root = 3;
+
+    static void setZero(Number &n)
+    {
+        memset(n.d, 0, sizeof(n.d));
+    }
+
+    static int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+
+    // Reads up to 48 hex digits, stopping at the first other character
+    static void fromHex(Number &n, const char *hex, int length)
+    {
+        setZero(n);
+        int digits = 0;
+        while (digits < length && digits < KeyHexDigits
+               && hexValue(hex[digits]) >= 0)
+            ++digits;
+        for (int i = 0; i < digits; ++i) {
+            const int shift = 4 * (digits - 1 - i);
+            n.d[shift / 32] |= quint32(hexValue(hex[i])) << (shift % 32);
+        }
+    }
+
+    // Writes 48 lower-case hex digits, with leading zeros
+    static void toHex(const Number &n, char *hex)
+    {
+        static const char digits[] = "0123456789abcdef";
+        for (int i = 0; i < KeyHexDigits; ++i) {
+            const int shift = 4 * (KeyHexDigits - 1 - i);
+            hex[i] = digits[(n.d[shift / 32] >> (shift % 32)) & 0xf];
+        }
+    }
+
+    static bool lessThan(const Number &a, const Number &b)
+    {
+        for (int i = Limbs - 1; i >= 0; --i) {
+            if (a.d[i] != b.d[i])
+                return a.d[i] < b.d[i];
+        }
+        return false;
+    }
+
+    static void subtract(Number &a, const Number &b)
+    {
+        quint64 borrow = 0;
+        for (int i = 0; i < Limbs; ++i) {
+            const quint64 t = quint64(a.d[i]) - b.d[i] - borrow;
+            a.d[i] = quint32(t);
+            borrow = (t >> 32) & 1;
+        }
+    }
+
+    // r = (r + a) mod m, for r and a below m
+    static void addMod(Number &r, const Number &a, const Number &m)
+    {
+        quint64 carry = 0;
+        for (int i = 0; i < Limbs; ++i) {
+            const quint64 t = quint64(r.d[i]) + a.d[i] + carry;
+            r.d[i] = quint32(t);
+            carry = t >> 32;
+        }
+        if (!lessThan(r, m))
+            subtract(r, m);
+    }
+
+    static bool bit(const Number &n, int i)
+    {
+        return (n.d[i / 32] >> (i % 32)) & 1;
+    }
+
+    // r = a * b mod m, by doubling and adding
+    static void mulMod(Number &r, const Number &a, const Number &b,
+                       const Number &m)
+    {
+        Number result;
+        setZero(result);
+        for (int i = 32 * (Limbs - 1) - 1; i >= 0; --i) {
+            const Number twice = result;
+            addMod(result, twice, m);
+            if (bit(b, i))
+                addMod(result, a, m);
+        }
+        r = result;
+    }
+
+    // r = base ^ exponent mod m, by squaring and multiplying
+    static void powMod(Number &r, const Number &base, const Number &exponent,
+                       const Number &m)
+    {
+        Number result;
+        setZero(result);
+        result.d[0] = 1;
+        for (int i = 32 * (Limbs - 1) - 1; i >= 0; --i) {
+            mulMod(result, result, result, m);
+            if (bit(exponent, i))
+                mulMod(result, result, base, m);
+        }
+        r = result;
+    }
+
+    static void modulus(Number &m)
+    {
+        fromHex(m, Modulus, KeyHexDigits);
+    }
+
+    /*
+      Makes a key pair from 24 random bytes: the secret is the random
+      number reduced modulo the modulus, the public key the root
+      raised to it, as with genkeys() in the BSD telnet's
+      libtelnet/pk.c.
+    */
+    static void generateKeys(const uchar *random, Number &secret,
+                             Number &publicKey)
+    {
+        Number m;
+        modulus(m);
+        setZero(secret);
+        for (int i = 0; i < 24; ++i)
+            secret.d[i / 4] |= quint32(random[23 - i]) << (8 * (i % 4));
+        while (!lessThan(secret, m))
+            subtract(secret, m);
+        Number root;
+        setZero(root);
+        root.d[0] = Root;
+        powMod(publicKey, root, secret, m);
+    }
+
+    /*
+      Derives the DES key from our secret and the other side's public
+      key, as common_key() in libtelnet/pk.c does: the 8 bytes above
+      the lowest 64 bits of the common key, least significant first,
+      with odd parity.
+    */
+    static void commonKey(const Number &secret, const Number &publicKey,
+                          uchar *desKey)
+    {
+        Number m, common;
+        modulus(m);
+        powMod(common, publicKey, secret, m);
+        for (int i = 0; i < 8; ++i) {
+            uchar b = uchar(common.d[2 + i / 4] >> (8 * (i % 4)));
+            b &= 0xfe;
+            int ones = 0;
+            for (int j = 1; j < 8; ++j)
+                ones += (b >> j) & 1;
+            desKey[i] = b | ((ones & 1) ? 0 : 1);
+        }
+    }
+}
+
+namespace SraMessage
+{
+    const char Key = 0;
+    const char User = 1;
+    const char Continue = 2;
+    const char Password = 3;
+    const char Accept = 4;
+    const char Reject = 5;
+};
+
+/*
+  Fills \a data with \a length bytes from the operating system's
+  random source. Returns false if it cannot be read; the key exchange
+  then fails rather than making a key that can be predicted.
+*/
+static bool randomBytes(uchar *data, int length)
+{
+#if QT_VERSION >= 0x050a00
+    for (int i = 0; i < length; ++i)
+        data[i] = uchar(QRandomGenerator::system()->generate());
+    return true;
+#elif defined(Q_OS_WIN)
+    HCRYPTPROV provider;
+    if (!CryptAcquireContext(&provider, 0, 0, PROV_RSA_FULL,
+                             CRYPT_VERIFYCONTEXT | CRYPT_SILENT))
+        return false;
+    const bool ok = CryptGenRandom(provider, DWORD(length), data) != FALSE;
+    CryptReleaseContext(provider, 0);
+    return ok;
+#else
+    QFile urandom(QLatin1String("/dev/urandom"));
+    return urandom.open(QIODevice::ReadOnly)
+        && urandom.read(reinterpret_cast<char *>(data), length) == length;
+#endif
+}
+
+/*
+  Encrypts \a text with DES in CBC mode with a zero IV, padded with
+  zeros to a multiple of 8 bytes, and returns it in lower-case hex, as
+  pk_encode() in libtelnet/pk.c does.
+*/
+static QByteArray sraEncode(const QByteArray &text, const uchar *desKey)
+{
+    static const char digits[] = "0123456789abcdef";
+    QByteArray padded = text;
+    padded.append(QByteArray((8 - text.size() % 8) % 8, '\0'));
+    Des::Schedule schedule;
+    Des::schedule(schedule, Des::load(desKey));
+
+    QByteArray hex;
+    hex.reserve(padded.size() * 2);
+    const uchar *p = reinterpret_cast<const uchar *>(padded.constData());
+    quint64 chain = 0;
+    uchar block[8];
+    for (int i = 0; i < padded.size(); i += 8) {
+        chain = Des::encrypt(schedule, Des::load(p + i) ^ chain);
+        Des::store(chain, block);
+        for (int j = 0; j < 8; ++j) {
+            hex.append(digits[block[j] >> 4]);
+            hex.append(digits[block[j] & 0xf]);
+        }
+    }
+    return hex;
+}
+
+/*
+  The keys of the last exchange with each server, by host and port.
+*/
+struct QtTelnetSraKeys
+{
+    Sra::Number secret;
+    QByteArray publicKey; // Hex, as sent
+    QByteArray serverKey; // Hex, as received; empty until known
+    QByteArray desKey;    // From secret and serverKey
+};
+
+class QtTelnetSraKeyCache
+{
+public:
+    bool keys(const QString &host, QtTelnetSraKeys *keys)
+    {
+        QMutexLocker locker(&mutex);
+        QHash<QString, QtTelnetSraKeys>::const_iterator it =
+            cache.constFind(host);
+        if (it == cache.constEnd())
+            return false;
+        *keys = it.value();
+        return true;
+    }
+    void setKeys(const QString &host, const QtTelnetSraKeys &keys)
+    {
+        QMutexLocker locker(&mutex);
+        cache.insert(host, keys);
+    }
+    void clear()
+    {
+        QMutexLocker locker(&mutex);
+        cache.clear();
+    }
+
+private:
+    QMutex mutex;
+    QHash<QString, QtTelnetSraKeys> cache;
+};
+
+Q_GLOBAL_STATIC(QtTelnetSraKeyCache, sraKeyCache)
+
+/*
+  The way back from the jobs to the authenticator, shared by both. The
+  authenticator clears the receiver when it is destroyed, under the
+  mutex, so a job never posts its result to an object that is gone.
+*/
+struct QtTelnetSraChannel
+{
+    QtTelnetSraChannel(QObject *receiver) : receiver(receiver) {}
+
+    QMutex mutex;
+    QObject *receiver;
+};
+
+/*
+  Makes a key pair, or derives the DES key from our key pair and the
+  server's public key, on a pool thread, stores the result in the
+  cache and posts it to the authenticator's jobFinished(). The pool
+  deletes the job once it has run. An empty public key reports that
+  no key pair could be made.
+*/
+class QtTelnetSraJob : public QRunnable
+{
+public:
+    QtTelnetSraJob(const QSharedPointer<QtTelnetSraChannel> &channel,
+                   int serial, const QString &host,
+                   const QtTelnetSraKeys &keys)
+        : channel(channel), serial(serial), host(host), keys(keys)
+    {}
+
+    void run();
+
+private:
+    QSharedPointer<QtTelnetSraChannel> channel;
+    int serial;
+    QString host;
+    QtTelnetSraKeys keys;
+};
+
+void QtTelnetSraJob::run()
+{
+    if (keys.serverKey.isEmpty()) {
+        uchar random[24];
+        if (randomBytes(random, sizeof(random))) {
+            Sra::Number publicKey;
+            Sra::generateKeys(random, keys.secret, publicKey);
+            keys.publicKey.resize(Sra::KeyHexDigits);
+            Sra::toHex(publicKey, keys.publicKey.data());
+        }
+        memset(random, 0, sizeof(random));
+    } else {
+        Sra::Number serverKey;
+        Sra::fromHex(serverKey, keys.serverKey.constData(),
+                     keys.serverKey.size());
+        keys.desKey.resize(8);
+        Sra::commonKey(keys.secret, serverKey,
+                       reinterpret_cast<uchar *>(keys.desKey.data()));
+    }
+    if (!keys.publicKey.isEmpty())
+        sraKeyCache()->setKeys(host, keys);
+    const QByteArray secret(reinterpret_cast<const char *>(&keys.secret),
+                            sizeof(keys.secret));
+    QMutexLocker locker(&channel->mutex);
+    if (channel->receiver)
+        QMetaObject::invokeMethod(channel->receiver, "jobFinished",
+                                  Qt::QueuedConnection,
+                                  Q_ARG(int, serial),
+                                  Q_ARG(QByteArray, secret),
+                                  Q_ARG(QByteArray, keys.publicKey),
+                                  Q_ARG(QByteArray, keys.desKey));
+}
+
+class QtTelnetSraAuthenticatorPrivate : public QObject
+{
+    Q_OBJECT
+public:
+    enum Step { Idle, MakingKeys, KeySent, DerivingKey, WaitingForUser,
+                UserSent, PasswordSent };
+
+    // A child of the authenticator, so that QtTelnet's waiting
+    // functions deliver the queued results of the jobs
+    QtTelnetSraAuthenticatorPrivate(QtTelnetSraAuthenticator *parent)
+        : QObject(parent), q(parent), step(Idle), serial(0),
+          channel(new QtTelnetSraChannel(this))
+    {}
+    ~QtTelnetSraAuthenticatorPrivate();
+
+    QtTelnetSraAuthenticator *q;
+    Step step;
+    int serial; // Of the current connection; stale jobs are ignored
+    QString host;
+    QtTelnetSraKeys keys;
+    QSharedPointer<QtTelnetSraChannel> channel;
+
+    void startJob(Step next);
+    void sendKey();
+    void sendUser();
+
+public slots:
+    void jobFinished(int serial, const QByteArray &secret,
+                     const QByteArray &publicKey, const QByteArray &desKey);
+};
+
+/*
+  Jobs still running finish on their own and are deleted by the pool;
+  their results are dropped.
+*/
+QtTelnetSraAuthenticatorPrivate::~QtTelnetSraAuthenticatorPrivate()
+{
+    QMutexLocker locker(&channel->mutex);
+    channel->receiver = 0;
+}
+
+/*
+  Runs the exchange step that leads to \a next on a pool thread.
+*/
+void QtTelnetSraAuthenticatorPrivate::startJob(Step next)
+{
+    step = next;
+    QThreadPool::globalInstance()->start(
+        new QtTelnetSraJob(channel, serial, host, keys));
+}
+
+void QtTelnetSraAuthenticatorPrivate::jobFinished(int jobserial,
+                                                  const QByteArray &secret,
+                                                  const QByteArray &publicKey,
+                                                  const QByteArray &desKey)
+{
+    if (jobserial != serial)
+        return;
+    if (step == MakingKeys) {
+        if (publicKey.isEmpty()) { // No random source
+            step = Idle;
+            q->setFailed();
+            return;
+        }
+        memcpy(&keys.secret, secret.constData(), sizeof(keys.secret));
+        keys.publicKey = publicKey;
+        sendKey();
+    } else if (step == DerivingKey) {
+        keys.desKey = desKey;
+        sendUser();
+    }
+}
+
+void QtTelnetSraAuthenticatorPrivate::sendKey()
+{
+    step = KeySent;
+    q->send(SraMessage::Key + keys.publicKey);
+}
+
+/*
+  Sends the user name, or waits for QtTelnet::login() if there is
+  none yet.
+*/
+void QtTelnetSraAuthenticatorPrivate::sendUser()
+{
+    const QString user = q->userName();
+    if (user.isEmpty()) {
+        step = WaitingForUser;
+        return;
+    }
+    step = UserSent;
+    const uchar *key = reinterpret_cast<const uchar *>(keys.desKey.constData());
+    q->send(SraMessage::User + sraEncode(user.toUtf8(), key));
+}
+
+/*!
+    Constructs an SRA authenticator with the given \a parent.
+*/
+QtTelnetSraAuthenticator::QtTelnetSraAuthenticator(QObject *parent)
+    : QtTelnetAuthenticator(6, 0, parent), // SRA, CLIENT|ONE-WAY
+      d(new QtTelnetSraAuthenticatorPrivate(this))
+{
+}
+
+/*!
+    Destroys the authenticator. Exchange steps still running on the
+    thread pool finish on their own and are ignored.
+*/
+QtTelnetSraAuthenticator::~QtTelnetSraAuthenticator()
+{
+    delete d;
+}
+
+/*!
+    Discards the keys cached for all servers. The next connection to
+    each server makes a new key pair.
+*/
+void QtTelnetSraAuthenticator::clearKeyCache()
+{
+    sraKeyCache()->clear();
+}
+
+/*!
+    \reimp
+
+    Sends our public key, from the cache or once it has been made.
+*/
+void QtTelnetSraAuthenticator::start()
+{
+    QTcpSocket *socket = telnet() ? telnet()->socket() : 0;
+    d->host.clear();
+    if (socket) {
+        d->host = socket->peerName();
+        if (d->host.isEmpty())
+            d->host = socket->peerAddress().toString();
+        d->host += QLatin1Char(':') + QString::number(socket->peerPort());
+    }
+    if (sraKeyCache()->keys(d->host, &d->keys)) {
+        d->sendKey();
+    } else {
+        d->keys = QtTelnetSraKeys();
+        d->startJob(QtTelnetSraAuthenticatorPrivate::MakingKeys);
+    }
+}
+
+/*!
+    \reimp
+*/
+void QtTelnetSraAuthenticator::receive(const QByteArray &data)
+{
+    if (data.isEmpty())
+        return;
+    switch (data.at(0)) {
+    case SraMessage::Key:
+        if (d->step != QtTelnetSraAuthenticatorPrivate::KeySent)
+            break;
+        if (data.size() < 1 + Sra::KeyHexDigits) {
+            setFailed();
+            break;
+        }
+        if (data.mid(1, Sra::KeyHexDigits) == d->keys.serverKey
+            && !d->keys.desKey.isEmpty()) {
+            d->sendUser();
+        } else {
+            d->keys.serverKey = data.mid(1, Sra::KeyHexDigits);
+            d->keys.desKey.clear();
+            d->startJob(QtTelnetSraAuthenticatorPrivate::DerivingKey);
+        }
+        break;
+    case SraMessage::Continue:
+        if (d->step == QtTelnetSraAuthenticatorPrivate::UserSent) {
+            const uchar *key =
+                reinterpret_cast<const uchar *>(d->keys.desKey.constData());
+            d->step = QtTelnetSraAuthenticatorPrivate::PasswordSent;
+            send(SraMessage::Password + sraEncode(password().toUtf8(), key));
+        }
+        break;
+    case SraMessage::Accept:
+    case SraMessage::Reject:
+        // Only an answer to the password counts
+        if (d->step != QtTelnetSraAuthenticatorPrivate::PasswordSent)
+            break;
+        d->step = QtTelnetSraAuthenticatorPrivate::Idle;
+        if (data.at(0) == SraMessage::Accept)
+            setSucceeded();
+        else
+            setFailed();
+        break;
+    default:
+        break;
+    }
+}
+
+/*!
+    \reimp
+
+    Sends the user name if it was being waited for.
+*/
+void QtTelnetSraAuthenticator::credentialsChanged()
+{
+    if (d->step == QtTelnetSraAuthenticatorPrivate::WaitingForUser)
+        d->sendUser();
+}
+
+/*!
+    \reimp
+*/
+void QtTelnetSraAuthenticator::reset()
+{
+    ++d->serial;
+    d->step = QtTelnetSraAuthenticatorPrivate::Idle;
+    QtTelnetAuthenticator::reset();
+}
+
+#include "qttelnetsraauthenticator.moc"
@@ -0,0 +1,387 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+/*!
+    \class QtTelnetTrace
+    \brief The QtTelnetTrace class records the lifecycle events of
+    Telnet sessions for profiling.
+
+    When tracing is enabled with setEnabled(), QtTelnet records an
+    event for every step of a session: the start of the connection,
+    the host lookup, the TLS handshake, every option negotiation and
+    suboption sent or received, the login and password prompts, the
+    credentials sent, prompt matches, the login and the close.
+    QtTelnetServer records the option negotiations of its connections
+    too. writeChromeTrace() writes the events in the Chrome trace
+    event format, which can be loaded into Perfetto
+    (ui.perfetto.dev) or chrome://tracing to see where the time of a
+    slow login went. Each session appears as a track of its own; its
+    login span ends when the login succeeds, fails or is cut short by
+    the connection closing.
+
+    Events are kept in a ring buffer per thread, which holds the last
+    bufferSize() events recorded by the thread. Recording takes no
+    locks; the buffer of a thread is allocated when it records its
+    first event. The tracing calls are always compiled in, but while
+    tracing is disabled each of them is a single test of a flag.
+
+    Applications can record events of their own with the
+    QTTELNET_TRACE_BEGIN(), QTTELNET_TRACE_END(),
+    QTTELNET_TRACE_INSTANT() and QTTELNET_TRACE_VALUE() macros, which
+    take a category, a name and the address of the object the event
+    belongs to. The category and name must be string literals, or
+    otherwise outlive the trace, as only the pointers are recorded.
+*/
+
+#include "qttelnettrace.h"
+#include <QtCore/QAtomicInt>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QThreadStorage>
+
+QAtomicInt QtTelnetTrace::enabled;
+
+struct QtTelnetTraceEvent
+{
+    qint64 time; // In nanoseconds
+    const void *id;
+    const char *category;
+    const char *name;
+    const char *argname; // 0 if the event has no argument
+    qint64 arg;
+    int tid;
+    char phase;
+};
+
+/*
+  The events recorded by one thread. Only that thread writes them;
+  written counts the events that are complete, and is published with
+  release semantics after each one so that writeChromeTrace() can
+  read them without a lock.
+*/
+struct QtTelnetTraceRing
+{
+    QtTelnetTraceRing(int size)
+        : size(size), next(0), start(0), tid(0), retired(false),
+          events(new QtTelnetTraceEvent[size])
+    {}
+    ~QtTelnetTraceRing() { delete [] events; }
+
+    int size; // A power of two
+    quint32 next;
+    QAtomicInt written;
+    quint32 start; // Where the events begin after clear()
+    int tid;
+    bool retired; // The thread has finished, the ring can be reused
+    QtTelnetTraceEvent *events;
+};
+
+class QtTelnetTraceRegistry
+{
+public:
+    QtTelnetTraceRegistry() : buffersize(16384), nexttid(1) { clock.start(); }
+    ~QtTelnetTraceRegistry() { qDeleteAll(rings); }
+
+    QtTelnetTraceRing *acquire();
+
+    QMutex mutex;
+    QList<QtTelnetTraceRing *> rings;
+    QElapsedTimer clock;
+    int buffersize;
+    int nexttid;
+};
+
+Q_GLOBAL_STATIC(QtTelnetTraceRegistry, traceRegistry)
+
+/*
+  Returns a ring for the calling thread, reusing the ring of a thread
+  that has finished if there is one. Its events stay, tagged with the
+  id of the thread that recorded them.
+*/
+QtTelnetTraceRing *QtTelnetTraceRegistry::acquire()
+{
+    QMutexLocker locker(&mutex);
+    QtTelnetTraceRing *ring = 0;
+    for (int i = 0; i < rings.size() && !ring; ++i) {
+        if (rings.at(i)->retired && rings.at(i)->size == buffersize)
+            ring = rings.at(i);
+    }
+    if (!ring) {
+        ring = new QtTelnetTraceRing(buffersize);
+        rings.append(ring);
+    }
+    ring->retired = false;
+    ring->tid = nexttid++;
+    return ring;
+}
+
+/*
+  Hands the ring of a thread back when the thread finishes. The ring
+  itself is owned by the registry, since its events are still wanted.
+*/
+class QtTelnetTraceRingRef
+{
+public:
+    QtTelnetTraceRingRef(QtTelnetTraceRing *ring) : ring(ring) {}
+    ~QtTelnetTraceRingRef()
+    {
+        QtTelnetTraceRegistry *registry = traceRegistry();
+        if (!registry) // Destroyed at exit
+            return;
+        QMutexLocker locker(&registry->mutex);
+        ring->retired = true;
+    }
+
+    QtTelnetTraceRing *ring;
+};
+
+static QThreadStorage<QtTelnetTraceRingRef *> localRings;
+
+/*!
+    Enables tracing if \a enable is true; otherwise disables it.
+    Tracing is disabled by default.
+
+    The flag is atomic but read with relaxed ordering, so threads that
+    are busy may record a few more events after tracing has been
+    disabled, or miss a few after it has been enabled.
+
+    \sa isEnabled(), writeChromeTrace()
+*/
+void QtTelnetTrace::setEnabled(bool enable)
+{
+    if (enable)
+        traceRegistry(); // Start the clock
+    enabled.fetchAndStoreRelaxed(enable ? 1 : 0);
+}
+
+/*!
+    \fn bool QtTelnetTrace::isEnabled()
+
+    Returns true if tracing is enabled; otherwise returns false.
+
+    \sa setEnabled()
+*/
+
+/*!
+    Sets the number of events each thread keeps to \a events, rounded
+    up to a power of two. Once a thread has recorded that many events,
+    each new event replaces its oldest. The size applies to the threads
+    that record their first event after the call. The default is 16384
+    events, which take 1 MB.
+
+    \sa bufferSize()
+*/
+void QtTelnetTrace::setBufferSize(int events)
+{
+    int size = 256;
+    while (size < events && size < (1 << 24))
+        size <<= 1;
+    QtTelnetTraceRegistry *registry = traceRegistry();
+    QMutexLocker locker(&registry->mutex);
+    registry->buffersize = size;
+}
+
+/*!
+    Returns the number of events each thread keeps.
+
+    \sa setBufferSize()
+*/
+int QtTelnetTrace::bufferSize()
+{
+    QtTelnetTraceRegistry *registry = traceRegistry();
+    QMutexLocker locker(&registry->mutex);
+    return registry->buffersize;
+}
+
+/*!
+    Discards the events recorded so far.
+*/
+void QtTelnetTrace::clear()
+{
+    QtTelnetTraceRegistry *registry = traceRegistry();
+    QMutexLocker locker(&registry->mutex);
+    for (int i = 0; i < registry->rings.size(); ++i) {
+        QtTelnetTraceRing *ring = registry->rings.at(i);
+        ring->start = quint32(ring->written.fetchAndAddAcquire(0));
+    }
+}
+
+/*!
+    Records an event of the given \a phase, \a category and \a name
+    for the object at \a id, with the argument \a arg named \a argName
+    unless \a argName is 0. The phase is one of the event types of the
+    Chrome trace event format: 'b' and 'e' for the beginning and end
+    of a span, and 'n' for an instant. Events are recorded even if
+    tracing is disabled; use the QTTELNET_TRACE macros, which check
+    isEnabled() first.
+
+    Only the pointers \a category, \a name and \a argName are recorded,
+    so the strings must outlive the trace.
+*/
+void QtTelnetTrace::record(char phase, const char *category,
+                           const char *name, const void *id,
+                           const char *argName, qint64 arg)
+{
+    QtTelnetTraceRegistry *registry = traceRegistry();
+    if (!registry)
+        return;
+    if (!localRings.hasLocalData())
+        localRings.setLocalData(new QtTelnetTraceRingRef(registry->acquire()));
+    QtTelnetTraceRing *ring = localRings.localData()->ring;
+
+    QtTelnetTraceEvent &e = ring->events[ring->next & (ring->size - 1)];
+    e.time = registry->clock.nsecsElapsed();
+    e.id = id;
+    e.category = category;
+    e.name = name;
+    e.argname = argName;
+    e.arg = arg;
+    e.tid = ring->tid;
+    e.phase = phase;
+    ring->written.fetchAndStoreRelease(int(++ring->next));
+}
+
+static void appendJsonString(QByteArray &out, const char *str)
+{
+    out.append('"');
+    for (; *str; ++str) {
+        const uchar c = uchar(*str);
+        if (c == '"' || c == '\\') {
+            out.append('\\');
+            out.append(char(c));
+        } else if (c < 0x20) {
+            static const char digits[] = "0123456789abcdef";
+            out.append("\\u00");
+            out.append(digits[c >> 4]);
+            out.append(digits[c & 0xf]);
+        } else {
+            out.append(char(c));
+        }
+    }
+    out.append('"');
+}
+
+/*!
+    Writes the recorded events to \a device in the JSON format of the
+    Chrome trace event format. Returns true if all of it could be
+    written; otherwise returns false.
+
+    The events are read while other threads may still be recording.
+    Disable tracing first for a consistent trace: an event that is
+    overwritten while it is being written out may come out garbled.
+
+    \sa setEnabled()
+*/
+bool QtTelnetTrace::writeChromeTrace(QIODevice *device)
+{
+    QtTelnetTraceRegistry *registry = traceRegistry();
+    if (!registry || !device)
+        return false;
+    const QByteArray pid =
+        QByteArray::number(QCoreApplication::applicationPid());
+
+    QMutexLocker locker(&registry->mutex);
+    QByteArray out("{\"traceEvents\":[");
+    bool first = true;
+    for (int i = 0; i < registry->rings.size(); ++i) {
+        QtTelnetTraceRing *ring = registry->rings.at(i);
+        const quint32 written = quint32(ring->written.fetchAndAddAcquire(0));
+        quint32 begin = ring->start;
+        if (written - begin > quint32(ring->size))
+            begin = written - ring->size;
+        for (quint32 n = begin; n != written; ++n) {
+            const QtTelnetTraceEvent &e =
+                ring->events[n & (ring->size - 1)];
+            out.append(first ? "\n{\"name\":" : ",\n{\"name\":");
+            first = false;
+            appendJsonString(out, e.name);
+            out.append(",\"cat\":");
+            appendJsonString(out, e.category);
+            out.append(",\"ph\":\"");
+            out.append(e.phase);
+            out.append("\",\"ts\":");
+            out.append(QByteArray::number(double(e.time) / 1000, 'f', 3));
+            out.append(",\"pid\":");
+            out.append(pid);
+            out.append(",\"tid\":");
+            out.append(QByteArray::number(e.tid));
+            out.append(",\"id\":\"0x");
+            out.append(QByteArray::number(quintptr(e.id), 16));
+            out.append('"');
+            if (e.argname) {
+                out.append(",\"args\":{");
+                appendJsonString(out, e.argname);
+                out.append(':');
+                out.append(QByteArray::number(e.arg));
+                out.append('}');
+            }
+            out.append('}');
+            if (out.size() >= 65536) {
+                if (device->write(out) != out.size())
+                    return false;
+                out.clear();
+            }
+        }
+    }
+    out.append("\n],\"displayTimeUnit\":\"ms\"}\n");
+    return device->write(out) == out.size();
+}
+
+/*!
+    \overload
+
+    Writes the recorded events to the file \a fileName, replacing it.
+*/
+bool QtTelnetTrace::writeChromeTrace(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return writeChromeTrace(&file) && file.flush();
+}
@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+#ifndef QTTELNETTRACE_H
+#define QTTELNETTRACE_H
+
+#include "qttelnetglobal.h"
+#include <QtCore/QAtomicInt>
+
+class QIODevice;
+class QString;
+
+class QT_QTTELNET_EXPORT QtTelnetTrace
+{
+public:
+    static void setEnabled(bool enable);
+    static bool isEnabled()
+    {
+#if QT_VERSION >= 0x050e00
+        return enabled.loadRelaxed() != 0;
+#elif QT_VERSION >= 0x050000
+        return enabled.load() != 0;
+#else
+        return int(enabled) != 0;
+#endif
+    }
+    static void setBufferSize(int events);
+    static int bufferSize();
+    static void clear();
+
+    static bool writeChromeTrace(QIODevice *device);
+    static bool writeChromeTrace(const QString &fileName);
+
+    static void record(char phase, const char *category, const char *name,
+                       const void *id, const char *argName = 0,
+                       qint64 arg = 0);
+
+private:
+    static QAtomicInt enabled;
+};
+
+#define QTTELNET_TRACE_EVENT(phase, category, name, id, argName, arg) \
+    do { \
+        if (QtTelnetTrace::isEnabled()) \
+            QtTelnetTrace::record(phase, category, name, id, argName, arg); \
+    } while (0)
+
+#define QTTELNET_TRACE_BEGIN(category, name, id) \
+    QTTELNET_TRACE_EVENT('b', category, name, id, 0, 0)
+#define QTTELNET_TRACE_END(category, name, id) \
+    QTTELNET_TRACE_EVENT('e', category, name, id, 0, 0)
+#define QTTELNET_TRACE_INSTANT(category, name, id) \
+    QTTELNET_TRACE_EVENT('n', category, name, id, 0, 0)
+#define QTTELNET_TRACE_VALUE(category, name, id, argName, arg) \
+    QTTELNET_TRACE_EVENT('n', category, name, id, argName, arg)
+
+#endif
@@ -0,0 +1,561 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+/*!
+    \class QtTelnetTranscript
+    \brief The QtTelnetTranscript class records the data sent and
+    received by a QtTelnet session in memory-mapped segment files.
+
+    Set a transcript on a session with QtTelnet::setTranscript() to
+    record every byte the session sends and receives, including the
+    Telnet commands. Each chunk is stored as a record with a timestamp
+    and its direction.
+
+    The transcript is written to segment files named
+    \e{baseName.NNNNNN.tlog}, which are created at their full size,
+    segmentSize(), and mapped into memory. Appending a chunk copies it
+    into the mapping, which is all the work done on the thread of the
+    session; it allocates no memory. A background thread, shared by all
+    transcripts, prepares the next segment ahead of time, syncs the
+    data to disk every syncInterval() milliseconds, and closes full
+    segments, truncating them to the data they hold.
+
+    Each segment starts with the 8 bytes "QTTLOG" 0x01 0x00 followed by
+    the creation time as a 64-bit number of milliseconds since the
+    epoch. Records follow, each with a 16-byte header: the timestamp in
+    milliseconds since the epoch (64 bits), the length of the data (32
+    bits), the direction (8 bits) and 3 reserved bytes, followed by the
+    data. All numbers are in host byte order. A header that is all
+    zeros marks the end of the records. A record's header is written
+    after its data, so that a crash never leaves a partial record.
+*/
+
+#include "qttelnettranscript.h"
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QThread>
+#include <QtCore/QDateTime>
+#include <QtCore/QElapsedTimer>
+#include <string.h>
+
+#if defined(Q_OS_WIN)
+#  include <windows.h>
+#  include <io.h>
+#else
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+namespace Transcript
+{
+    const char Magic[8] = { 'Q', 'T', 'T', 'L', 'O', 'G', 1, 0 };
+    const int FileHeaderSize = 16;
+
+    struct RecordHeader
+    {
+        quint64 msecs;
+        quint32 length;
+        quint8 direction;
+        quint8 reserved[3];
+    };
+};
+
+struct QtTelnetTranscriptSegment
+{
+    QtTelnetTranscriptSegment() : file(0), map(0), used(0), synced(0) {}
+
+    QFile *file;
+    uchar *map;
+    qint64 used, synced;
+};
+
+class QtTelnetTranscriptPrivate
+{
+public:
+    typedef QtTelnetTranscriptSegment Segment;
+
+    QtTelnetTranscriptPrivate(const QString &name, qint64 size)
+        : basename(name), segmentsize(qMax(size, qint64(4096))),
+          syncinterval(1000), sequence(0), waiters(0), open(false),
+          failed(false)
+    {}
+
+    QString basename;
+    qint64 segmentsize;
+    int syncinterval;
+
+    QMutex mutex; // Guards everything below
+    QWaitCondition prepared;
+    QWaitCondition released; // Signalled when the last waiter has left
+    Segment current, next;
+    QList<Segment> retired;
+    int sequence;
+    int waiters; // Threads waiting in rotate()
+    bool open, failed;
+    QString error;
+    QElapsedTimer lastsync;
+
+    QString segmentName(int seq) const;
+    bool prepareSegment(Segment *segment, int seq, QString *errorString);
+    void syncSegment(const Segment &segment, qint64 from, qint64 to);
+    void finishSegment(Segment &segment);
+    bool rotate();
+    void service();
+};
+
+/*
+  The thread that does the disk work for all open transcripts.
+*/
+class QtTelnetTranscriptService : public QThread
+{
+public:
+    QtTelnetTranscriptService() : stopping(false), woken(false) {}
+    ~QtTelnetTranscriptService();
+
+    void add(QtTelnetTranscriptPrivate *transcript);
+    void remove(QtTelnetTranscriptPrivate *transcript);
+    void wake();
+
+protected:
+    void run();
+
+private:
+    QMutex listmutex; // Held while a transcript is serviced
+    QList<QtTelnetTranscriptPrivate *> transcripts;
+
+    // Separate from listmutex, since wake() is called with a
+    // transcript's mutex held
+    QMutex wakemutex;
+    QWaitCondition wakeup;
+    bool stopping, woken;
+};
+
+Q_GLOBAL_STATIC(QtTelnetTranscriptService, transcriptService)
+
+QtTelnetTranscriptService::~QtTelnetTranscriptService()
+{
+    wakemutex.lock();
+    stopping = true;
+    wakeup.wakeOne();
+    wakemutex.unlock();
+    wait();
+}
+
+void QtTelnetTranscriptService::add(QtTelnetTranscriptPrivate *transcript)
+{
+    listmutex.lock();
+    transcripts.append(transcript);
+    listmutex.unlock();
+    if (!isRunning())
+        start(QThread::LowPriority);
+    wake();
+}
+
+/*
+  Returns once \a transcript is no longer being serviced.
+*/
+void QtTelnetTranscriptService::remove(QtTelnetTranscriptPrivate *transcript)
+{
+    QMutexLocker locker(&listmutex);
+    transcripts.removeAll(transcript);
+}
+
+void QtTelnetTranscriptService::wake()
+{
+    QMutexLocker locker(&wakemutex);
+    woken = true;
+    wakeup.wakeOne();
+}
+
+void QtTelnetTranscriptService::run()
+{
+    forever {
+        int interval = 1000;
+        listmutex.lock();
+        for (int i = 0; i < transcripts.size(); ++i) {
+            transcripts.at(i)->service();
+            interval = qMin(interval, transcripts.at(i)->syncinterval);
+        }
+        listmutex.unlock();
+
+        QMutexLocker locker(&wakemutex);
+        if (stopping)
+            return;
+        if (!woken)
+            wakeup.wait(&wakemutex, qMax(10, interval));
+        woken = false;
+        if (stopping)
+            return;
+    }
+}
+
+QString QtTelnetTranscriptPrivate::segmentName(int seq) const
+{
+    return QString::fromLatin1("%1.%2.tlog").arg(basename)
+        .arg(seq, 6, 10, QLatin1Char('0'));
+}
+
+/*
+  Creates segment file number \a seq at its full size and maps it.
+*/
+bool QtTelnetTranscriptPrivate::prepareSegment(Segment *segment, int seq,
+                                               QString *errorString)
+{
+    QFile *file = new QFile(segmentName(seq));
+    if (!file->open(QIODevice::ReadWrite | QIODevice::Truncate)
+        || !file->resize(segmentsize)) {
+        *errorString = file->errorString();
+        delete file;
+        return false;
+    }
+    uchar *map = file->map(0, segmentsize);
+    if (!map) {
+        *errorString = file->errorString();
+        file->remove();
+        delete file;
+        return false;
+    }
+    const quint64 now = QDateTime::currentMSecsSinceEpoch();
+    memcpy(map, Transcript::Magic, sizeof(Transcript::Magic));
+    memcpy(map + sizeof(Transcript::Magic), &now, sizeof(now));
+    segment->file = file;
+    segment->map = map;
+    segment->used = Transcript::FileHeaderSize;
+    segment->synced = 0;
+    return true;
+}
+
+/*
+  Writes bytes \a from to \a to of \a segment to disk.
+*/
+void QtTelnetTranscriptPrivate::syncSegment(const Segment &segment,
+                                            qint64 from, qint64 to)
+{
+    if (!segment.map || to <= from)
+        return;
+#if defined(Q_OS_WIN)
+    FlushViewOfFile(segment.map + from, SIZE_T(to - from));
+    FlushFileBuffers(HANDLE(_get_osfhandle(segment.file->handle())));
+#else
+    static const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    const qint64 start = from - from % pageSize;
+    ::msync(segment.map + start, size_t(to - start), MS_SYNC);
+    ::fsync(segment.file->handle());
+#endif
+}
+
+/*
+  Syncs and closes a segment that is no longer written to, truncating
+  the file to the data it holds.
+*/
+void QtTelnetTranscriptPrivate::finishSegment(Segment &segment)
+{
+    if (!segment.file)
+        return;
+    syncSegment(segment, segment.synced, segment.used);
+    segment.file->unmap(segment.map);
+    segment.file->resize(segment.used);
+    segment.file->close();
+    delete segment.file;
+    segment = Segment();
+}
+
+/*
+  Retires the current segment and continues in the one prepared ahead
+  by the service thread, waiting for it if necessary. Returns false if
+  no segment could be prepared, or if the transcript was closed in the
+  meantime, since the service thread then no longer prepares any.
+  Called with the mutex held.
+*/
+bool QtTelnetTranscriptPrivate::rotate()
+{
+    ++waiters;
+    while (!next.map && !failed && open) {
+        transcriptService()->wake();
+        prepared.wait(&mutex);
+    }
+    if (--waiters == 0)
+        released.wakeAll();
+    if (!next.map || !open)
+        return false;
+    retired.append(current);
+    current = next;
+    next = Segment();
+    transcriptService()->wake();
+    return true;
+}
+
+/*
+  Called on the service thread: prepares the next segment, closes the
+  retired ones and syncs the current one when it is due.
+*/
+void QtTelnetTranscriptPrivate::service()
+{
+    mutex.lock();
+    if (!open) {
+        mutex.unlock();
+        return;
+    }
+    const bool neednext = !next.map && !failed;
+    const int last = sequence;
+    QList<Segment> done = retired;
+    retired.clear();
+    Segment cur = current;
+    const bool syncdue = !lastsync.isValid()
+        || lastsync.elapsed() >= syncinterval;
+    mutex.unlock();
+
+    if (neednext) {
+        // Skip the segment files left behind by earlier runs, as open()
+        // does, since preparing a segment truncates its file
+        int seq = last + 1;
+        while (QFile::exists(segmentName(seq)))
+            ++seq;
+        Segment segment;
+        QString errorString;
+        const bool ok = prepareSegment(&segment, seq, &errorString);
+        QMutexLocker locker(&mutex);
+        sequence = seq;
+        if (ok) {
+            next = segment;
+        } else {
+            failed = true;
+            error = errorString;
+        }
+        prepared.wakeAll();
+    }
+    for (int i = 0; i < done.size(); ++i)
+        finishSegment(done[i]);
+
+    // Only this thread unmaps segments, so the current one stays
+    // mapped while it is synced without the mutex held.
+    if (syncdue && cur.map && cur.used > cur.synced) {
+        syncSegment(cur, cur.synced, cur.used);
+        QMutexLocker locker(&mutex);
+        if (current.map == cur.map)
+            current.synced = cur.used;
+        lastsync.start();
+    } else if (syncdue) {
+        QMutexLocker locker(&mutex);
+        lastsync.start();
+    }
+}
+
+/*!
+    Constructs a transcript that writes to segment files named after
+    \a baseName, each \a segmentSize bytes large. The transcript must be
+    opened with open() before it records anything.
+*/
+QtTelnetTranscript::QtTelnetTranscript(const QString &baseName,
+                                       qint64 segmentSize)
+    : d(new QtTelnetTranscriptPrivate(baseName, segmentSize))
+{
+}
+
+/*!
+    Closes the transcript and destroys it.
+
+    \sa close()
+*/
+QtTelnetTranscript::~QtTelnetTranscript()
+{
+    close();
+    delete d;
+}
+
+/*!
+    Returns the base name of the segment files.
+*/
+QString QtTelnetTranscript::baseName() const
+{
+    return d->basename;
+}
+
+/*!
+    Returns the size of a segment file in bytes.
+*/
+qint64 QtTelnetTranscript::segmentSize() const
+{
+    return d->segmentsize;
+}
+
+/*!
+    Sets the interval at which the recorded data is synced to disk to
+    \a msecs milliseconds. The default is 1000 milliseconds.
+*/
+void QtTelnetTranscript::setSyncInterval(int msecs)
+{
+    QMutexLocker locker(&d->mutex);
+    d->syncinterval = qMax(10, msecs);
+}
+
+/*!
+    Returns the interval at which the recorded data is synced to disk.
+*/
+int QtTelnetTranscript::syncInterval() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->syncinterval;
+}
+
+/*!
+    Creates the first segment file and starts recording. Numbering
+    continues after the segment files already present for the base
+    name. Returns false if the segment could not be created; see
+    errorString().
+*/
+bool QtTelnetTranscript::open()
+{
+    QMutexLocker locker(&d->mutex);
+    if (d->open)
+        return true;
+    int seq = d->sequence + 1;
+    while (QFile::exists(d->segmentName(seq)))
+        ++seq;
+    QString errorString;
+    if (!d->prepareSegment(&d->current, seq, &errorString)) {
+        d->error = errorString;
+        return false;
+    }
+    d->sequence = seq;
+    d->open = true;
+    d->failed = false;
+    d->error.clear();
+    locker.unlock();
+    transcriptService()->add(d);
+    return true;
+}
+
+/*!
+    Stops recording, syncs all recorded data to disk and closes the
+    segment files.
+*/
+void QtTelnetTranscript::close()
+{
+    if (!isOpen())
+        return;
+    transcriptService()->remove(d);
+    QMutexLocker locker(&d->mutex);
+    d->open = false;
+    for (int i = 0; i < d->retired.size(); ++i)
+        d->finishSegment(d->retired[i]);
+    d->retired.clear();
+    d->finishSegment(d->current);
+    if (d->next.file) { // Prepared but never used
+        d->next.file->unmap(d->next.map);
+        d->next.file->remove();
+        delete d->next.file;
+        d->next = QtTelnetTranscriptSegment();
+    }
+    d->prepared.wakeAll();
+    // Threads blocked in append() must be gone before the destructor
+    // deletes d
+    while (d->waiters > 0)
+        d->released.wait(&d->mutex);
+}
+
+/*!
+    Returns true if the transcript is recording; otherwise returns
+    false.
+*/
+bool QtTelnetTranscript::isOpen() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->open;
+}
+
+/*!
+    Returns a description of the last error, e.g. why a segment file
+    could not be created.
+*/
+QString QtTelnetTranscript::errorString() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->error;
+}
+
+/*!
+    Records \a length bytes at \a data sent in \a direction. Chunks that
+    do not fit in the current segment are split across segments. If no
+    new segment can be created, the data is dropped and errorString()
+    describes the problem.
+
+    This function is thread-safe.
+*/
+void QtTelnetTranscript::append(Direction direction, const char *data,
+                                int length)
+{
+    if (length <= 0)
+        return;
+    QMutexLocker locker(&d->mutex);
+    if (!d->open)
+        return;
+
+    const quint64 now = QDateTime::currentMSecsSinceEpoch();
+    const qint64 headerSize = sizeof(Transcript::RecordHeader);
+    while (length > 0) {
+        const qint64 room = d->segmentsize - d->current.used - headerSize;
+        if (room <= 0) {
+            if (!d->rotate())
+                return;
+            continue;
+        }
+        const int n = int(qMin(room, qint64(length)));
+        uchar *p = d->current.map + d->current.used;
+        Transcript::RecordHeader header;
+        memset(&header, 0, sizeof(header));
+        header.msecs = now;
+        header.length = quint32(n);
+        header.direction = quint8(direction);
+        memcpy(p + headerSize, data, n);
+        memcpy(p, &header, sizeof(header));
+        d->current.used += headerSize + n;
+        data += n;
+        length -= n;
+    }
+}
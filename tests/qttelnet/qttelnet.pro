@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = tst_qttelnet
+CONFIG += console testcase
+CONFIG -= app_bundle
+QT -= gui
+QT += testlib
+
+include(../../src/qttelnet.pri)
+
+SOURCES += tst_qttelnet.cpp
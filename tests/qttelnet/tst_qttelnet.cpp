@@ -0,0 +1,532 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+
+/*
+  Tests for QtTelnet and QtTelnetServer. The sessions talk to a plain
+  QTcpServer in the same process, which writes the server's side of
+  the protocol byte by byte where the split matters, or to a
+  QtTelnetServer.
+*/
+
+#include "qttelnet.h"
+#include "qttelnetserver.h"
+#include "qttelnet_p.h"
+#include <QtTest/QtTest>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QTextCodec>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#ifdef Q_OS_UNIX
+#  include <sys/types.h>
+#  include <sys/socket.h>
+#endif
+
+#ifndef QTRY_VERIFY
+#  define QTRY_VERIFY(expr) \
+    do { \
+        for (int i = 0; i < 500 && !(expr); ++i) \
+            QTest::qWait(10); \
+        QVERIFY(expr); \
+    } while (0)
+#endif
+
+#if QT_VERSION >= 0x050000
+#  define SKIP(message) QSKIP(message)
+#else
+#  define SKIP(message) QSKIP(message, SkipSingle)
+#endif
+
+/*
+  Reads from \a socket into \a buffer until it contains \a wanted.
+  Returns false if that does not happen within \a msecs.
+*/
+static bool waitForBytes(QTcpSocket *socket, QByteArray *buffer,
+                         const QByteArray &wanted, int msecs = 5000)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!buffer->contains(wanted)) {
+        if (timer.elapsed() > msecs)
+            return false;
+        QTest::qWait(10);
+        buffer->append(socket->readAll());
+    }
+    return true;
+}
+
+/*
+  Writes \a data and waits until the session has had the chance to
+  read it, so that the next write arrives in a read of its own.
+*/
+static void writeSeparately(QTcpSocket *socket, const QByteArray &data)
+{
+    socket->write(data);
+    socket->flush();
+    QTest::qWait(50);
+}
+
+/*
+  Records what qtTelnetScan() finds. Data bytes are logged one at a
+  time, so that the log does not depend on how runs of data are cut.
+*/
+struct ScanLog
+{
+    QByteArray log;
+
+    void telnetData(const char *data, int length)
+    {
+        for (int i = 0; i < length; ++i)
+            log += 'd' + QByteArray(1, data[i]);
+    }
+    void telnetCommand(uchar command)
+    {
+        log += 'c' + QByteArray::number(command) + ';';
+    }
+    void telnetOption(uchar operation, uchar option)
+    {
+        log += 'o' + QByteArray::number(operation) + ','
+            + QByteArray::number(option) + ';';
+    }
+    void telnetSubOption(const char *data, int length)
+    {
+        log += 's' + QByteArray(data, length).toHex() + ';';
+    }
+};
+
+class tst_QtTelnet : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void appendText(const QString &text) { received += text; }
+    void appendLine(const QByteArray &line) { lines.append(line); }
+    void appendError(QAbstractSocket::SocketError error)
+    { errors.append(error); }
+
+private slots:
+    void init();
+    void cleanup();
+
+    void parallelConnect();
+    void connectTimeout();
+    void scanSplit();
+    void scanIncomplete();
+    void splitNegotiation();
+    void serverNegotiation();
+    void sync();
+    void syncMarkReadFirst();
+    void utf8Split();
+    void lineModeAck();
+    void lineModeEditing();
+    void status();
+    void splitSubOption();
+    void newEnviron();
+    void lineFraming();
+
+private:
+    QTcpSocket *connectSession(QtTelnet *telnet);
+
+    QTcpServer *listener;
+    QString received;
+    QList<QByteArray> lines;
+    QList<QAbstractSocket::SocketError> errors;
+};
+
+void tst_QtTelnet::init()
+{
+    listener = new QTcpServer(this);
+    received.clear();
+    lines.clear();
+    errors.clear();
+}
+
+void tst_QtTelnet::cleanup()
+{
+    delete listener;
+    listener = 0;
+}
+
+/*
+  Connects \a telnet to the listener and returns the server's end of
+  the connection, or 0 on failure. The session's own option requests
+  are read and dropped.
+*/
+QTcpSocket *tst_QtTelnet::connectSession(QtTelnet *telnet)
+{
+    if (!listener->listen(QHostAddress::LocalHost))
+        return 0;
+    connect(telnet, SIGNAL(message(QString)),
+            this, SLOT(appendText(QString)));
+    connect(telnet, SIGNAL(connectionError(QAbstractSocket::SocketError)),
+            this, SLOT(appendError(QAbstractSocket::SocketError)));
+    telnet->connectToHost(QLatin1String("127.0.0.1"),
+                          listener->serverPort());
+    if (!listener->waitForNewConnection(5000))
+        return 0;
+    QTcpSocket *socket = listener->nextPendingConnection();
+    for (int i = 0; i < 500 && !telnet->isConnected(); ++i)
+        QTest::qWait(10);
+    if (!telnet->isConnected())
+        return 0;
+    QTest::qWait(50);
+    socket->readAll();
+    return socket;
+}
+
+void tst_QtTelnet::parallelConnect()
+{
+    // localhost may resolve to ::1 first, where nobody listens
+    QVERIFY(listener->listen(QHostAddress::LocalHost));
+    QtTelnet telnet;
+    connect(&telnet, SIGNAL(connectionError(QAbstractSocket::SocketError)),
+            this, SLOT(appendError(QAbstractSocket::SocketError)));
+    telnet.setParallelConnectEnabled(true);
+    telnet.setConnectTimeout(5000);
+    telnet.connectToHost(QLatin1String("localhost"),
+                         listener->serverPort());
+    QVERIFY(listener->waitForNewConnection(5000));
+    QTRY_VERIFY(telnet.isConnected());
+    QVERIFY(errors.isEmpty());
+}
+
+void tst_QtTelnet::connectTimeout()
+{
+    QtTelnet telnet;
+    connect(&telnet, SIGNAL(connectionError(QAbstractSocket::SocketError)),
+            this, SLOT(appendError(QAbstractSocket::SocketError)));
+    telnet.setConnectTimeout(300);
+    QElapsedTimer timer;
+    timer.start();
+    // TEST-NET-1 (RFC5737), which nothing answers
+    telnet.connectToHost(QLatin1String("192.0.2.1"), 23);
+    QTRY_VERIFY(!errors.isEmpty());
+    if (errors.first() != QAbstractSocket::SocketTimeoutError)
+        SKIP("The network refuses the connection attempt at once");
+    QVERIFY(timer.elapsed() < 3000);
+    QCOMPARE(errors.size(), 1);
+    QVERIFY(!telnet.isConnected());
+}
+
+void tst_QtTelnet::scanSplit()
+{
+    static const char data[] = "ab\xff\xff" "c\xff\xfb\x03"
+                               "\xff\xfa\x18\x01\xff\xff\xff\xf0"
+                               "\xff\xf9z";
+    const QByteArray stream(data, sizeof(data) - 1);
+    ScanLog whole;
+    QCOMPARE(qtTelnetScan(&whole, stream.constData(), stream.size()),
+             stream.size());
+    QCOMPARE(whole.log, QByteArray("dadbd\xff" "dco251,3;s1801ffff;c249;dz"));
+
+    // Any split must give the same result once the rest has arrived
+    for (int split = 0; split <= stream.size(); ++split) {
+        ScanLog parts;
+        const QByteArray first = stream.left(split);
+        const int used = qtTelnetScan(&parts, first.constData(),
+                                      first.size());
+        QVERIFY(used <= split);
+        const QByteArray rest = first.mid(used) + stream.mid(split);
+        QCOMPARE(qtTelnetScan(&parts, rest.constData(), rest.size()),
+                 rest.size());
+        QCOMPARE(parts.log, whole.log);
+    }
+}
+
+void tst_QtTelnet::scanIncomplete()
+{
+    ScanLog scan;
+    QCOMPARE(qtTelnetScan(&scan, "\xff", 1), 0);
+    QCOMPARE(qtTelnetScan(&scan, "\xff\xfd", 2), 0);
+    QCOMPARE(qtTelnetScan(&scan, "\xff\xfa\x18\x01", 4), 0);
+    QCOMPARE(qtTelnetScan(&scan, "\xff\xfa\x18\x01\xff", 5), 0);
+    QCOMPARE(qtTelnetScan(&scan, "x\xff\xfd", 3), 1);
+    QCOMPARE(scan.log, QByteArray("dx"));
+}
+
+void tst_QtTelnet::splitNegotiation()
+{
+    QtTelnet telnet;
+    QTcpSocket *server = connectSession(&telnet);
+    QVERIFY(server);
+
+    // IAC DO ECHO, one byte per read; ECHO is always refused
+    writeSeparately(server, QByteArray("\xff", 1));
+    writeSeparately(server, QByteArray("\xfd", 1));
+    writeSeparately(server, QByteArray("\x01", 1));
+    QByteArray reply;
+    QVERIFY(waitForBytes(server, &reply, QByteArray("\xff\xfc\x01", 3)));
+    QVERIFY(!telnet.isOptionEnabled(1));
+}
+
+void tst_QtTelnet::serverNegotiation()
+{
+    QtTelnetServer server;
+    server.setOptions(QtTelnetServer::SuppressGoAhead
+                      | QtTelnetServer::WindowSize
+                      | QtTelnetServer::TerminalType);
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+
+    QtTelnet telnet;
+    telnet.setWindowSize(100, 40);
+    telnet.setTerminalTypes(QStringList() << QLatin1String("XTERM"));
+    telnet.connectToHost(QLatin1String("127.0.0.1"), server.serverPort());
+    QTRY_VERIFY(server.hasPendingConnections());
+    QtTelnetServerConnection *connection = server.nextPendingConnection();
+    QVERIFY(connection);
+
+    QTRY_VERIFY(connection->windowSize() == QSize(100, 40));
+    QTRY_VERIFY(connection->terminalType() == QLatin1String("XTERM"));
+    QTRY_VERIFY(telnet.isOptionEnabled(3, QtTelnet::RemoteSide));
+    QVERIFY(connection->isOptionEnabled(3));
+    delete connection;
+}
+
+void tst_QtTelnet::sync()
+{
+#ifndef Q_OS_UNIX
+    SKIP("Sending urgent data needs BSD sockets");
+#else
+    QtTelnet telnet;
+    QTcpSocket *server = connectSession(&telnet);
+    QVERIFY(server);
+
+    // The Data Mark goes out as urgent data, the rest in band. All of
+    // it is sent before the session gets to read any of it.
+    const int fd = int(server->socketDescriptor());
+    QCOMPARE(int(::send(fd, "junk", 4, 0)), 4);
+    QCOMPARE(int(::send(fd, "\xff\xf2", 2, MSG_OOB)), 2);
+    QCOMPARE(int(::send(fd, "after\r\n", 7, 0)), 7);
+    QTRY_VERIFY(received.contains(QLatin1String("after")));
+    QVERIFY(!received.contains(QLatin1String("junk")));
+
+    // Discarding must have ended at the mark
+    writeSeparately(server, "more\r\n");
+    QTRY_VERIFY(received.contains(QLatin1String("more")));
+#endif
+}
+
+void tst_QtTelnet::syncMarkReadFirst()
+{
+#ifndef Q_OS_UNIX
+    SKIP("Sending urgent data needs BSD sockets");
+#else
+    QtTelnet telnet;
+    QTcpSocket *server = connectSession(&telnet);
+    QVERIFY(server);
+
+    // The IAC is read on its own, so the Data Mark is the first byte
+    // of the next read, and that read takes it along with the text
+    // after it before the urgent notification is handled
+    writeSeparately(server, "before\r\n\xff");
+    QTRY_VERIFY(received.contains(QLatin1String("before")));
+    const int fd = int(server->socketDescriptor());
+    QCOMPARE(int(::send(fd, "\xf2", 1, MSG_OOB)), 1);
+    QCOMPARE(int(::send(fd, "after\r\n", 7, 0)), 7);
+    QTRY_VERIFY(received.contains(QLatin1String("after")));
+
+    // Nothing is discarded waiting for a mark that was already read
+    writeSeparately(server, "more\r\n");
+    QTRY_VERIFY(received.contains(QLatin1String("more")));
+#endif
+}
+
+void tst_QtTelnet::utf8Split()
+{
+    QtTelnet telnet;
+    telnet.setTextCodec(QTextCodec::codecForName("UTF-8"));
+    QTcpSocket *server = connectSession(&telnet);
+    QVERIFY(server);
+
+    writeSeparately(server, "caf\xc3");
+    writeSeparately(server, "\xa9\r\n");
+    const QString expected = QString::fromUtf8("caf\xc3\xa9");
+    QTRY_VERIFY(received.contains(expected));
+    QVERIFY(!received.contains(QChar(0xfffd)));
+}
+
+void tst_QtTelnet::lineModeAck()
+{
+    QtTelnet telnet;
+    QTcpSocket *server = connectSession(&telnet);
+    QVERIFY(server);
+
+    // MODE EDIT|TRAPSIG|SOFT_TAB: only EDIT and TRAPSIG are acked
+    writeSeparately(server, QByteArray("\xff\xfd\x22", 3));
+    writeSeparately(server, QByteArray("\xff\xfa\x22\x01\x0b\xff\xf0", 7));
+    QByteArray reply;
+    QVERIFY(waitForBytes(server, &reply,
+                         QByteArray("\xff\xfa\x22\x01\x07\xff\xf0", 7)));
+
+    // An acknowledgement is not answered
+    reply.clear();
+    writeSeparately(server, QByteArray("\xff\xfa\x22\x01\x07\xff\xf0", 7));
+    reply += server->readAll();
+    QVERIFY(!reply.contains(QByteArray("\xff\xfa\x22\x01", 4)));
+}
+
+void tst_QtTelnet::lineModeEditing()
+{
+    QtTelnet telnet;
+    QTcpSocket *server = connectSession(&telnet);
+    QVERIFY(server);
+
+    writeSeparately(server, QByteArray("\xff\xfd\x22", 3));
+    writeSeparately(server, QByteArray("\xff\xfa\x22\x01\x01\xff\xf0", 7));
+    QByteArray reply;
+    QVERIFY(waitForBytes(server, &reply,
+                         QByteArray("\xff\xfa\x22\x01\x05\xff\xf0", 7)));
+
+    // DEL is EC by default
+    reply.clear();
+    telnet.sendData(QLatin1String("xy\x7fz\r\n"));
+    QVERIFY(waitForBytes(server, &reply, "xz\r\n"));
+
+    // EC at the NOSUPPORT level unbinds it, flush bits or not
+    writeSeparately(server,
+                    QByteArray("\xff\xfa\x22\x03\x0a\x20\x7f\xff\xf0", 9));
+    reply.clear();
+    telnet.sendData(QLatin1String("xy\x7fz\r\n"));
+    QVERIFY(waitForBytes(server, &reply, "xy\x7fz\r\n"));
+}
+
+void tst_QtTelnet::status()
+{
+    QtTelnet telnet;
+    QTcpSocket *server = connectSession(&telnet);
+    QVERIFY(server);
+
+    writeSeparately(server, QByteArray("\xff\xfb\x05", 3));
+    QTRY_VERIFY(telnet.isOptionEnabled(5, QtTelnet::RemoteSide));
+    QVERIFY(!telnet.hasPeerStatus());
+
+    telnet.requestStatus();
+    QByteArray reply;
+    QVERIFY(waitForBytes(server, &reply,
+                         QByteArray("\xff\xfa\x05\x01\xff\xf0", 6)));
+    // IS WILL SGA DO NAWS
+    writeSeparately(server,
+                    QByteArray("\xff\xfa\x05\x00\xfb\x03\xfd\x1f\xff\xf0",
+                               10));
+    QTRY_VERIFY(telnet.hasPeerStatus());
+    QVERIFY(telnet.isPeerOptionEnabled(3, QtTelnet::RemoteSide));
+    QVERIFY(telnet.isPeerOptionEnabled(31, QtTelnet::LocalSide));
+    QVERIFY(!telnet.isPeerOptionEnabled(3, QtTelnet::LocalSide));
+    QVERIFY(!telnet.isPeerOptionEnabled(24, QtTelnet::RemoteSide));
+}
+
+void tst_QtTelnet::splitSubOption()
+{
+    QtTelnet telnet;
+    telnet.setTerminalTypes(QStringList() << QLatin1String("VT100"));
+    QTcpSocket *server = connectSession(&telnet);
+    QVERIFY(server);
+
+    QByteArray reply;
+    writeSeparately(server, QByteArray("\xff\xfd\x18", 3));
+    QVERIFY(waitForBytes(server, &reply, QByteArray("\xff\xfb\x18", 3)));
+    writeSeparately(server, QByteArray("\xff\xfa\x18", 3));
+    writeSeparately(server, QByteArray("\x01\xff", 2));
+    writeSeparately(server, QByteArray("\xf0", 1));
+    QVERIFY(waitForBytes(server, &reply,
+                         QByteArray("\xff\xfa\x18\x00VT100\xff\xf0", 11)));
+}
+
+void tst_QtTelnet::newEnviron()
+{
+    QtTelnet telnet;
+    telnet.setEnvironmentVariable(QLatin1String("USER"),
+                                  QLatin1String("joe"));
+    telnet.setEnvironmentVariable(QLatin1String("FOO"),
+                                  QLatin1String("bar"));
+    QTcpSocket *server = connectSession(&telnet);
+    QVERIFY(server);
+
+    writeSeparately(server, QByteArray("\xff\xfd\x27", 3));
+    QTRY_VERIFY(telnet.isOptionEnabled(39));
+
+    // SEND with no names asks for all variables
+    writeSeparately(server, QByteArray("\xff\xfa\x27\x01\xff\xf0", 6));
+    QByteArray reply;
+    QVERIFY(waitForBytes(server, &reply,
+                         QByteArray("\xff\xfa\x27\x00"
+                                    "\x03" "FOO" "\x01" "bar"
+                                    "\x00" "USER" "\x01" "joe"
+                                    "\xff\xf0", 23)));
+
+    // A named request gets only that variable
+    reply.clear();
+    writeSeparately(server,
+                    QByteArray("\xff\xfa\x27\x01\x00USER\xff\xf0", 11));
+    QVERIFY(waitForBytes(server, &reply,
+                         QByteArray("\xff\xfa\x27\x00"
+                                    "\x00" "USER" "\x01" "joe"
+                                    "\xff\xf0", 15)));
+}
+
+void tst_QtTelnet::lineFraming()
+{
+    QtTelnet telnet;
+    telnet.setLineFramingEnabled(true);
+    connect(&telnet, SIGNAL(lineReceived(QByteArray)),
+            this, SLOT(appendLine(QByteArray)));
+    QTcpSocket *server = connectSession(&telnet);
+    QVERIFY(server);
+
+    // Lines and CR LF pairs cut across reads; the lines must also
+    // still hold their data once the reads are gone
+    writeSeparately(server, "one\r");
+    writeSeparately(server, "\ntwo\npar");
+    writeSeparately(server, "tial\r\n");
+    QTRY_VERIFY(lines.size() >= 3);
+    QCOMPARE(lines.size(), 3);
+    QCOMPARE(lines.at(0), QByteArray("one"));
+    QCOMPARE(lines.at(1), QByteArray("two"));
+    QCOMPARE(lines.at(2), QByteArray("partial"));
+}
+
+QTEST_MAIN(tst_QtTelnet)
+#include "tst_qttelnet.moc"
@@ -0,0 +1,208 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+/*
+  Counts the heap allocations QtTelnet makes while handling reads in
+  a steady-state session, i.e. after negotiation. A local server
+  streams text with embedded Telnet commands; only the allocations
+  made inside QtTelnet's readyRead() handler are counted.
+
+  By default nothing is connected to message(), so the text is never
+  decoded, and the tool exits with status 1 if there were any
+  allocations at all. The zero allocation guarantee only covers this
+  path. With -m a receiver is connected to message(), and each
+  emitted message needs the QString passed to it; the tool then exits
+  with status 1 if there were more allocations than messages.
+
+  Counting works by interposing malloc() and friends, so this tool
+  requires glibc.
+*/
+
+#include "qttelnet.h"
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTimer>
+#include <QtCore/QStringList>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <stdio.h>
+#include <stddef.h>
+
+static __thread bool counting = false;
+static long allocations = 0;
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    if (counting)
+        ++allocations;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    if (counting)
+        ++allocations;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (counting)
+        ++allocations;
+    return __libc_realloc(ptr, size);
+}
+}
+
+class AllocationCheck : public QObject
+{
+    Q_OBJECT
+public:
+    AllocationCheck(int warmup, int reads, bool receiver)
+        : warmup(warmup), reads(reads), seen(0), messages(0), peer(0)
+    {
+        if (receiver)
+            connect(&telnet, SIGNAL(message(QString)),
+                    this, SLOT(messageReceived()));
+    }
+
+    bool start()
+    {
+        if (!server.listen(QHostAddress::LocalHost))
+            return false;
+        connect(&server, SIGNAL(newConnection()), this, SLOT(accepted()));
+        connect(&timer, SIGNAL(timeout()), this, SLOT(sendBlock()));
+
+        // Count only what happens between these two slots, which
+        // surround QtTelnet's own readyRead() handler.
+        QTcpSocket *socket = new QTcpSocket;
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readStarted()));
+        telnet.setSocket(socket);
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readFinished()));
+        telnet.connectToHost(QLatin1String("127.0.0.1"), server.serverPort());
+
+        // Text lines with the commands a quiet session typically sees
+        const char nop[2] = { char(255), char(241) };
+        const char ga[2] = { char(255), char(249) };
+        for (int i = 0; i < 64; ++i) {
+            block.append("The quick brown fox jumps over the lazy dog. "
+                         "0123456789 ABCDEFGHIJ\r\n");
+            if (i % 16 == 0)
+                block.append(nop, sizeof(nop));
+        }
+        block.append("prompt> ");
+        block.append(ga, sizeof(ga));
+        return true;
+    }
+
+private slots:
+    void accepted()
+    {
+        peer = server.nextPendingConnection();
+        timer.start(1);
+    }
+
+    void sendBlock()
+    {
+        peer->write(block);
+    }
+
+    void readStarted()
+    {
+        counting = (seen >= warmup);
+    }
+
+    void messageReceived()
+    {
+        if (counting)
+            ++messages;
+    }
+
+    void readFinished()
+    {
+        counting = false;
+        if (++seen < warmup + reads)
+            return;
+        timer.stop();
+        printf("reads counted:   %d\n", reads);
+        printf("messages:        %ld\n", messages);
+        printf("allocations:     %ld\n", allocations);
+        QCoreApplication::exit(allocations > messages ? 1 : 0);
+    }
+
+private:
+    int warmup, reads, seen;
+    long messages;
+    QTcpServer server;
+    QTcpSocket *peer;
+    QTimer timer;
+    QByteArray block;
+    QtTelnet telnet;
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    const QStringList args = app.arguments();
+    const bool receiver = args.contains(QLatin1String("-m"));
+    if (args.size() > (receiver ? 2 : 1)) {
+        fprintf(stderr, "usage: allocations [-m]\n");
+        return 2;
+    }
+
+    AllocationCheck check(100, 10000, receiver);
+    if (!check.start()) {
+        fprintf(stderr, "allocations: cannot listen on localhost\n");
+        return 2;
+    }
+    return app.exec();
+}
+
+#include "main.moc"
@@ -0,0 +1,249 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+/*
+  Reports the resident memory used by a number of QtTelnet sessions.
+
+  Without a host the sessions are only created. With a host they
+  connect, negotiate and then stay idle for a few seconds before the
+  memory is measured, which is the state a console collector keeps
+  most of its sessions in. As many plain QTcpSockets are then
+  connected to the same host, and their memory is subtracted, so that
+  what remains is QtTelnet's own state in both cases. Raise the open
+  file limit (ulimit -n) when connecting many sessions.
+
+  The program exits with 1 if a session uses more than the budget set
+  with -b, which defaults to the 2048 bytes documented for QtTelnet.
+*/
+
+#include "qttelnet.h"
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtNetwork/QTcpSocket>
+#include <unistd.h>
+#include <stdio.h>
+
+static qint64 residentBytes()
+{
+    QFile statm(QLatin1String("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly))
+        return -1;
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() < 2)
+        return -1;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+}
+
+class Footprint : public QObject
+{
+    Q_OBJECT
+public:
+    Footprint(int count, const QString &host, quint16 port, int settle,
+              qint64 budget)
+        : count(count), host(host), port(port), settle(settle),
+          budget(budget), pending(0), failed(0), baseline(0),
+          sessionsrss(0)
+    {}
+
+    void start()
+    {
+        baseline = residentBytes();
+        for (int i = 0; i < count; ++i) {
+            QtTelnet *t = new QtTelnet(this);
+            sessions.append(t);
+            if (host.isEmpty())
+                continue;
+            connect(t, SIGNAL(connected()), this, SLOT(sessionDone()));
+            connect(t, SIGNAL(connectionError(QAbstractSocket::SocketError)),
+                    this, SLOT(sessionFailed()));
+            ++pending;
+            t->connectToHost(host, port);
+        }
+        if (!pending)
+            report(residentBytes(), 0);
+    }
+
+private slots:
+    void sessionFailed()
+    {
+        ++failed;
+        sessionDone();
+    }
+
+    void sessionDone()
+    {
+        if (--pending == 0)
+            QTimer::singleShot(settle * 1000, this, SLOT(sessionsIdle()));
+    }
+
+    void sessionsIdle()
+    {
+        sessionsrss = residentBytes();
+        for (int i = 0; i < count; ++i) {
+            QTcpSocket *s = new QTcpSocket(this);
+            sockets.append(s);
+            connect(s, SIGNAL(connected()), this, SLOT(socketDone()));
+            connect(s, SIGNAL(error(QAbstractSocket::SocketError)),
+                    this, SLOT(socketFailed()));
+            connect(s, SIGNAL(readyRead()), this, SLOT(drain()));
+            ++pending;
+            s->connectToHost(host, port);
+        }
+    }
+
+    void socketFailed()
+    {
+        ++failed;
+        socketDone();
+    }
+
+    void socketDone()
+    {
+        if (--pending == 0)
+            QTimer::singleShot(settle * 1000, this, SLOT(socketsIdle()));
+    }
+
+    // The plain sockets keep no more data than the sessions do
+    void drain()
+    {
+        static_cast<QTcpSocket *>(sender())->readAll();
+    }
+
+    void socketsIdle()
+    {
+        const qint64 rss = residentBytes();
+        report(sessionsrss, rss < 0 || sessionsrss < 0 ? -1
+                                                       : rss - sessionsrss);
+    }
+
+private:
+    void report(qint64 rss, qint64 socketbytes)
+    {
+        if (rss < 0 || baseline < 0 || socketbytes < 0) {
+            fprintf(stderr, "footprint: cannot read /proc/self/statm\n");
+            QCoreApplication::exit(1);
+            return;
+        }
+        if (failed) {
+            fprintf(stderr, "footprint: %d connections failed\n", failed);
+            QCoreApplication::exit(1);
+            return;
+        }
+        const qint64 used = rss - baseline - socketbytes;
+        const qint64 persession = used / qMax(1, count);
+        printf("sessions:        %d\n", count);
+        printf("resident total:  %lld KB\n", rss / 1024);
+        if (!host.isEmpty())
+            printf("sockets total:   %lld KB\n", socketbytes / 1024);
+        printf("sessions total:  %lld KB\n", used / 1024);
+        printf("per session:     %lld bytes\n", persession);
+        printf("per 10k:         %lld KB\n",
+               used * 10000 / qMax(1, count) / 1024);
+        if (budget <= 0) {
+            printf("budget:          not checked\n");
+            QCoreApplication::exit(0);
+            return;
+        }
+        const bool exceeded = persession > budget;
+        printf("budget:          %lld bytes, %s\n", budget,
+               exceeded ? "EXCEEDED" : "met");
+        QCoreApplication::exit(exceeded ? 1 : 0);
+    }
+
+    int count;
+    QString host;
+    quint16 port;
+    int settle;
+    qint64 budget;
+    int pending;
+    int failed;
+    qint64 baseline;
+    qint64 sessionsrss;
+    QList<QtTelnet *> sessions;
+    QList<QTcpSocket *> sockets;
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    int count = 10000;
+    int settle = 5;
+    qint64 budget = -1;
+    QString host;
+    quint16 port = 23;
+    QStringList args = app.arguments();
+    args.removeFirst();
+    while (!args.isEmpty()) {
+        const QString arg = args.takeFirst();
+        if (arg == QLatin1String("-n") && !args.isEmpty()) {
+            count = args.takeFirst().toInt();
+        } else if (arg == QLatin1String("-s") && !args.isEmpty()) {
+            settle = args.takeFirst().toInt();
+        } else if (arg == QLatin1String("-b") && !args.isEmpty()) {
+            budget = args.takeFirst().toLongLong();
+        } else if (host.isEmpty() && !arg.startsWith(QLatin1Char('-'))) {
+            host = arg;
+            if (!args.isEmpty() && !args.first().startsWith(QLatin1Char('-')))
+                port = args.takeFirst().toUShort();
+        } else {
+            fprintf(stderr, "usage: footprint [-n sessions] [-s settle-seconds]"
+                    " [-b bytes] [host [port]]\n");
+            return 2;
+        }
+    }
+
+    if (budget < 0)
+        budget = 2048;
+    Footprint footprint(qMax(1, count), host, port, settle, budget);
+    footprint.start();
+    return app.exec();
+}
+
+#include "main.moc"
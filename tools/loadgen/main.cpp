@@ -0,0 +1,499 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+
+/*
+  Opens a number of concurrent QtTelnet sessions to a server, logs
+  in, and then sends commands from a script at a fixed total rate for
+  a while. Reports the connect rate, the login times, the command
+  latencies (from sending a command to seeing the prompt again) with
+  their 50th, 99th and 99.9th percentiles, the CPU time used and the
+  resident memory.
+
+  Without a host, the sessions connect to a stand-in server built on
+  QtTelnetServer, which runs in its own thread in the same process;
+  the CPU time reported then includes the stand-in. Each command is
+  sent as a line; the stand-in answers it with the line and a prompt.
+  Raise the open file limit (ulimit -n) for many sessions.
+*/
+
+#include "qttelnet.h"
+#include "qttelnetserver.h"
+#include "qttelnettrace.h"
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtCore/QElapsedTimer>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+static qint64 residentBytes()
+{
+    QFile statm(QLatin1String("/proc/self/statm"));
+    if (!statm.open(QIODevice::ReadOnly))
+        return -1;
+    const QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() < 2)
+        return -1;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+}
+
+static double cpuSeconds(bool system)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    const struct timeval &tv = system ? usage.ru_stime : usage.ru_utime;
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+  Returns the \a q quantile of the \a sorted samples, in
+  milliseconds.
+*/
+static double percentile(const QVector<qint64> &sorted, double q)
+{
+    if (sorted.isEmpty())
+        return 0;
+    int i = int(ceil(q * sorted.size())) - 1;
+    i = qBound(0, i, sorted.size() - 1);
+    return sorted.at(i) / 1000.0;
+}
+
+static void printTimes(const char *label, QVector<qint64> times)
+{
+    std::sort(times.begin(), times.end());
+    printf("%-16s p50 %.3f  p99 %.3f  p999 %.3f  max %.3f ms (%d)\n",
+           label, percentile(times, 0.5), percentile(times, 0.99),
+           percentile(times, 0.999), percentile(times, 1.0),
+           times.size());
+}
+
+/*
+  A server that asks for a login and a password, if wanted, and then
+  answers every line with the line itself followed by the prompt.
+*/
+class StandIn : public QObject
+{
+    Q_OBJECT
+public:
+    StandIn(bool login, const QString &prompt)
+        : port(0), login(login), prompt(prompt.toLatin1()), server(0)
+    {}
+
+    quint16 port;
+
+public slots:
+    void start()
+    {
+        server = new QtTelnetServer(this);
+        server->setOptions(QtTelnetServer::SuppressGoAhead);
+        connect(server, SIGNAL(newConnection()), this, SLOT(accepted()));
+        if (server->listen(QHostAddress::LocalHost))
+            port = server->serverPort();
+    }
+
+private slots:
+    void accepted()
+    {
+        while (QtTelnetServerConnection *c = server->nextPendingConnection()) {
+            connect(c, SIGNAL(dataReceived(QByteArray)),
+                    this, SLOT(received(QByteArray)));
+            connect(c, SIGNAL(disconnected()), this, SLOT(closed()));
+            State &state = states[c];
+            state.stage = login ? 0 : 2;
+            c->sendData(login ? QByteArray("login: ") : prompt);
+        }
+    }
+
+    void received(const QByteArray &data)
+    {
+        QtTelnetServerConnection *c =
+            static_cast<QtTelnetServerConnection *>(sender());
+        State &state = states[c];
+        for (int i = 0; i < data.size(); ++i) {
+            const char ch = data.at(i);
+            if (ch != '\r' && ch != '\n') {
+                state.line.append(ch);
+                continue;
+            }
+            if (state.line.isEmpty())
+                continue;
+            if (state.stage == 0) {
+                c->sendData("Password: ");
+            } else if (state.stage == 1) {
+                c->sendData("\r\nLast login: never\r\n" + prompt);
+            } else {
+                c->sendData(state.line + "\r\n" + prompt);
+            }
+            state.stage = qMin(state.stage + 1, 2);
+            state.line.clear();
+        }
+    }
+
+    void closed()
+    {
+        QtTelnetServerConnection *c =
+            static_cast<QtTelnetServerConnection *>(sender());
+        states.remove(c);
+        c->deleteLater();
+    }
+
+private:
+    struct State
+    {
+        int stage;
+        QByteArray line;
+    };
+
+    bool login;
+    QByteArray prompt;
+    QtTelnetServer *server;
+    QHash<QtTelnetServerConnection *, State> states;
+};
+
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+public:
+    LoadGenerator(int count, const QString &host, quint16 port)
+        : count(count), host(host), port(port), rate(1000), duration(10),
+          prompt(QLatin1String("$ ")), connectedcount(0), readycount(0),
+          failedcount(0), lastconnect(0), cursor(0), issued(0),
+          skipped(0), idlerss(0)
+    {
+        commands << QLatin1String("echo hello");
+        connect(&ticker, SIGNAL(timeout()), this, SLOT(tick()));
+    }
+
+    int count;
+    QString host;
+    quint16 port;
+    int rate;
+    int duration;
+    QString user, password, prompt;
+    QStringList commands;
+
+    void start()
+    {
+        cpustart[0] = cpuSeconds(false);
+        cpustart[1] = cpuSeconds(true);
+        clock.start();
+        sessions.resize(count);
+        for (int i = 0; i < count; ++i) {
+            Session &s = sessions[i];
+            s.telnet = new QtTelnet(this);
+            s.ready = s.busy = false;
+            s.next = i % commands.size();
+            index.insert(s.telnet, i);
+            connect(s.telnet, SIGNAL(connected()), this, SLOT(connected()));
+            connect(s.telnet, SIGNAL(loggedIn()), this, SLOT(loggedIn()));
+            connect(s.telnet, SIGNAL(message(QString)),
+                    this, SLOT(message(QString)));
+            connect(s.telnet,
+                    SIGNAL(connectionError(QAbstractSocket::SocketError)),
+                    this, SLOT(failed()));
+            if (!user.isEmpty()) {
+                s.telnet->setPromptString(prompt);
+                s.telnet->login(user, password);
+            }
+            s.started = now();
+            s.telnet->connectToHost(host, port);
+        }
+    }
+
+private slots:
+    void connected()
+    {
+        ++connectedcount;
+        lastconnect = now();
+    }
+
+    void loggedIn()
+    {
+        setReady(session());
+    }
+
+    void message(const QString &text)
+    {
+        Session &s = session();
+        s.tail.append(text);
+        if (s.tail.size() > prompt.size())
+            s.tail = s.tail.right(prompt.size());
+        if (!s.tail.endsWith(prompt))
+            return;
+        if (!s.ready && user.isEmpty()) {
+            setReady(s);
+        } else if (s.busy) {
+            latencies.append(now() - s.started);
+            s.busy = false;
+        }
+    }
+
+    void failed()
+    {
+        Session &s = session();
+        if (s.ready)
+            return;
+        s.ready = true; // Never to be used
+        s.busy = true;
+        ++failedcount;
+        checkReady();
+    }
+
+    void tick()
+    {
+        const qint64 elapsed = now() - phasestart;
+        if (elapsed >= qint64(duration) * 1000000) {
+            ticker.stop();
+            // Give the outstanding commands a moment to complete
+            QTimer::singleShot(2000, this, SLOT(report()));
+            return;
+        }
+        const qint64 due = qint64(double(rate) * elapsed / 1e6) - issued;
+        for (qint64 i = 0; i < due; ++i) {
+            ++issued;
+            Session *s = idleSession();
+            if (!s) {
+                ++skipped;
+                continue;
+            }
+            s->busy = true;
+            s->started = now();
+            s->tail.clear();
+            s->telnet->sendData(commands.at(s->next)
+                                + QLatin1String("\r\n"));
+            s->next = (s->next + 1) % commands.size();
+        }
+    }
+
+    void report()
+    {
+        const double seconds = (now() - phasestart) / 1e6;
+        const double usercpu = cpuSeconds(false) - cpustart[0];
+        const double systemcpu = cpuSeconds(true) - cpustart[1];
+        const double total = now() / 1e6;
+
+        printf("sessions:        %d connected, %d failed\n",
+               connectedcount, failedcount);
+        printf("connects/sec:    %.1f\n",
+               lastconnect ? connectedcount / (lastconnect / 1e6) : 0.0);
+        printTimes("login:", logintimes);
+        printf("commands:        %lld sent, %d answered, %lld skipped"
+               " (no idle session)\n", issued - skipped, latencies.size(),
+               skipped);
+        printf("command rate:    %.1f/s (target %d/s)\n",
+               latencies.size() / qMax(seconds, 0.001), rate);
+        printTimes("latency:", latencies);
+        printf("cpu:             %.2fs user, %.2fs system, %.1f%% of a"
+               " core\n", usercpu, systemcpu,
+               100 * (usercpu + systemcpu) / total);
+        printf("resident idle:   %lld KB\n", idlerss / 1024);
+        printf("resident end:    %lld KB\n", residentBytes() / 1024);
+        QCoreApplication::exit(connectedcount ? 0 : 1);
+    }
+
+private:
+    struct Session
+    {
+        QtTelnet *telnet;
+        qint64 started;
+        QString tail;
+        int next;
+        bool ready;
+        bool busy;
+    };
+
+    qint64 now() const { return clock.nsecsElapsed() / 1000; }
+
+    Session &session()
+    {
+        return sessions[index.value(static_cast<QtTelnet *>(sender()))];
+    }
+
+    void setReady(Session &s)
+    {
+        if (s.ready)
+            return;
+        s.ready = true;
+        logintimes.append(now() - s.started);
+        ++readycount;
+        checkReady();
+    }
+
+    void checkReady()
+    {
+        if (readycount + failedcount < count || ticker.isActive())
+            return;
+        idlerss = residentBytes();
+        if (!readycount) {
+            report();
+            return;
+        }
+        phasestart = now();
+        ticker.start(10);
+    }
+
+    Session *idleSession()
+    {
+        for (int i = 0; i < count; ++i) {
+            Session &s = sessions[cursor];
+            cursor = (cursor + 1) % count;
+            if (!s.busy)
+                return &s;
+        }
+        return 0;
+    }
+
+    QVector<Session> sessions;
+    QHash<QtTelnet *, int> index;
+    QElapsedTimer clock;
+    QTimer ticker;
+    double cpustart[2];
+    int connectedcount, readycount, failedcount;
+    qint64 lastconnect;
+    qint64 phasestart;
+    int cursor;
+    qint64 issued, skipped;
+    qint64 idlerss;
+    QVector<qint64> logintimes, latencies;
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    LoadGenerator generator(100, QString(), 23);
+    QString tracefile;
+    QStringList args = app.arguments();
+    args.removeFirst();
+    while (!args.isEmpty()) {
+        const QString arg = args.takeFirst();
+        const bool value = !args.isEmpty();
+        if (arg == QLatin1String("-n") && value) {
+            generator.count = qMax(1, args.takeFirst().toInt());
+        } else if (arg == QLatin1String("-r") && value) {
+            generator.rate = qMax(1, args.takeFirst().toInt());
+        } else if (arg == QLatin1String("-d") && value) {
+            generator.duration = args.takeFirst().toInt();
+        } else if (arg == QLatin1String("-u") && value) {
+            generator.user = args.takeFirst();
+        } else if (arg == QLatin1String("-p") && value) {
+            generator.password = args.takeFirst();
+        } else if (arg == QLatin1String("-P") && value) {
+            generator.prompt = args.takeFirst();
+        } else if (arg == QLatin1String("-t") && value) {
+            tracefile = args.takeFirst();
+        } else if (arg == QLatin1String("-f") && value) {
+            QFile script(args.takeFirst());
+            if (!script.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                fprintf(stderr, "loadgen: cannot open %s\n",
+                        qPrintable(script.fileName()));
+                return 2;
+            }
+            generator.commands.clear();
+            while (!script.atEnd()) {
+                const QString line =
+                    QString::fromLocal8Bit(script.readLine()).trimmed();
+                if (!line.isEmpty())
+                    generator.commands.append(line);
+            }
+            if (generator.commands.isEmpty()) {
+                fprintf(stderr, "loadgen: %s has no commands\n",
+                        qPrintable(script.fileName()));
+                return 2;
+            }
+        } else if (generator.host.isEmpty()
+                   && !arg.startsWith(QLatin1Char('-'))) {
+            generator.host = arg;
+            if (!args.isEmpty() && !args.first().startsWith(QLatin1Char('-')))
+                generator.port = args.takeFirst().toUShort();
+        } else {
+            fprintf(stderr, "usage: loadgen [-n sessions] [-r commands/s]"
+                    " [-d seconds] [-u user] [-p password]\n"
+                    "               [-P prompt] [-f script] [-t trace.json]"
+                    " [host [port]]\n");
+            return 2;
+        }
+    }
+
+    QThread thread;
+    StandIn standin(!generator.user.isEmpty(), generator.prompt);
+    if (generator.host.isEmpty()) {
+        standin.moveToThread(&thread);
+        thread.start();
+        QMetaObject::invokeMethod(&standin, "start",
+                                  Qt::BlockingQueuedConnection);
+        if (!standin.port) {
+            fprintf(stderr, "loadgen: cannot start the stand-in server\n");
+            return 1;
+        }
+        generator.host = QLatin1String("127.0.0.1");
+        generator.port = standin.port;
+    }
+
+    if (!tracefile.isEmpty())
+        QtTelnetTrace::setEnabled(true);
+    generator.start();
+    const int status = app.exec();
+    thread.quit();
+    thread.wait();
+    if (!tracefile.isEmpty() && !QtTelnetTrace::writeChromeTrace(tracefile)) {
+        fprintf(stderr, "loadgen: cannot write %s\n", qPrintable(tracefile));
+        return 2;
+    }
+    return status;
+}
+
+#include "main.moc"
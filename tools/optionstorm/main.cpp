@@ -0,0 +1,198 @@
+/****************************************************************************
+**
+** This file is part of a Qt Solutions component.
+** 
+** Copyright (c) 2009 Nokia Corporation and/or its subsidiary(-ies).
+** 
+** Contact:  Qt Software Information (qt-info@nokia.com)
+** 
+** Commercial Usage  
+** Licensees holding valid Qt Commercial licenses may use this file in
+** accordance with the Qt Solutions Commercial License Agreement provided
+** with the Software or, alternatively, in accordance with the terms
+** contained in a written agreement between you and Nokia.
+** 
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+** 
+** In addition, as a special exception, Nokia gives you certain
+** additional rights. These rights are described in the Nokia Qt LGPL
+** Exception version 1.0, included in the file LGPL_EXCEPTION.txt in this
+** package.
+** 
+** GNU General Public License Usage 
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+** 
+** Please note Third Party Software included with Qt Solutions may impose
+** additional restrictions and it is the user's responsibility to ensure
+** that they have met the licensing requirements of the GPL, LGPL, or Qt
+** Solutions Commercial license and the relevant license of the Third
+** Party Software they are using.
+** 
+** If you are unsure which license is appropriate for your use, please
+** contact the sales department at qt-sales@nokia.com.
+** 
+****************************************************************************/
+
+/*
+  Measures how fast QtTelnet handles option negotiations. A local
+  server sends blocks of nothing but WILL, WONT, DO and DONT for all
+  options, with the odd STATUS suboption, and the time spent in
+  QtTelnet's readyRead() handler is reported per negotiation.
+
+  With -h, a QtTelnetOptionHandler is set for every option, so the
+  time taken by the handlers set at runtime is measured instead.
+*/
+
+#include "qttelnet.h"
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <stdio.h>
+
+class AgreeingHandler : public QtTelnetOptionHandler
+{
+public:
+    bool allowOption(QtTelnet *, int, QtTelnet::OptionSide)
+    { return true; }
+};
+
+class OptionStorm : public QObject
+{
+    Q_OBJECT
+public:
+    OptionStorm(int reads, bool handlers)
+        : reads(reads), seen(0), perblock(0), pending(0), negotiations(0),
+          nsecs(0), peer(0)
+    {
+        if (!handlers)
+            return;
+        for (int option = 0; option < 256; ++option)
+            telnet.setOptionHandler(option, &handler);
+    }
+
+    bool start()
+    {
+        if (!server.listen(QHostAddress::LocalHost))
+            return false;
+        connect(&server, SIGNAL(newConnection()), this, SLOT(accepted()));
+        connect(&timer, SIGNAL(timeout()), this, SLOT(sendBlock()));
+
+        // Time only what happens between these two slots, which
+        // surround QtTelnet's own readyRead() handler.
+        QTcpSocket *socket = new QTcpSocket;
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readStarted()));
+        telnet.setSocket(socket);
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readFinished()));
+        telnet.connectToHost(QLatin1String("127.0.0.1"), server.serverPort());
+
+        // Every operation on every option, in an order that keeps
+        // turning options on and off. LOGOUT and TIMING-MARK are left
+        // out since they end the session or flush output.
+        const char status[10] = { char(255), char(250), 5, 0, char(251), 3,
+                                  char(253), 1, char(255), char(240) };
+        const char ops[4] = { char(251), char(253), char(252), char(254) };
+        for (int i = 0; i < 4; ++i) {
+            for (int option = 0; option < 256; ++option) {
+                if (option == 6 || option == 18)
+                    continue;
+                const char c[3] = { char(255), ops[i], char(option) };
+                block.append(c, sizeof(c));
+                ++perblock;
+                if (option % 64 == 0)
+                    block.append(status, sizeof(status));
+            }
+        }
+        return true;
+    }
+
+private slots:
+    void accepted()
+    {
+        peer = server.nextPendingConnection();
+        connect(peer, SIGNAL(readyRead()), this, SLOT(discardReplies()));
+        timer.start(1);
+    }
+
+    void sendBlock()
+    {
+        peer->write(block);
+    }
+
+    void discardReplies()
+    {
+        peer->readAll();
+    }
+
+    void readStarted()
+    {
+        clock.start();
+        pending = telnet.socket()->bytesAvailable();
+    }
+
+    void readFinished()
+    {
+        nsecs += clock.nsecsElapsed();
+        negotiations += pending * perblock / block.size();
+        if (++seen < reads)
+            return;
+        timer.stop();
+        printf("negotiations:    %lld\n", negotiations);
+        printf("ns/negotiation:  %.1f\n", double(nsecs) / negotiations);
+        printf("negotiations/s:  %.0f\n", negotiations * 1e9 / nsecs);
+        QCoreApplication::exit(0);
+    }
+
+private:
+    int reads, seen;
+    int perblock;
+    qint64 pending, negotiations, nsecs;
+    QTcpServer server;
+    QTcpSocket *peer;
+    QTimer timer;
+    QElapsedTimer clock;
+    QByteArray block;
+    AgreeingHandler handler;
+    QtTelnet telnet;
+};
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    int reads = 10000;
+    bool handlers = false;
+    const QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        if (args.at(i) == QLatin1String("-h")) {
+            handlers = true;
+        } else if (args.at(i) == QLatin1String("-n") && i + 1 < args.size()) {
+            reads = args.at(++i).toInt();
+        } else {
+            fprintf(stderr, "usage: optionstorm [-n reads] [-h]\n");
+            return 2;
+        }
+    }
+
+    OptionStorm storm(qMax(1, reads), handlers);
+    if (!storm.start()) {
+        fprintf(stderr, "optionstorm: cannot listen on localhost\n");
+        return 2;
+    }
+    return app.exec();
+}
+
+#include "main.moc"
@@ -0,0 +1,8 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+QT -= gui
+
+include(../../src/qttelnet.pri)
+
+SOURCES += main.cpp
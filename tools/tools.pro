@@ -0,0 +1,5 @@
+TEMPLATE = subdirs
+
+SUBDIRS += optionstorm
+unix:SUBDIRS += footprint loadgen
+linux*:SUBDIRS += allocations